@@ -1,12 +1,16 @@
 #include "altplanet.h"
-#include "triangulate.hpp"
-#include "incrtriangulate.hpp"
+#include "surfacetriangulate.h"
+#include "surfacesampling.h"
 #include "../common/macro/macrodebugassert.h"
 #include "../common/macro/macroprofile.h"
 #include "../common/macro/debuglog.h"
 #include "../common/procedural/noise3d.h"
+#include "../common/procedural/counterrng.h"
 #include "../common/mathext.h"
 #include "../common/stdext.h"
+#include "../common/threads/parallelfor.h"
+#include "../common/filecache.h"
+#include "../common/meshtopology.h"
 
 #include <algorithm>
 #include <array>
@@ -14,8 +18,6 @@
 #include <functional>
 #include <iostream>
 #include <tuple>
-#include <unordered_set>
-#include <unordered_map>
 #include <vector>
 
 
@@ -27,11 +29,12 @@ namespace AltPlanet
 													const SpaceHash3D &spacehash,
 													const Shape::BaseShape &planet_shape);
 
-    void removePointsTooClose(std::vector<vmath::Vector3> &points, SpaceHash3D &spacehash, float min_distance);
+    // returns the old to new point index remap, -1 for removed points
+    std::vector<int> removePointsTooClose(std::vector<vmath::Vector3> &points, SpaceHash3D &spacehash, float min_distance);
 
     float scaleByPointDensity(const SpaceHash3D &spacehash) {return cbrt(1.0f/spacehash.getPointDensity());}
 
-    PlanetGeometry generate(unsigned int n_points, const Shape::BaseShape &planet_shape)
+    PlanetGeometry generate(unsigned int n_points, const Shape::BaseShape &planet_shape, unsigned int seed, PointSampling sampling)
 	{
         PROFILE_BEGIN(generate_timer);
         std::cout << "generating planet... " << std::endl;
@@ -40,50 +43,66 @@ namespace AltPlanet
 		std::vector<vmath::Vector3> &points = geometry.points;
 		std::vector<gfx::Triangle> &triangles = geometry.triangles;
 
-		// generate random points
-		Shape::AABB aabb = planet_shape.getAABB();
-
-
-		points.reserve(n_points);
+		int n_redistribute_iterations = 25;
+		bool filter_degenerate_points = true;
 
-		for (unsigned int i = 0; i < n_points; i++)
+		if (sampling == PointSampling::PoissonDisk)
+		{
+			// already well spaced and no two points too close, repulsion would only undo that
+			points = poissonDiskSurface(n_points, planet_shape, seed);
+			n_redistribute_iterations = 0;
+			filter_degenerate_points = false;
+		}
+		else
 		{
-			vmath::Vector3 point = {frand(-aabb.width *0.75, aabb.width *0.75),
-									frand(-aabb.height*0.75, aabb.height*0.75),
-									frand(-aabb.width *0.75, aabb.width *0.75)};
+			// generate random points, three draws per point
+			Shape::AABB aabb = planet_shape.getAABB();
+			Procedural::CounterRng rng(seed, Procedural::RngStage::PointSampling);
+
+			points.resize(n_points);
 
-			// project onto shape
-			point = planet_shape.projectPoint(point);
+			Threads::parallelFor(0, int(n_points), [&](int begin, int end)
+			{
+				for (int i = begin; i < end; i++)
+				{
+					vmath::Vector3 point = {rng.uniform(i, 0, -aabb.width *0.75f, aabb.width *0.75f),
+											rng.uniform(i, 1, -aabb.height*0.75f, aabb.height*0.75f),
+											rng.uniform(i, 2, -aabb.width *0.75f, aabb.width *0.75f)};
 
-			points.push_back(point);
+					// project onto shape
+					points[i] = planet_shape.projectPoint(point);
+				}
+			});
 		}
 
 		// hash the points onto a 3d grid
 		SpaceHash3D spacehash(points);
 
-		// Distribute them (more) evenly
-		std::vector<vmath::Vector3> pt_force;
-		pt_force.resize(points.size());
+		// Distribute them (more) evenly, double buffered so the passes can run in parallel
+		std::vector<vmath::Vector3> points_next;
+		points_next.reserve(points.size());
 
 		//int k_nn = 5; // nearest neighbors
 		//float repulse_factor = 0.006f; // repulsive force factor
 
         //std::cout << "distributing points evenly... ";
-		int n_redistribute_iterations = 25;
 		for (int i_red = 0; i_red < n_redistribute_iterations; i_red++)
 		{
 			float it_repulsion_factor = i_red > 2 ? 0.003f : 0.008f;
             //std::cout << i_red << "/" << n_redistribute_iterations << std::endl;
 			//float it_repulse_factor = repulse_factor/(sqrt(float(i_red)));
-			pointsRepulse(points, spacehash, planet_shape, it_repulsion_factor);
+			pointsRepulseJacobi(points, points_next, spacehash, planet_shape, it_repulsion_factor);
 		}
         //std::cout << "done!" << std::endl;
 
 		// finished distributing them evenly...
 
-        float degenerate_point_sensitivity = 0.2480/2.0f;
-        float min_distance = degenerate_point_sensitivity*scaleByPointDensity(spacehash); // size dependent
-        removePointsTooClose(points, spacehash, min_distance);
+        if (filter_degenerate_points)
+        {
+            float degenerate_point_sensitivity = 0.2480/2.0f;
+            float min_distance = degenerate_point_sensitivity*scaleByPointDensity(spacehash); // size dependent
+            removePointsTooClose(points, spacehash, min_distance);
+        }
 
 
 		// triangulate... :)
@@ -102,48 +121,43 @@ namespace AltPlanet
 		return geometry;
 	}
 
-	void pointsRepulse(std::vector<vmath::Vector3> &points, SpaceHash3D &spacehash, const Shape::BaseShape &planet_shape, float repulse_factor)
+	// repulsive force on point i_p from its neighbours within force_radius, clamped in length
+	inline vmath::Vector3 repulsionForce(int i_p, const std::vector<vmath::Vector3> &points, const SpaceHash3D &spacehash,
+										 float force_radius, float repulse_factor_scaled)
 	{
-		float largest_force = 0.0f;
+		vmath::Vector3 force = {0.0f, 0.0f, 0.0f};
+		spacehash.forEachPointInSphere(points[i_p], force_radius,
+									   [&](const int &i_n) -> bool
+									   {
+										   const auto diff_vector = points[i_p] - points[i_n];
+										   float diff_length = vmath::length(diff_vector);
+										   if (diff_length > 0.0f)
+										   {
+											   force += repulse_factor_scaled * vmath::normalize(diff_vector)/(diff_length);
+										   }
+										   return false;
+									   });
+
+		// reduce the force size
+		float force_size = vmath::length(force);
+		float use_length = std::min(0.2f, force_size);
+		force = use_length*vmath::normalize(force);
+
+		// fix NaN
+		for (int i = 0; i < 3; i++) if(isnan_lame(force[i])) force = {0.f, 0.f, 0.f};
 
-		std::vector<vmath::Vector3> pt_force;
-		pt_force.resize(points.size());
+		return force;
+	}
 
+	void pointsRepulse(std::vector<vmath::Vector3> &points, SpaceHash3D &spacehash, const Shape::BaseShape &planet_shape, float repulse_factor)
+	{
         float forceRadius = 1.8f*scaleByPointDensity(spacehash);
         float repulse_factor_scaled = 2.0f*forceRadius*repulse_factor;
 
 		for (int i_p = 0; i_p<points.size(); i_p++)
 		{
-			pt_force[i_p] = {0.0f, 0.0f, 0.0f};
-            spacehash.forEachPointInSphere(points[i_p], forceRadius,
-										   [&](const int &i_n) -> bool
-										   {
-											   const auto diff_vector = points[i_p] - points[i_n];
-											   float diff_length = vmath::length(diff_vector);
-											   if (diff_length > 0.0f)
-											   {
-                                                   pt_force[i_p] += repulse_factor_scaled * vmath::normalize(diff_vector)/(diff_length);
-											   }
-											   return false;
-										   });
-
-			//for (int i = 0; i < 3; i++) if(isnan_lame(point[i])) std::cerr << "nan detected" << std::endl;
-
-			// reduce the force size
-			float force_size = vmath::length(pt_force[i_p]);
-			float use_length = std::min(0.2f, force_size);
-			pt_force[i_p] = use_length*vmath::normalize(pt_force[i_p]);
-
-			// fix NaN
-			for (int i = 0; i < 3; i++) if(isnan_lame(pt_force[i_p][i])) pt_force[i_p] = {0.f, 0.f, 0.f};
-
-			// apply the force
-			points[i_p] += pt_force[i_p];
-
-			if (force_size > largest_force) largest_force = force_size;
-
-			//std::cout << "n_neighbors: " << neighbors.size() << std::endl;
-			//std::cout << "length(force):" << force_size << std::endl;
+			// apply the force, in place: later points see the already moved earlier points
+			points[i_p] += repulsionForce(i_p, points, spacehash, forceRadius, repulse_factor_scaled);
 		}
 
 		// check if nan
@@ -153,14 +167,34 @@ namespace AltPlanet
 		}
 
 		// reproject
-		for (unsigned int i = 0; i < points.size(); i++)
+		planet_shape.projectPoints(points.data(), points.data(), int(points.size()));
+
+		// move the points in the hash, the number of points is unchanged
+		spacehash.update(points);
+	}
+
+	void pointsRepulseJacobi(std::vector<vmath::Vector3> &points, std::vector<vmath::Vector3> &points_next,
+							 SpaceHash3D &spacehash, const Shape::BaseShape &planet_shape, float repulse_factor)
+	{
+        float forceRadius = 1.8f*scaleByPointDensity(spacehash);
+        float repulse_factor_scaled = 2.0f*forceRadius*repulse_factor;
+
+		points_next.resize(points.size());
+
+		// every point only reads the previous positions, so the points can be moved in any order
+		Threads::parallelFor(0, points.size(), [&](int i_begin, int i_end)
 		{
-			// project onto shape
-			points[i] = planet_shape.projectPoint(points[i]);
-		}
+			for (int i_p = i_begin; i_p<i_end; i_p++)
+			{
+				points_next[i_p] = points[i_p] + repulsionForce(i_p, points, spacehash, forceRadius, repulse_factor_scaled);
+			}
+			planet_shape.projectPoints(&points_next[i_begin], &points_next[i_begin], i_end-i_begin);
+		});
+
+		std::swap(points, points_next);
 
-		// rehash the points
-		spacehash.rehash(points);
+		// move the points in the hash, the number of points is unchanged
+		spacehash.update(points);
 	}
 
 	void pointsRepulse(std::vector<vmath::Vector3> &points, const Shape::BaseShape &planet_shape, float repulse_factor)
@@ -175,51 +209,6 @@ namespace AltPlanet
 	//    std::sort(inds.begin(), inds.end());
 	//}
 
-	inline vmath::Vector3 triangleCross(const gfx::Triangle &triangle, const std::vector<vmath::Vector3> &points)
-	{
-		const auto v1 = points[triangle[1]] - points[triangle[0]];
-		const auto v2 = points[triangle[2]] - points[triangle[0]];
-		return vmath::cross(v1,v2);
-	}
-
-	inline vmath::Vector3 triangleNormal(const gfx::Triangle &triangle, const std::vector<vmath::Vector3> &points)
-	{
-		return vmath::normalize(triangleCross(triangle, points));
-	}
-
-	void orientTriangles(const std::vector<vmath::Vector3> &points,
-						 std::vector<gfx::Triangle> &triangles,
-						 const Shape::BaseShape &planet_shape)
-	{
-		for (int i_t = 0; i_t<triangles.size(); i_t++)
-		{
-			gfx::Triangle &tri = triangles[i_t];
-			const auto v1 = points[tri[1]] - points[tri[0]];
-			const auto v2 = points[tri[2]] - points[tri[0]];
-
-			if (vmath::dot(vmath::cross(v1,v2), planet_shape.getGradDir(points[tri[0]])) < 0.0f)
-			{
-				// reverse the order of the triangle indices
-				std::swap(tri[0], tri[2]);
-			}
-		}
-	}
-
-	inline void surfaceGradFilterTriangles( const std::vector<vmath::Vector3> &points,
-											std::vector<gfx::Triangle> &triangles,
-											const Shape::BaseShape &planet_shape)
-	{
-		float n_dot_thresh = 0.9f;
-		auto remove_predicate = [&](const gfx::Triangle &tri) -> bool
-		{
-			vmath::Vector3 tri_n = triangleNormal(tri, points);
-			vmath::Vector3 av_pt = 0.33f*(points[tri[0]]+points[tri[1]]+points[tri[2]]);
-			vmath::Vector3 grad_planet_n = vmath::normalize(planet_shape.getGradDir(av_pt));
-			return vmath::dot(tri_n, grad_planet_n)<n_dot_thresh;
-		};
-		triangles.erase(std::remove_if(triangles.begin(), triangles.end(), remove_predicate), triangles.end());
-	}
-
     /*
 	inline bool checkIfTrianglesIntersect(const std::vector<vmath::Vector3> &points,
 										  const gfx::Triangle &tri1, const gfx::Triangle &tri2)
@@ -270,133 +259,31 @@ namespace AltPlanet
         std::cout << "found_intersecting_tris: " << found_intersecting_tris << std::endl;
     }*/
 	
-    inline void tripleEdgeFilterTriangles(std::vector<gfx::Triangle> &triangles)
-	{
-		// build edge-triangle adjacency and triangle-edge adjacency
-		std::unordered_map<gfx::Line, std::vector<int>> edge_tri_adj;
-
-		for (int i_tri = 0; i_tri < triangles.size(); ++i_tri) 
-		{
-			const gfx::Triangle &tri = triangles[i_tri];
-			for (int j = 0; j < 3; j++)
-			{
-				gfx::Line line = { tri[j%3], tri[(j+1)%3] };
-				if (line.indices[1] > line.indices[0]) std::swap(line.indices[0], line.indices[1]);
-
-				auto it = edge_tri_adj.find(line);
-				if (it == edge_tri_adj.end())
-				{
-					edge_tri_adj.insert(std::make_pair(line, std::vector<int>()));
-				}
-				edge_tri_adj[line].push_back(i_tri);
-			}	
-		}
-
-		// for each triangle
-		//   count the number of edges with more than 2 triangles adjacent
-		//     if more than two edges has 2 triangles adjacent, then mark this triangle for removal
-		auto rogue_tri = [&](const gfx::Triangle &tri) -> bool
-		{
-			int triple_edge_count = 0; // number of edges with three or more triangles
-			for (int j = 0; j < 3; j++)
-			{
-				gfx::Line line = { tri[j%3], tri[(j+1)%3] };
-				if (line.indices[1] > line.indices[0]) std::swap(line.indices[0], line.indices[1]);
-				if (edge_tri_adj[line].size() > 2) ++triple_edge_count;
-			}
-			return triple_edge_count > 1;
-		};
-
-        // remove triangles
-		int w = 0;
-		for (int r = 0; r < triangles.size(); r++)
-	   	{
-			const gfx::Triangle &tri = triangles[r];
-
-			// read from r, write to index w	
-			if (rogue_tri(tri))
-			{
-				// remove it from the edge vector
-				for (int j = 0; j < 3; j++)
-				{
-					gfx::Line line = { tri[j%3], tri[(j+1)%3] };
-					if (line.indices[1] > line.indices[0]) std::swap(line.indices[0], line.indices[1]);
-
-					auto &v = edge_tri_adj[line];
-					v.erase(std::remove(v.begin(), v.end(), r), v.end());
-				}
-			}
-			else 
-			{
-				// copy the read triangle to the writing position and increment the write index
-				triangles[w] = triangles[r];
-				++w;
-			}
-		}
-
-		// resize the vector to its final size (w)
-		triangles.resize(w);
-	}
 
 	std::vector<gfx::Triangle> triangulateAndOrient(const std::vector<vmath::Vector3> &points,
 													const SpaceHash3D &spacehash, const Shape::BaseShape &planet_shape)
 	{
-        float triangulationRadius = 0.78f*scaleByPointDensity(spacehash);
-        //std::cout << "n_points = " << points.size() << ", rad = " << triangulationRadius << std::endl;
-
-		// create a triangulation
-        Triangulate::ReturnType trisandhash = Triangulate::trianglesWithHash(points, triangulationRadius, spacehash);
-//        Triangulate::ReturnType trisandhash = Triangulate::incrTriangulate(points, triangulationRadius, spacehash); // need to look more into this
-		std::vector<gfx::Triangle> &triangles = trisandhash.triangles;
-		//std::unordered_set<gfx::Triangle> &existing_tris = trisandhash.trianglesHash;
-
-		// orient triangles
-		orientTriangles(points, triangles, planet_shape);
-
-		// filter away triangles with normals different from planet shape normal
-		surfaceGradFilterTriangles(points, triangles, planet_shape);
-
-        // Filter away triangles with more than two edges that border three triangles
-        // an edge should strictly be between two triangles for "manifoldness"
-        tripleEdgeFilterTriangles(triangles);
-
+		// create a triangulation, the surface delaunay stars give an oriented manifold directly
+		std::vector<gfx::Triangle> triangles = Triangulate::surfaceDelaunay(points, spacehash, planet_shape);
 
         // analyse edges
-        int num_edges = 0;
-        std::unordered_set<gfx::Line> existing_edges;
-        std::vector<std::vector<int>> point_point_adj(points.size());
-        for (const auto &tri : triangles)
-        {
-            for (int i=0; i<3; i++)
-            {
-                int i_next =(i+1)%3;
-                std::array<int,2> inds = {tri[i], tri[i_next]};
-                std::sort(inds.begin(), inds.end());
-
-                gfx::Line line = {inds[0], inds[1]};
-
-                if (existing_edges.find(line) == existing_edges.end())
-                {
-                    existing_edges.insert(line);
-                    num_edges++;
-                    point_point_adj[inds[0]].push_back(inds[1]);
-                    point_point_adj[inds[1]].push_back(inds[0]);
-                }
-            }
-        }
+        gfx::MeshTopology topology(points.size(), triangles);
 
         // compute the euler characteristic
-        int euler_characteristic = points.size()-num_edges+triangles.size();
+        int euler_characteristic = topology.eulerCharacteristic();
 
         /*std::cout << "num points = " << points.size() << std::endl;
 		std::cout << "num triangles = " << triangles.size() << std::endl;
         std::cout << "num edges = " << num_edges << std::endl;*/
 		std::cout << "euler characteristic = " << euler_characteristic << std::endl;
 
+		// every edge has two triangles, no holes are left
+		DEBUG_ASSERT(topology.isClosedManifold());
+
 		return triangles;
 	}
 
-    void perturbHeightNoise3D(std::vector<vmath::Vector3> &points, const Shape::BaseShape &planet_shape)
+    void perturbHeightNoise3D(std::vector<vmath::Vector3> &points, const Shape::BaseShape &planet_shape, unsigned int seed)
     {
         Shape::AABB aabb = planet_shape.getAABB();
 
@@ -405,150 +292,140 @@ namespace AltPlanet
         float size_factor = aabb.width/planet_shape.getDim();
 
         DEBUG_LOG("size_factor" << size_factor);
-        Noise3D noise3d(aabb.width, aabb.height, smallest_noise_scale, 198327);
+        Noise3D noise3d(aabb.width, aabb.height, smallest_noise_scale, seed ^ 198327u);
 
-        for (auto &point : points)
+        std::vector<float> noise_samples(points.size());
+        noise3d.sampleBatch(points.data(), noise_samples.data(), points.size());
+
+        for (int i = 0; i < points.size(); i++)
         {
-            float noise_sample = size_factor/4.0f * 0.1f*noise3d.sample(point);
-            planet_shape.scalePointHeight(point, std::max(1.0f+noise_sample, 0.5f));
+            float noise_sample = size_factor/4.0f * 0.1f*noise_samples[i];
+            planet_shape.scalePointHeight(points[i], std::max(1.0f+noise_sample, 0.5f));
         }
         //DEBUG_LOG("max perturbation = ")
     }
 
-    void removePointsTooClose(std::vector<vmath::Vector3> &points, SpaceHash3D &spacehash, float min_distance)
+    std::vector<int> removePointsTooClose(std::vector<vmath::Vector3> &points, SpaceHash3D &spacehash, float min_distance)
     {
-        int total_points_filtered = 0;
-        bool found_none_tooclose = false;
-        while (!found_none_tooclose)
-        {
-            found_none_tooclose = true; // assume everything is ok until proven otherwise
+        int n_points = points.size();
 
-            std::vector<std::pair<int, int>> pairs_too_close;
-
-            // search in a sphere around each point
-            for (int i_p = 0; i_p<points.size(); i_p++)
+        // greedy filter in index order: a point is removed if it is too close to a point
+        // before it that is kept, so after one pass no kept pair is too close
+        std::vector<char> keep(n_points, 1);
+        for (int i_p = 0; i_p<n_points; i_p++)
+        {
+            spacehash.forEachPointInSphere(points[i_p], min_distance, [&](const int &i_n) -> bool
             {
-                std::vector<int> neighbors;
-                spacehash.forEachPointInSphere(points[i_p], min_distance,
-                                               [&](const int &i_n) -> bool // stop sphere search after first found
-                                               {
-                                                    if (i_n != i_p) neighbors.push_back(i_n);
-                                                    return false;
-                                               });
-
-                if (neighbors.size() > 0)
-                {
-                    found_none_tooclose = false;
-                    // pick only the closest one
-                    std::sort(neighbors.begin(), neighbors.end(), [&](int i0, int i1)
-                    {
-                        return vmath::length(points[i0]-points[i_p]) < vmath::length(points[i1]-points[i_p]);
-                    });
-                    int i_n = neighbors[0];
-
-                    auto pn_pair = (i_n > i_p) ? std::make_pair(i_p, i_n) : std::make_pair(i_n, i_p);
-                    pairs_too_close.push_back(pn_pair);
-                }
-            }
-            // at this point two copies might exist of a closest point pair, need to remove duplicates
-            std::sort( pairs_too_close.begin(), pairs_too_close.end() );
-            pairs_too_close.erase( std::unique( pairs_too_close.begin(), pairs_too_close.end() ), pairs_too_close.end() );
-
-            // Only one of a "too close pair" needs to be deleted, arbitrarily pick the first one
-            auto filter = [](const std::pair<int, int> &pair) -> int {return pair.first;};
-            std::vector<int> to_del_inds = StdExt::vector_map<std::pair<int,int>, int>(pairs_too_close, filter);
-            // why cannot the template arguments be deduced?
+                bool early_return = i_n < i_p && keep[i_n];
+                if (early_return) keep[i_p] = 0;
+                return early_return;
+            });
+        }
 
-            StdExt::remove_index(points, to_del_inds);
+        // compact the points once, old to new index remap with -1 for removed points
+        std::vector<int> point_remap(n_points, -1);
+        int n_kept = 0;
+        for (int i_p = 0; i_p<n_points; i_p++)
+        {
+            if (!keep[i_p]) continue;
+            point_remap[i_p] = n_kept;
+            points[n_kept++] = points[i_p];
+        }
+        points.resize(n_kept);
 
-            total_points_filtered += to_del_inds.size();
+        spacehash.compact(point_remap);
 
-            spacehash.rehash(points);
-        } // while found_none_tooclose
+        std::cout << "filtered out " << n_points-n_kept << " degenerate points" << std::endl;
 
-        std::cout << "filtered out " << total_points_filtered << " degenerate points" << std::endl;
+        return point_remap;
     }
 
-// the pregenerated grid shapes used certain input parameters
+// the planet shapes before scaling
 #define ALT_PLANET_FILE_SPHERE_RAD 3.0f
 #define ALT_PLANET_FILE_TORUS_MAJOR_RAD 3.0f
 #define ALT_PLANET_FILE_TORUS_MINOR_RAD 1.0f
 
-    void createOrLoadPlanetGeom(PlanetGeometry &alt_planet_geometry, AltPlanet::Shape::BaseShape *&planet_shape_ptr,
-                                PlanetShape shape, float planet_scale_factor)
+// generated geometry is cached here, keyed by the generation parameters
+#define ALT_PLANET_CACHE_DIRECTORY "res/meshes/cache"
+#define ALT_PLANET_CACHE_MAX_BYTES (256ull*1024ull*1024ull)
+
+    Shape::BaseShape *createPlanetShape(PlanetShape shape, float planet_scale_factor)
     {
-        std::string planet_filename;
         switch(shape)
         {
         case(PlanetShape::Sphere):
-        {
-            float radius = ALT_PLANET_FILE_SPHERE_RAD * planet_scale_factor;
-            planet_shape_ptr = new AltPlanet::Shape::Sphere(radius);
-            planet_filename = "res/meshes/sphere_planet.dat";
+            return new AltPlanet::Shape::Sphere(ALT_PLANET_FILE_SPHERE_RAD * planet_scale_factor);
+        case(PlanetShape::Torus):
+            return new AltPlanet::Shape::Torus(ALT_PLANET_FILE_TORUS_MAJOR_RAD * planet_scale_factor,
+                                               ALT_PLANET_FILE_TORUS_MINOR_RAD * planet_scale_factor);
+        default:
+            DEBUG_ASSERT(false&&"invalid planet shape enum");
         }
+        return nullptr;
+    }
+
+    void createOrLoadPlanetGeom(PlanetGeometry &alt_planet_geometry, AltPlanet::Shape::BaseShape *&planet_shape_ptr,
+                                PlanetShape shape, float planet_scale_factor, unsigned int seed,
+                                PointSampling sampling)
+    {
+        planet_shape_ptr = createPlanetShape(shape, planet_scale_factor);
+        float dimensions[2] = {0.0f, 0.0f};
+        switch(shape)
+        {
+        case(PlanetShape::Sphere):
+            dimensions[0] = ALT_PLANET_FILE_SPHERE_RAD * planet_scale_factor;
         break;
         case(PlanetShape::Torus):
-        {
-            float major_radius = ALT_PLANET_FILE_TORUS_MAJOR_RAD * planet_scale_factor;
-            float minor_radius = ALT_PLANET_FILE_TORUS_MINOR_RAD * planet_scale_factor;
-            planet_shape_ptr = new AltPlanet::Shape::Torus(major_radius, minor_radius);
-            planet_filename = "res/meshes/torus_planet.dat";
-        }
+            dimensions[0] = ALT_PLANET_FILE_TORUS_MAJOR_RAD * planet_scale_factor;
+            dimensions[1] = ALT_PLANET_FILE_TORUS_MINOR_RAD * planet_scale_factor;
         break;
         default:
             DEBUG_ASSERT(false&&"invalid planet shape enum");
         }
         AltPlanet::Shape::BaseShape &planet_shape = *planet_shape_ptr;
 
-        // try to open planet file
-        std::ifstream file(planet_filename, std::ios::binary);
-        bool loading_went_bad = false;
-        if (file.is_open()) {
-            // load planet from file
-            try {
-                std::cout << "loading planet file: " << planet_filename << std::endl;
-                Serial::StreamType resin = Serial::read_from_file(planet_filename);
-                alt_planet_geometry = Serial::deserialize<AltPlanet::PlanetGeometry>(resin);
-
-                // scale planet points relative to the size they were generated as...
-                for (auto &pt : alt_planet_geometry.points)
-                {
-                    pt = vmath::Matrix3::scale(planet_scale_factor * vmath::Vector3(1.0)) * pt;
-                }
-            } catch (...) {
-                loading_went_bad = true;
-                std::cout << "something went wrong while trying to load " << planet_filename << std::endl;
-            }
-        }
-        else
+        // everything the generated geometry depends on
+        unsigned int n_points = NUM_GEN_POINTS_DEFAULT;
+        Serial::StreamType cache_key;
+        Serial::serialize(std::make_tuple(GEOMETRY_PIPELINE_VERSION, static_cast<int>(shape),
+                                          dimensions[0], dimensions[1], n_points, seed,
+                                          static_cast<int>(sampling)), cache_key);
+
+        FileCache::Directory cache(ALT_PLANET_CACHE_DIRECTORY, ALT_PLANET_CACHE_MAX_BYTES);
+
+        // try to load the planet from the cache. The checksums are not checked, that would read
+        // the whole entry once more, the copy checks the triangles instead. The geometry is
+        // subdivided in place later, so it is copied out of the mapping once.
+        bool loaded = false;
+        Archive::MappedFile cache_entry;
+        PlanetGeometryView cached_geometry;
+        if (cache.load(cache_key, cache_entry, false) && viewFromArchive(cache_entry, cached_geometry))
         {
-            std::cout << "could not open file " << planet_filename << std::endl;
-            loading_went_bad = true;
+            loaded = cached_geometry.copyChecked(alt_planet_geometry);
+            std::cout << (loaded ? "loaded planet geometry from cache" : "damaged planet geometry in cache") << std::endl;
         }
+        cache_entry.close();
 
-        if (loading_went_bad)
+        if (!loaded)
         {
             std::cout << "generating planet geometry" << std::endl;
-            // create the planet
 
             // Generate geometry
-            alt_planet_geometry = AltPlanet::generate(10000, planet_shape);
+            alt_planet_geometry = AltPlanet::generate(n_points, planet_shape, seed, sampling);
 
-            // Serialize it
-            try {
-                Serial::serialize_to_file(alt_planet_geometry, planet_filename);
-            } catch (...) {
-                std::cout << "something went wrong while trying to serialize to " << planet_filename << std::endl;
-            }
+            // Cache it
+            Archive::Writer cache_writer;
+            addToArchive(cache_writer, alt_planet_geometry);
+            if (!cache.store(cache_key, cache_writer)) std::cout << "could not cache the planet geometry" << std::endl;
         }
     }
 
     void reproject(std::vector<vmath::Vector3> &points, const Shape::BaseShape &planet_shape)
     {
-        for (auto &pt : points)
+        Threads::parallelFor(0, int(points.size()), [&](int begin, int end)
         {
-            pt = planet_shape.projectPoint(pt);
-        }
+            planet_shape.projectPoints(&points[begin], &points[begin], end-begin);
+        });
     }
 
 } // namespace AltPlanet
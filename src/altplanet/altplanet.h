@@ -17,18 +17,40 @@ namespace AltPlanet
 
 static const unsigned int NUM_GEN_POINTS_DEFAULT = 10000;
 
-PlanetGeometry generate(unsigned int n_points, const Shape::BaseShape &planet_shape);
+// Part of the geometry cache key. Bump it whenever generate() changes what it outputs for
+// the same parameters, so geometry cached by an older version is not used.
+static const unsigned int GEOMETRY_PIPELINE_VERSION = 3;
+
+// RandomRelaxed: uniform random points projected onto the shape, evened out by repulsion passes.
+// PoissonDisk: blue noise points sampled directly on the surface, no relaxation needed.
+enum class PointSampling {RandomRelaxed, PoissonDisk};
+
+// The same arguments always give the same geometry, the random numbers are drawn from a
+// Procedural::CounterRng keyed by seed.
+PlanetGeometry generate(unsigned int n_points, const Shape::BaseShape &planet_shape, unsigned int seed,
+                        PointSampling sampling = PointSampling::RandomRelaxed);
 
 enum class PlanetShape {Sphere, Torus, Disk};
+// The planet shape createOrLoadPlanetGeom uses for these arguments, owned by the caller.
+Shape::BaseShape *createPlanetShape(PlanetShape shape, float planet_scale_factor);
+// Creates the planet shape and loads its geometry from the cache, or generates and caches it
+// if no geometry was cached for the same shape, size, seed, sampling and pipeline version.
 void createOrLoadPlanetGeom(PlanetGeometry &alt_planet_geometry, Shape::BaseShape *&planet_shape_ptr,
-                            PlanetShape shape, float planet_scale_factor);
+                            PlanetShape shape, float planet_scale_factor, unsigned int seed,
+                            PointSampling sampling);
 
-void perturbHeightNoise3D(std::vector<vmath::Vector3> &points, const Shape::BaseShape &planet_shape);
+void perturbHeightNoise3D(std::vector<vmath::Vector3> &points, const Shape::BaseShape &planet_shape, unsigned int seed);
 
 void pointsRepulse(std::vector<vmath::Vector3> &points, SpaceHash3D &spacehash, const Shape::BaseShape &planet_shape, float repulse_factor);
 
 void pointsRepulse(std::vector<vmath::Vector3> &points, const Shape::BaseShape &planet_shape, float repulse_factor);
 
+// Jacobi style repulsion: forces are computed from the current positions only and the moved,
+// reprojected points are written to points_next before the buffers are swapped. The points are
+// split over the thread pool, the result is the same for any number of threads.
+void pointsRepulseJacobi(std::vector<vmath::Vector3> &points, std::vector<vmath::Vector3> &points_next,
+                         SpaceHash3D &spacehash, const Shape::BaseShape &planet_shape, float repulse_factor);
+
 void reproject(std::vector<vmath::Vector3> &points, const Shape::BaseShape &planet_shape);
 
 } // namespace AltPlanet
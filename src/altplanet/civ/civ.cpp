@@ -1,14 +1,18 @@
 #include "civ.h"
 
 #include "../../common/macro/debuglog.h"
+#include "../../common/procedural/counterrng.h"
 
 namespace AltPlanet {
 
 namespace Civ {
 
 std::vector<Resource> distributeResources(const std::vector<vmath::Vector3> &points,
-                                          std::vector<LandWaterType> &land_water_types)
+                                          std::vector<LandWaterType> &land_water_types,
+                                          unsigned int seed)
 {
+    Procedural::CounterRng rng(seed, Procedural::RngStage::Resources);
+
     // create a vector of all land points,
     std::vector<int> land_point_indices;
     for (int i = 0; i<land_water_types.size(); i++)
@@ -26,8 +30,8 @@ std::vector<Resource> distributeResources(const std::vector<vmath::Vector3> &poi
     DEBUG_ASSERT(n_res > 0);
     for (int i = 0; i<n_res; i++)
     {
-        int land_pt_index = rand()%land_point_indices.size(); // woops is this correct...
-        int res_type_int = rand()%static_cast<int>(ResourceType::Unobtainium); // Unobtainium = max resource type index + 1
+        int land_pt_index = rng.below(i, 0, land_point_indices.size()); // woops is this correct...
+        int res_type_int = rng.below(i, 1, static_cast<int>(ResourceType::Unobtainium)); // Unobtainium = max resource type index + 1
         ResourceType res_type = static_cast<ResourceType>(res_type_int);
         resources_out.push_back({ land_pt_index, res_type });
     }
@@ -31,7 +31,8 @@ namespace Civ {
 
     struct Lake
     {
-        // Road data, name, ends, lines etc... curve geometry?
+        int waterLake; // index into WaterGeometry::Freshwater::Lakes::bodies, the mesh, water level and outlet
+        // name etc...
     };
 
     struct River
@@ -88,7 +89,8 @@ namespace Civ {
 
     // functions
     std::vector<Resource> distributeResources(const std::vector<vmath::Vector3> &points,
-                                              std::vector<LandWaterType> &land_water_types);
+                                              std::vector<LandWaterType> &land_water_types,
+                                              unsigned int seed);
 
 
 
@@ -2,23 +2,79 @@
 
 #include "../../common/procedural/noise3d.h"
 #include "../../common/mathext.h"
+#include "../../common/sparsesolver.h"
+#include "../../common/macro/debuglog.h"
 
 namespace AltPlanet {
 
 namespace Humidity {
 
+namespace {
+
+const float MOISTURE_LENGTH_FACTOR = 0.1f;
+const float NOISE_WEIGHT = 0.15f;
+
+}
+
 std::vector<float> humidityYearMean(const std::vector<vmath::Vector3> &points,
-                                    const Shape::BaseShape &planet_shape)
+                                    const std::vector<gfx::Triangle> &triangles,
+                                    const gfx::MeshTopology &topology,
+                                    const std::vector<LandWaterType> &land_water_types,
+                                    const Shape::BaseShape &planet_shape,
+                                    unsigned int seed)
 {
-    std::vector<float> out(points.size());
+    // (L + M*rain) h = 0 on land with h = 1 on the sea, L the cotangent Laplacian and M the
+    // vertex areas, so the solution does not depend on the mesh resolution
+    std::vector<float> mass;
+    Sparse::CsrMatrix A = Sparse::cotangentLaplacian(points, triangles, topology, mass);
 
     Shape::AABB aabb = planet_shape.getAABB();
+    float moisture_length = MOISTURE_LENGTH_FACTOR*aabb.width;
+    float rain = 1.0f/(moisture_length*moisture_length);
+
+    // the sea values are known, so they move to the right hand side and the sea rows become
+    // x = 0. Only the coastal land is left in b and the residual, so the tolerance measures
+    // the land instead of being swamped by the sea.
+    auto is_sea = [&](int i) {return land_water_types[i] == LandWaterType::Sea;};
+    std::vector<float> b(points.size(), 0.0f);
+    for (int i = 0; i<points.size(); i++)
+    {
+        if (is_sea(i))
+        {
+            for (int k = A.offsets[i]+1; k<A.offsets[i+1]; k++) A.values[k] = 0.0f;
+            A.diagonal(i) = 1.0f;
+            continue;
+        }
+
+        A.diagonal(i) += mass[i]*rain;
+        for (int k = A.offsets[i]+1; k<A.offsets[i+1]; k++)
+        {
+            if (!is_sea(A.columns[k])) continue;
+            b[i] -= A.values[k];
+            A.values[k] = 0.0f;
+        }
+    }
+
+    std::vector<float> moisture(points.size(), 0.0f);
+    Sparse::SolveSettings settings;
+    Sparse::SolveResult result = Sparse::solveConjugateGradient(A, b, moisture, settings);
+    DEBUG_LOG("humidity: " << result.iterations << " iterations, relative residual " << result.relativeResidual);
+
+    for (int i = 0; i<points.size(); i++)
+    {
+        if (is_sea(i)) moisture[i] = 1.0f;
+    }
+
+    // noise for some variation
+    std::vector<float> out(points.size());
     float smallest_noise_scale = aabb.width/10.0f;
-    Noise3D noise3d(aabb.width*1.1f, aabb.height*1.1f, smallest_noise_scale, 58234);
+    Noise3D noise3d(aabb.width*1.1f, aabb.height*1.1f, smallest_noise_scale, seed ^ 58234u);
+    noise3d.sampleBatch(points.data(), out.data(), points.size());
+    MathExt::normalizeFloatVec(out);
 
     for (int i=0; i<out.size(); i++)
     {
-        out[i] = noise3d.sample(points[i]);
+        out[i] = (1.0f-NOISE_WEIGHT)*moisture[i] + NOISE_WEIGHT*out[i];
     }
 
     // normalize values to between 0 and 1
@@ -4,15 +4,28 @@
 #include <vector>
 
 #include "../../common/gfx_primitives.h"
+#include "../../common/meshtopology.h"
 #include "../planetshapes.h"
+#include "../watersystem.h"
 
 namespace AltPlanet {
 
 namespace Humidity
 {
 
+/**
+ * @brief humidityYearMean: Moisture spreading inland from the sea. Solves the steady state of
+ *          diffusion over the surface, with the sea as the source and moisture raining out at a
+ *          constant rate on the way, so humidity falls off over a tenth of the planet width
+ *          from the coast. Some noise is mixed in for variation.
+ * @return: humidity at each point, normalized to [0, 1]
+ */
 std::vector<float> humidityYearMean(const std::vector<vmath::Vector3> &points,
-                                    const Shape::BaseShape &planet_shape);
+                                    const std::vector<gfx::Triangle> &triangles,
+                                    const gfx::MeshTopology &topology,
+                                    const std::vector<LandWaterType> &land_water_types,
+                                    const Shape::BaseShape &planet_shape,
+                                    unsigned int seed);
 
 }
 
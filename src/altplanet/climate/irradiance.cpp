@@ -2,34 +2,91 @@
 
 #include "../../common/mathext.h"
 #include "../../common/macro/macrodebugassert.h"
+#include "../../common/meshbvh.h"
+#include "../../common/threads/parallelfor.h"
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <xmmintrin.h>
+#endif
 
 namespace AltPlanet {
 
 namespace Irradiance {
 
-// function for determining whether a point is visible from the sun (need to account for self shadowing)
-
 // function for calculating irradiance given normal and direction to sun
 inline float calcIrradiance(const vmath::Vector3 &normal, const vmath::Vector3 sun_dir)
 {
     return std::max(0.0f, static_cast<float>(vmath::dot(normal, sun_dir)));
 }
 
-std::vector<float> irradianceYearMean(const std::vector<vmath::Vector3> &points,
-                                      const std::vector<vmath::Vector3> &normals,
-                                      const std::vector<gfx::Triangle> &triangles,
-                                      float planet_tilt_rad)
+namespace
 {
-    DEBUG_ASSERT(points.size()>0);
-    DEBUG_ASSERT(triangles.size()>0);
-    // also triangles should only have indices in the valid range of the points vector size
-    // planet tilt can be anything as radians wrap nicely both in positive and negative direction
 
+// the sun latitude over the year, sun_angle is the position on the orbit
+inline float sinDeclination(float sun_angle, float planet_tilt_rad)
+{
+    // the sun direction (cos a, 0, -sin a) seen from the tilted planet, y is the rotation axis
+    return -std::sin(sun_angle)*std::sin(planet_tilt_rad);
+}
+
+const int N_LATITUDE_TABLE = 513;
+const int N_ORBIT_SAMPLES = 360;
+
+std::vector<float> irradianceAnalytic(const std::vector<vmath::Vector3> &normals, float planet_tilt_rad)
+{
+    // the year mean only depends on the latitude, tabulate it over sin(latitude) in [-1, 1]
+    std::vector<float> sin_declinations(N_ORBIT_SAMPLES);
+    for (int i_orbit = 0; i_orbit<N_ORBIT_SAMPLES; i_orbit++)
+    {
+        float sun_angle = static_cast<float>(i_orbit)/static_cast<float>(N_ORBIT_SAMPLES)*2.0f*DR_M_PI;
+        sin_declinations[i_orbit] = sinDeclination(sun_angle, planet_tilt_rad);
+    }
+
+    std::vector<float> year_mean(N_LATITUDE_TABLE);
+    for (int i_lat = 0; i_lat<N_LATITUDE_TABLE; i_lat++)
+    {
+        float sin_latitude = -1.0f + 2.0f*static_cast<float>(i_lat)/static_cast<float>(N_LATITUDE_TABLE-1);
+        float sum = 0.0f;
+        for (float sin_declination : sin_declinations) sum += dailyMeanInsolation(sin_latitude, sin_declination);
+        year_mean[i_lat] = sum/static_cast<float>(N_ORBIT_SAMPLES);
+    }
+
+    std::vector<float> irradiance(normals.size());
+    Threads::parallelFor(0, int(normals.size()), [&](int begin, int end)
+    {
+        for (int i_point = begin; i_point<end; i_point++)
+        {
+            // the insolation scales with the length of the normal, like the dot product does
+            float normal_length = vmath::length(normals[i_point]);
+            if (normal_length <= 0.0f)
+            {
+                irradiance[i_point] = 0.0f;
+                continue;
+            }
+
+            float sin_latitude = MathExt::clamp(normals[i_point].getY()/normal_length, -1.0f, 1.0f);
+            float t = (sin_latitude + 1.0f)*0.5f*static_cast<float>(N_LATITUDE_TABLE-1);
+            int i_lat = std::min(static_cast<int>(t), N_LATITUDE_TABLE-2);
+            float frac = t - static_cast<float>(i_lat);
+            irradiance[i_point] = normal_length*((1.0f-frac)*year_mean[i_lat] + frac*year_mean[i_lat+1]);
+        }
+    });
+
+    return irradiance;
+}
+
+// the N_SUN_ROTATION x N_SELF_ROTATION directions to the sun in the planet frame
+std::vector<vmath::Vector3> sampledSunDirections(float planet_tilt_rad)
+{
     // calculate quaternion corresponding to tilt rotation (around x-axis)
     vmath::Quat tilt_rotation = vmath::Quat::rotation(planet_tilt_rad, vmath::Vector3(1.0, 0.0, 0.0));
 
-    std::vector<float> irradiance(points.size(), 0.0f);
-
+    // dot(R*normal, sun_direction) = dot(normal, transpose(R)*sun_direction), so the sun
+    // directions are rotated into the planet frame once instead of rotating every normal
+    std::vector<vmath::Vector3> sun_directions;
+    sun_directions.reserve(N_SUN_ROTATION*N_SELF_ROTATION);
     for (int i_sun = 0; i_sun<N_SUN_ROTATION; i_sun++)
     {
         float sun_angle = static_cast<float>(i_sun)/(static_cast<float>(N_SUN_ROTATION))*2.0f*DR_M_PI;
@@ -39,7 +96,6 @@ std::vector<float> irradianceYearMean(const std::vector<vmath::Vector3> &points,
         vmath::Matrix3 sun_rotation_matrix = vmath::Matrix3(sun_rotation);
         vmath::Vector3 sun_direction = sun_rotation_matrix * vmath::Vector3(1.0, 0.0, 0.0);
 
-
         for (int i_self = 0; i_self<N_SELF_ROTATION; i_self++)
         {
             float self_angle = static_cast<float>(i_self)/(static_cast<float>(N_SELF_ROTATION))*2.0f*DR_M_PI;
@@ -48,17 +104,157 @@ std::vector<float> irradianceYearMean(const std::vector<vmath::Vector3> &points,
             vmath::Quat self_rotation = vmath::Quat::rotation(self_angle, vmath::Vector3(0.0, 1.0, 0.0));
             vmath::Matrix3 normal_rotation_matrix = vmath::Matrix3(tilt_rotation * self_rotation);
 
-            for (int i_point = 0; i_point <points.size(); i_point ++)
+            sun_directions.push_back(vmath::transpose(normal_rotation_matrix) * sun_direction);
+        }
+    }
+
+    return sun_directions;
+}
+
+std::vector<float> irradianceSampled(const std::vector<vmath::Vector3> &normals, float planet_tilt_rad)
+{
+    std::vector<vmath::Vector3> sun_directions = sampledSunDirections(planet_tilt_rad);
+
+    // sun direction components as separate arrays
+    int n_sun = sun_directions.size();
+    std::vector<float> sun_x(n_sun), sun_y(n_sun), sun_z(n_sun);
+    for (int i_dir = 0; i_dir<n_sun; i_dir++)
+    {
+        sun_x[i_dir] = sun_directions[i_dir].getX();
+        sun_y[i_dir] = sun_directions[i_dir].getY();
+        sun_z[i_dir] = sun_directions[i_dir].getZ();
+    }
+
+    int n_points = normals.size();
+    std::vector<float> irradiance(n_points, 0.0f);
+    Threads::parallelFor(0, n_points, [&](int begin, int end)
+    {
+        int i_point = begin;
+#ifdef __SSE2__
+        // four points at a time, one per lane
+        for (; i_point+4 <= end; i_point += 4)
+        {
+            const vmath::Vector3 *n = &normals[i_point];
+            __m128 nx = _mm_setr_ps(n[0].getX(), n[1].getX(), n[2].getX(), n[3].getX());
+            __m128 ny = _mm_setr_ps(n[0].getY(), n[1].getY(), n[2].getY(), n[3].getY());
+            __m128 nz = _mm_setr_ps(n[0].getZ(), n[1].getZ(), n[2].getZ(), n[3].getZ());
+
+            __m128 sum = _mm_setzero_ps();
+            for (int i_dir = 0; i_dir<n_sun; i_dir++)
             {
-                vmath::Vector3 normal_rotated = normal_rotation_matrix * normals[i_point];
-                irradiance[i_point] += calcIrradiance(normal_rotated, sun_direction);
+                __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_set1_ps(sun_x[i_dir])),
+                                                   _mm_mul_ps(ny, _mm_set1_ps(sun_y[i_dir]))),
+                                        _mm_mul_ps(nz, _mm_set1_ps(sun_z[i_dir])));
+                sum = _mm_add_ps(sum, _mm_max_ps(dot, _mm_setzero_ps()));
             }
+            _mm_storeu_ps(&irradiance[i_point], sum);
         }
-    }
+#endif
+        for (; i_point<end; i_point++)
+        {
+            float sum = 0.0f;
+            for (int i_dir = 0; i_dir<n_sun; i_dir++)
+            {
+                sum += calcIrradiance(normals[i_point], sun_directions[i_dir]);
+            }
+            irradiance[i_point] = sum;
+        }
+    });
+
+    return irradiance;
+}
+
+std::vector<float> irradianceShadowed(const std::vector<vmath::Vector3> &points,
+                                      const std::vector<vmath::Vector3> &normals,
+                                      const std::vector<gfx::Triangle> &triangles,
+                                      float planet_tilt_rad)
+{
+    std::vector<vmath::Vector3> sun_directions = sampledSunDirections(planet_tilt_rad);
+    gfx::MeshBvh bvh(points, triangles);
+
+    // shadow rays start a little above the surface so they do not hit the triangles around
+    // their own point
+    float max_extent = 0.0f;
+    for (const vmath::Vector3 &p : points) max_extent = std::max(max_extent, static_cast<float>(vmath::maxElem(vmath::absPerElem(p))));
+    float ray_offset = 1e-4f*max_extent;
+
+    int n_sun = sun_directions.size();
+    std::vector<float> irradiance(points.size(), 0.0f);
+    Threads::parallelFor(0, int(points.size()), [&](int begin, int end)
+    {
+        for (int i_point = begin; i_point<end; i_point++)
+        {
+            const vmath::Vector3 &normal = normals[i_point];
+            float normal_length = vmath::length(normal);
+            if (normal_length <= 0.0f) continue;
+            vmath::Vector3 origin = points[i_point] + (ray_offset/normal_length)*normal;
+
+            // the lit sun directions in packets of four, neighboring directions are close
+            // so the rays of a packet take similar paths through the bvh
+            gfx::Ray packet[4];
+            float packet_irradiance[4];
+            int n_packet = 0;
+            float sum = 0.0f;
+            for (int i_dir = 0; i_dir<=n_sun; i_dir++)
+            {
+                if (i_dir < n_sun)
+                {
+                    float irradiance_dir = calcIrradiance(normal, sun_directions[i_dir]);
+                    if (irradiance_dir <= 0.0f) continue;
+                    packet[n_packet] = gfx::Ray(origin, sun_directions[i_dir]);
+                    packet_irradiance[n_packet] = irradiance_dir;
+                    n_packet++;
+                }
+
+                if (n_packet == 4 || (i_dir == n_sun && n_packet > 0))
+                {
+                    int occluded = bvh.occludedPacket(packet, (1 << n_packet) - 1);
+                    for (int i = 0; i<n_packet; i++)
+                    {
+                        if (!(occluded & (1 << i))) sum += packet_irradiance[i];
+                    }
+                    n_packet = 0;
+                }
+            }
+            irradiance[i_point] = sum;
+        }
+    });
+
+    return irradiance;
+}
+
+} // anonymous namespace
+
+float dailyMeanInsolation(float sin_latitude, float sin_declination)
+{
+    // cos(zenith) = a + b*cos(hour angle)
+    float a = sin_latitude*sin_declination;
+    float b = std::sqrt(std::max(0.0f, 1.0f - sin_latitude*sin_latitude))*
+              std::sqrt(std::max(0.0f, 1.0f - sin_declination*sin_declination));
+
+    if (a >= b) return a;       // polar day
+    if (a <= -b) return 0.0f;   // polar night
+
+    // the sun sets at the hour angle h0 where a + b*cos(h0) = 0
+    float h0 = std::acos(-a/b);
+    return (a*h0 + b*std::sin(h0))/static_cast<float>(DR_M_PI);
+}
+
+std::vector<float> irradianceYearMean(const std::vector<vmath::Vector3> &points,
+                                      const std::vector<vmath::Vector3> &normals,
+                                      const std::vector<gfx::Triangle> &triangles,
+                                      float planet_tilt_rad,
+                                      Method method)
+{
+    DEBUG_ASSERT(points.size()>0);
+    DEBUG_ASSERT(triangles.size()>0);
+    DEBUG_ASSERT(normals.size()==points.size());
+    // also triangles should only have indices in the valid range of the points vector size
+    // planet tilt can be anything as radians wrap nicely both in positive and negative direction
 
-    //      normalize the irradiance number somehow... (between one and zero for example?)
-    // float norm_factor = 1.0f/static_cast<float>(N_SUN_ROTATION*N_SELF_ROTATION);
-    // for (float &irr : irradiance) irr *= norm_factor;
+    std::vector<float> irradiance = method == Method::Analytic ? irradianceAnalytic(normals, planet_tilt_rad) :
+                                    method == Method::Sampled  ? irradianceSampled(normals, planet_tilt_rad) :
+                                 /* method == Method::Shadowed ?*/ irradianceShadowed(points, normals, triangles, planet_tilt_rad);
 
     MathExt::normalizeFloatVec(irradiance);
 
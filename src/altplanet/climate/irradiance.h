@@ -12,18 +12,35 @@ namespace Irradiance {
 const int N_SELF_ROTATION = 32;
 const int N_SUN_ROTATION = 32;
 
+// Analytic: closed form daily mean insolation from the latitude of the normal relative to the
+//           rotation axis, averaged over the year. Exact when nothing shadows the points.
+// Sampled: N_SUN_ROTATION x N_SELF_ROTATION sun directions summed for every point.
+// Shadowed: Sampled, leaving out the sun directions where the planet shades the point, found
+//           by casting rays through a gfx::MeshBvh of the triangles. For shapes that shade
+//           themselves like the torus, several times slower.
+enum class Method {Analytic, Sampled, Shadowed};
+
 /**
  * @brief irradianceYearMean: Calculate the year mean solar irradiance at each point on a planet
  * @param points: planet points
  * @param normals: planet normals
  * @param triangles: planet triangles
  * @param planet_tilt_rad: Planet tilt angle in radians
- * @return: a vector of floats representing intensity at each point. Has same size as points.
+ * @param method: how to average over the day and year
+ * @return: a vector of floats representing intensity at each point, normalized to [0, 1]. Has same size as points.
  */
 std::vector<float> irradianceYearMean(const std::vector<vmath::Vector3> &points,
                                       const std::vector<vmath::Vector3> &normals,
                                       const std::vector<gfx::Triangle> &triangles,
-                                      float planet_tilt_rad);
+                                      float planet_tilt_rad,
+                                      Method method = Method::Analytic);
+
+/**
+ * @brief dailyMeanInsolation: Mean of max(0, cos(sun zenith angle)) over one planet rotation
+ * @param sin_latitude: sine of the latitude relative to the rotation axis
+ * @param sin_declination: sine of the sun declination, the sun latitude
+ */
+float dailyMeanInsolation(float sin_latitude, float sin_declination);
 
 } // namespace Irradiance
 
@@ -3,19 +3,25 @@
 
 #include <vector>
 
-#include "adjacency.h"
+#include "../common/meshtopology.h"
 #include "../common/macro/debuglog.h"
 #include "../common/gfx_primitives.h"
 #include "../common/mathext.h"
+#include "../common/procedural/counterrng.h"
 
 
 namespace AltPlanet {
 
-void jitterPoints(std::vector<vmath::Vector3> &points,
-                  std::vector<gfx::Triangle> &triangles)
+// topology is the topology of the triangles on points. Every call with the same seed and
+// substream, for example the subdivision level, turns the points by the same angles.
+inline void jitterPoints(std::vector<vmath::Vector3> &points,
+                         const gfx::MeshTopology &topology,
+                         unsigned int seed,
+                         unsigned int substream = 0)
 {
-    // construct the point-point adjacency
-    std::vector<std::vector<int>> point_to_point_adjacency = Adjacancy::createAdjacencyList(points, triangles);
+    Procedural::CounterRng rng(seed, Procedural::RngStage::Jitter, substream);
+
+    const gfx::IndexLists &point_to_point_adjacency = topology.pointPoints();
 
     // for each point
     for (int i = 0; i<points.size(); i++)
@@ -41,7 +47,7 @@ void jitterPoints(std::vector<vmath::Vector3> &points,
         //float jitter_len = MathExt::frand(0.0f, 0.5f*vmath::length(smallest_vec));
         float jitter_len = 0.3f*vmath::length(smallest_vec);
 
-        float rand_angle = MathExt::frand(0.0f, 2.0*DR_M_PI);
+        float rand_angle = rng.uniform(i, 0, 0.0f, 2.0*DR_M_PI);
 
 
         vmath::Vector3 adj0 = points[point_to_point_adjacency[i][0]];
@@ -0,0 +1,541 @@
+#include "planetchunks.h"
+
+#include <algorithm>
+#include <chrono>
+#include <queue>
+
+#include "surfaceframes.h"
+#include "../common/macro/macrodebugassert.h"
+#include "../common/macro/debuglog.h"
+#include "../common/threads/threadpool.h"
+
+namespace AltPlanet
+{
+
+namespace
+{
+
+// everything a worker needs to build one chunk, copied so the job does not touch the tree
+struct ChunkInput
+{
+    std::array<vmath::Vector3, 3> basePoints;
+    std::array<float, 3> baseHeights;
+    std::array<gfx::TexCoords, 3> baseTexCoords;
+    int baseTriangle;
+    std::array<int, 3> basePointIndices;
+    std::array<std::array<int, 2>, 3> corners;
+    int resolution;
+    int n;
+    int stitchMask;
+};
+
+// surface point at integer base coordinates u, v. Points on a base edge only depend on the
+// edge end points, taken in point index order, so both triangles sharing the edge compute
+// exactly the same point.
+vmath::Vector3 surfacePoint(const ChunkInput &in, int u, int v, const Shape::BaseShape &planet_shape)
+{
+    const int weights[3] = {in.resolution-u-v, u, v};
+    const float resolution = float(in.resolution);
+
+    int n_nonzero = 0;
+    int nonzero[3];
+    for (int k = 0; k<3; k++)
+    {
+        if (weights[k] != 0) nonzero[n_nonzero++] = k;
+    }
+
+    // the base points are already on the surface
+    if (n_nonzero == 1) return in.basePoints[nonzero[0]];
+
+    vmath::Vector3 point;
+    float height;
+    if (n_nonzero == 2)
+    {
+        int lo = nonzero[0], hi = nonzero[1];
+        if (in.basePointIndices[lo] > in.basePointIndices[hi]) std::swap(lo, hi);
+        point = (float(weights[lo])*in.basePoints[lo] + float(weights[hi])*in.basePoints[hi])/resolution;
+        height = (float(weights[lo])*in.baseHeights[lo] + float(weights[hi])*in.baseHeights[hi])/resolution;
+    }
+    else
+    {
+        point = (float(weights[0])*in.basePoints[0] + float(weights[1])*in.basePoints[1] + float(weights[2])*in.basePoints[2])/resolution;
+        height = (float(weights[0])*in.baseHeights[0] + float(weights[1])*in.baseHeights[1] + float(weights[2])*in.baseHeights[2])/resolution;
+    }
+
+    planet_shape.setHeight(point, height);
+    return point;
+}
+
+gfx::TexCoords surfaceTexCoords(const ChunkInput &in, int u, int v)
+{
+    const float weights[3] = {float(in.resolution-u-v)/float(in.resolution), float(u)/float(in.resolution),
+                              float(v)/float(in.resolution)};
+    gfx::TexCoords texcoords = {{0.0f, 0.0f}};
+    for (int k = 0; k<3; k++)
+    {
+        texcoords[0] += weights[k]*in.baseTexCoords[k][0];
+        texcoords[1] += weights[k]*in.baseTexCoords[k][1];
+    }
+    return texcoords;
+}
+
+std::shared_ptr<const PlanetChunk> buildChunk(const ChunkInput &in, const Shape::BaseShape &planet_shape)
+{
+    // the patch c0, c1, c2 is split on the lattice c0 + i/n*(c1-c0) + j/n*(c2-c0), i+j <= n,
+    // with row j holding n+1-j lattice points
+    const int n = in.n;
+    auto lattice_index = [n](int i, int j) {return j*(n+1) - j*(j-1)/2 + i;};
+
+    std::shared_ptr<PlanetChunk> chunk = std::make_shared<PlanetChunk>();
+    chunk->points.resize((n+1)*(n+2)/2);
+    chunk->texcoords.resize(chunk->points.size());
+    chunk->triangles.reserve(n*n);
+    chunk->baseTriangle = in.baseTriangle;
+
+    const std::array<int, 2> &c0 = in.corners[0], &c1 = in.corners[1], &c2 = in.corners[2];
+    for (int j = 0; j<=n; j++)
+    {
+        for (int i = 0; i<=n-j; i++)
+        {
+            // exact, the patch size is a multiple of n
+            int u = c0[0] + (i*(c1[0]-c0[0]) + j*(c2[0]-c0[0]))/n;
+            int v = c0[1] + (i*(c1[1]-c0[1]) + j*(c2[1]-c0[1]))/n;
+            chunk->points[lattice_index(i, j)] = surfacePoint(in, u, v, planet_shape);
+            chunk->texcoords[lattice_index(i, j)] = surfaceTexCoords(in, u, v);
+        }
+    }
+
+    // next to a coarser patch every other border point is moved onto the coarse edge
+    for (int edge = 0; edge<3; edge++)
+    {
+        if (!(in.stitchMask & (1 << edge))) continue;
+
+        // lattice point m steps along the edge, counted from its start corner
+        auto edge_index = [&](int m)
+        {
+            return edge == 0 ? lattice_index(m, 0) :
+                   edge == 1 ? lattice_index(n-m, m) :
+                               lattice_index(0, n-m);
+        };
+
+        for (int m = 1; m<n; m += 2)
+        {
+            chunk->points[edge_index(m)] = 0.5f*(chunk->points[edge_index(m-1)] + chunk->points[edge_index(m+1)]);
+        }
+    }
+
+    // n^2 triangles with the orientation of the patch, pointing up and down in each row
+    for (int j = 0; j<n; j++)
+    {
+        for (int i = 0; i<n-j; i++)
+        {
+            chunk->triangles.push_back({lattice_index(i, j), lattice_index(i+1, j), lattice_index(i, j+1)});
+            if (i < n-j-1)
+            {
+                chunk->triangles.push_back({lattice_index(i+1, j), lattice_index(i+1, j+1), lattice_index(i, j+1)});
+            }
+        }
+    }
+
+    gfx::generateNormals(&chunk->normals, chunk->points, chunk->triangles);
+
+    chunk->center = vmath::Vector3(0.0f);
+    for (const vmath::Vector3 &point : chunk->points) chunk->center += point;
+    chunk->center /= float(chunk->points.size());
+    chunk->radius = 0.0f;
+    for (const vmath::Vector3 &point : chunk->points)
+    {
+        chunk->radius = std::max(chunk->radius, (float)vmath::length(point - chunk->center));
+    }
+
+    return chunk;
+}
+
+inline int64_t cross2(int64_t ax, int64_t ay, int64_t bx, int64_t by)
+{
+    return ax*by - ay*bx;
+}
+
+} // anonymous namespace
+
+PlanetChunks::PlanetChunks(const std::vector<vmath::Vector3> &points, const std::vector<gfx::Triangle> &triangles,
+                           const std::vector<gfx::TexCoords> &texcoords, const Shape::BaseShape &planet_shape,
+                           const Settings &settings) :
+    mPoints(points), mTriangles(triangles), mTexCoords(texcoords), mPlanetShape(planet_shape), mSettings(settings),
+    mTopology(points.size(), triangles), mNumLeaves(0), mNumGroups(0), mCachedBytes(0), mUpdateCount(0),
+    mDisplayGeneration(0)
+{
+    DEBUG_ASSERT(mSettings.chunkSplits >= 2 && mSettings.chunkSplits % 2 == 0);
+    DEBUG_ASSERT(texcoords.size() == points.size());
+
+    // large enough that patches at the deepest level still hold whole chunk lattices
+    mResolution = mSettings.chunkSplits << mSettings.maxLevel;
+
+    mPointHeights = computeSurfaceFrames(points, planet_shape).heights;
+
+    mBaseTriangleSizes.resize(triangles.size());
+    for (int i_t = 0; i_t<triangles.size(); i_t++)
+    {
+        const gfx::Triangle &tri = triangles[i_t];
+        float size = 0.0f;
+        for (int j = 0; j<3; j++)
+        {
+            size = std::max(size, (float)vmath::length(points[tri[(j+1)%3]] - points[tri[j]]));
+        }
+        mBaseTriangleSizes[i_t] = size;
+    }
+
+    groupTriangles();
+
+    // the chunks of the displayed and of the next selection can be cached at the same time
+    int n = mSettings.chunkSplits;
+    PlanetChunk chunk_size_probe;
+    chunk_size_probe.points.resize((n+1)*(n+2)/2);
+    chunk_size_probe.normals.resize(chunk_size_probe.points.size());
+    chunk_size_probe.texcoords.resize(chunk_size_probe.points.size());
+    chunk_size_probe.triangles.resize(n*n);
+    mMaxLeaves = int(mSettings.memoryBudget/chunk_size_probe.numBytes()/2);
+
+    // the root patches are always selected, a smaller budget only stops the refinement
+    if (mMaxLeaves < triangles.size())
+    {
+        DEBUG_LOG("memory budget " << mSettings.memoryBudget << " leaves no room to refine "
+                  << triangles.size() << " base chunks");
+    }
+}
+
+PlanetChunks::~PlanetChunks()
+{
+    // the jobs reference the planet shape
+    collectFinished(true);
+}
+
+void PlanetChunks::groupTriangles()
+{
+    // grow the groups breadth first over the triangle neighbors, so each one is a patch
+    mTriangleGroups.assign(mTriangles.size(), -1);
+    std::vector<int> queue;
+    for (int i_seed = 0; i_seed<mTriangles.size(); i_seed++)
+    {
+        if (mTriangleGroups[i_seed] >= 0) continue;
+
+        int n_in_group = 1;
+        queue.assign(1, i_seed);
+        mTriangleGroups[i_seed] = mNumGroups;
+        for (int i_queue = 0; i_queue<queue.size(); i_queue++)
+        {
+            for (int j = 0; j<3 && n_in_group < mSettings.trianglesPerGroup; j++)
+            {
+                int i_across = mTopology.triangleAcross(queue[i_queue], j);
+                if (i_across < 0 || mTriangleGroups[i_across] >= 0) continue;
+
+                mTriangleGroups[i_across] = mNumGroups;
+                queue.push_back(i_across);
+                ++n_in_group;
+            }
+        }
+        ++mNumGroups;
+    }
+}
+
+void PlanetChunks::update(const vmath::Vector3 &focus)
+{
+    // the displayed selection is complete and still close enough
+    if (mDisplayGeneration > 0 && mPending.empty() &&
+        vmath::length(focus - mSelectionFocus) < mSettings.reselectDistance) return;
+    mSelectionFocus = focus;
+
+    ++mUpdateCount;
+    collectFinished(false);
+    selectLeaves(focus);
+
+    std::vector<ChunkKey> wanted_keys;
+    std::vector<std::shared_ptr<const PlanetChunk>> wanted_chunks;
+    bool complete = true;
+
+    for (int i_node = 0; i_node<mNodes.size(); i_node++)
+    {
+        const Node &node = mNodes[i_node];
+        if (node.firstChild >= 0) continue;
+
+        ChunkKey key = chunkKey(i_node);
+        wanted_keys.push_back(key);
+
+        auto cached = mCache.find(key);
+        if (cached != mCache.end())
+        {
+            cached->second.lastUsed = mUpdateCount;
+            wanted_chunks.push_back(cached->second.chunk);
+            continue;
+        }
+
+        complete = false;
+        if (mPending.count(key)) continue;
+
+        const gfx::Triangle &tri = mTriangles[node.baseTriangle];
+        ChunkInput input;
+        for (int k = 0; k<3; k++)
+        {
+            input.basePoints[k] = mPoints[tri[k]];
+            input.baseHeights[k] = mPointHeights[tri[k]];
+            input.baseTexCoords[k] = mTexCoords[tri[k]];
+            input.basePointIndices[k] = tri[k];
+        }
+        input.baseTriangle = node.baseTriangle;
+        input.corners = node.corners;
+        input.resolution = mResolution;
+        input.n = mSettings.chunkSplits;
+        input.stitchMask = key[7];
+
+        const Shape::BaseShape *planet_shape = &mPlanetShape;
+        mPending[key] = Threads::ThreadPool::get().push([input, planet_shape](int /*thread_id*/)
+        {
+            return buildChunk(input, *planet_shape);
+        });
+    }
+
+    if (complete && wanted_keys != mDisplayedKeys)
+    {
+        mDisplayedKeys.swap(wanted_keys);
+        mDisplayed.swap(wanted_chunks);
+        ++mDisplayGeneration;
+        evict(mDisplayedKeys);
+    }
+    else
+    {
+        evict(wanted_keys);
+    }
+}
+
+void PlanetChunks::finish(const vmath::Vector3 &focus)
+{
+    collectFinished(true);
+    update(focus);
+    collectFinished(true);
+    update(focus);
+}
+
+void PlanetChunks::selectLeaves(const vmath::Vector3 &focus)
+{
+    // a root patch for every base triangle
+    mNodes.clear();
+    for (int i_t = 0; i_t<mTriangles.size(); i_t++)
+    {
+        mNodes.push_back({i_t, 0, -1, {{{{0, 0}}, {{mResolution, 0}}, {{0, mResolution}}}}});
+    }
+    mNumLeaves = mNodes.size();
+
+    // split the patches that need it most first, until the leaf budget is used. A balanced
+    // split can split a chain of coarser neighbors as well, keep room for that.
+    std::priority_queue<std::pair<float, int>> split_queue;
+    auto queue_leaves = [&](int first_node)
+    {
+        for (int i_node = first_node; i_node<mNodes.size(); i_node++)
+        {
+            const Node &node = mNodes[i_node];
+            if (node.firstChild >= 0 || node.level >= mSettings.maxLevel) continue;
+
+            float priority = splitPriority(node, focus);
+            if (priority > 1.0f) split_queue.push(std::make_pair(priority, i_node));
+        }
+    };
+    queue_leaves(0);
+
+    int split_reserve = 3*4*(mSettings.maxLevel+1);
+    while (!split_queue.empty() && mNumLeaves + split_reserve <= mMaxLeaves)
+    {
+        int i_node = split_queue.top().second;
+        split_queue.pop();
+        if (mNodes[i_node].firstChild >= 0) continue;
+
+        int first_new = mNodes.size();
+        splitBalanced(i_node);
+        queue_leaves(first_new);
+    }
+}
+
+void PlanetChunks::split(int i_node)
+{
+    Node parent = mNodes[i_node];
+    DEBUG_ASSERT(parent.firstChild < 0);
+
+    auto midpoint = [](const std::array<int, 2> &c0, const std::array<int, 2> &c1)
+    {
+        return std::array<int, 2>{{(c0[0]+c1[0])/2, (c0[1]+c1[1])/2}};
+    };
+    const std::array<int, 2> &c0 = parent.corners[0], &c1 = parent.corners[1], &c2 = parent.corners[2];
+    std::array<int, 2> m01 = midpoint(c0, c1), m12 = midpoint(c1, c2), m20 = midpoint(c2, c0);
+
+    // corner children hold corner k as child k, the center child is last, all keep the
+    // orientation of the parent
+    mNodes[i_node].firstChild = mNodes.size();
+    int level = parent.level+1;
+    mNodes.push_back({parent.baseTriangle, level, -1, {{c0, m01, m20}}});
+    mNodes.push_back({parent.baseTriangle, level, -1, {{m01, c1, m12}}});
+    mNodes.push_back({parent.baseTriangle, level, -1, {{m20, m12, c2}}});
+    mNodes.push_back({parent.baseTriangle, level, -1, {{m01, m12, m20}}});
+
+    mNumLeaves += 3;
+}
+
+void PlanetChunks::splitBalanced(int i_node)
+{
+    // neighbors may be at most one level coarser after the split
+    for (int edge = 0; edge<3; edge++)
+    {
+        int i_neighbor = neighborLeaf(i_node, edge);
+        if (i_neighbor >= 0 && mNodes[i_neighbor].level < mNodes[i_node].level) splitBalanced(i_neighbor);
+    }
+    split(i_node);
+}
+
+int PlanetChunks::findLeaf(int base_triangle, int64_t u3, int64_t v3) const
+{
+    // u3, v3 are three times the coordinates, so a patch centroid is exact. A centroid is
+    // never on the border of a deeper patch, so the leaf is never ambiguous.
+    int i_node = base_triangle;
+    while (mNodes[i_node].firstChild >= 0)
+    {
+        const Node &node = mNodes[i_node];
+        int64_t x[3], y[3];
+        for (int k = 0; k<3; k++)
+        {
+            x[k] = 3*int64_t(node.corners[k][0]) - u3;
+            y[k] = 3*int64_t(node.corners[k][1]) - v3;
+        }
+
+        // patches are counter clockwise in (u, v), so the area and the weights are positive
+        int64_t area = cross2(x[1]-x[0], y[1]-y[0], x[2]-x[0], y[2]-y[0]);
+
+        // the point is in corner child k if the weight of corner k is above one half
+        int child = 3;
+        for (int k = 0; k<3; k++)
+        {
+            int64_t weight = cross2(x[(k+1)%3], y[(k+1)%3], x[(k+2)%3], y[(k+2)%3]);
+            if (2*weight > area) child = k;
+        }
+        i_node = node.firstChild + child;
+    }
+    return i_node;
+}
+
+int PlanetChunks::neighborLeaf(int i_node, int edge) const
+{
+    const Node &node = mNodes[i_node];
+    const std::array<int, 2> &p = node.corners[edge];
+    const std::array<int, 2> &q = node.corners[(edge+1)%3];
+    const std::array<int, 2> &o = node.corners[(edge+2)%3];
+    const int res = mResolution;
+
+    // base triangle edge the patch edge lies on, in the order of the base half-edges
+    int base_edge = p[1] == 0 && q[1] == 0             ? 0 :
+                    p[0]+p[1] == res && q[0]+q[1] == res ? 1 :
+                    p[0] == 0 && q[0] == 0             ? 2 : -1;
+
+    if (base_edge < 0)
+    {
+        // inside the base triangle, the patch of the same level across the edge has its
+        // third corner mirrored through the edge
+        int64_t o_u = p[0]+q[0]-o[0], o_v = p[1]+q[1]-o[1];
+        return findLeaf(node.baseTriangle, p[0]+q[0]+o_u, p[1]+q[1]+o_v);
+    }
+
+    int i_twin = mTopology.twin(gfx::MeshTopology::halfEdge(node.baseTriangle, base_edge));
+    if (i_twin < 0) return -1;
+    int neighbor_triangle = gfx::MeshTopology::triangleOf(i_twin);
+    int neighbor_edge = gfx::MeshTopology::cornerOf(i_twin);
+
+    // distance along the base edge from its start, the twin runs the other way
+    auto to_neighbor = [&](const std::array<int, 2> &c)
+    {
+        int s = base_edge == 0 ? c[0] : base_edge == 1 ? c[1] : res - c[1];
+        int s_neighbor = res - s;
+        return neighbor_edge == 0 ? std::array<int, 2>{{s_neighbor, 0}} :
+               neighbor_edge == 1 ? std::array<int, 2>{{res - s_neighbor, s_neighbor}} :
+                                    std::array<int, 2>{{0, res - s_neighbor}};
+    };
+    std::array<int, 2> p_neighbor = to_neighbor(p), q_neighbor = to_neighbor(q);
+
+    // patches on a base edge point the same way as the base triangle
+    int64_t size = res >> node.level;
+    int64_t a = std::min(p_neighbor[0], q_neighbor[0]), b = std::min(p_neighbor[1], q_neighbor[1]);
+    return findLeaf(neighbor_triangle, 3*a+size, 3*b+size);
+}
+
+float PlanetChunks::splitPriority(const Node &node, const vmath::Vector3 &focus) const
+{
+    const gfx::Triangle &tri = mTriangles[node.baseTriangle];
+    vmath::Vector3 center(0.0f);
+    for (int k = 0; k<3; k++)
+    {
+        float u = float(node.corners[k][0])/float(mResolution), v = float(node.corners[k][1])/float(mResolution);
+        center += ((1.0f-u-v)*mPoints[tri[0]] + u*mPoints[tri[1]] + v*mPoints[tri[2]])/3.0f;
+    }
+
+    float size = std::ldexp(mBaseTriangleSizes[node.baseTriangle], -node.level);
+    float distance = vmath::length(center - focus);
+    return mSettings.splitDistanceFactor*size/std::max(distance, 1e-6f);
+}
+
+PlanetChunks::ChunkKey PlanetChunks::chunkKey(int i_node) const
+{
+    const Node &node = mNodes[i_node];
+
+    int stitch_mask = 0;
+    for (int edge = 0; edge<3; edge++)
+    {
+        int i_neighbor = neighborLeaf(i_node, edge);
+        if (i_neighbor >= 0 && mNodes[i_neighbor].level < node.level) stitch_mask |= 1 << edge;
+    }
+
+    return {{node.baseTriangle, node.corners[0][0], node.corners[0][1], node.corners[1][0], node.corners[1][1],
+             node.corners[2][0], node.corners[2][1], stitch_mask}};
+}
+
+void PlanetChunks::collectFinished(bool wait)
+{
+    for (auto it = mPending.begin(); it != mPending.end();)
+    {
+        if (!wait && it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            ++it;
+            continue;
+        }
+
+        std::shared_ptr<const PlanetChunk> chunk = it->second.get();
+        mCachedBytes += chunk->numBytes();
+        mCache[it->first] = {chunk, mUpdateCount};
+        it = mPending.erase(it);
+    }
+}
+
+void PlanetChunks::evict(const std::vector<ChunkKey> &wanted_keys)
+{
+    if (mCachedBytes <= mSettings.memoryBudget) return;
+
+    std::vector<ChunkKey> keep = wanted_keys;
+    keep.insert(keep.end(), mDisplayedKeys.begin(), mDisplayedKeys.end());
+    std::sort(keep.begin(), keep.end());
+
+    std::vector<std::map<ChunkKey, CacheEntry>::iterator> candidates;
+    for (auto it = mCache.begin(); it != mCache.end(); ++it)
+    {
+        if (!std::binary_search(keep.begin(), keep.end(), it->first)) candidates.push_back(it);
+    }
+
+    // least recently used first
+    std::sort(candidates.begin(), candidates.end(), [](const std::map<ChunkKey, CacheEntry>::iterator &e0,
+                                                       const std::map<ChunkKey, CacheEntry>::iterator &e1)
+    {
+        return e0->second.lastUsed < e1->second.lastUsed;
+    });
+
+    for (auto &entry : candidates)
+    {
+        if (mCachedBytes <= mSettings.memoryBudget) break;
+        mCachedBytes -= entry->second.chunk->numBytes();
+        mCache.erase(entry);
+    }
+}
+
+} // namespace AltPlanet
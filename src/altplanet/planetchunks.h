@@ -0,0 +1,171 @@
+#ifndef PLANETCHUNKS_H
+#define PLANETCHUNKS_H
+
+#include <array>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "../common/gfx_primitives.h"
+#include "../common/meshtopology.h"
+#include "planetshapes.h"
+
+namespace AltPlanet
+{
+
+// a patch of planet surface ready to upload, triangles index the chunk's own points
+struct PlanetChunk
+{
+    std::vector<vmath::Vector3> points;
+    std::vector<vmath::Vector3> normals;
+    std::vector<gfx::TexCoords> texcoords;
+    std::vector<gfx::Triangle> triangles;
+
+    int baseTriangle;           // the planet triangle the patch lies in
+    vmath::Vector3 center;      // bounding sphere of the points
+    float radius;
+
+    uint64_t numBytes() const
+    {
+        return (points.size() + normals.size())*sizeof(vmath::Vector3) + texcoords.size()*sizeof(gfx::TexCoords) +
+                triangles.size()*sizeof(gfx::Triangle);
+    }
+};
+
+/**
+ * @brief The PlanetChunks class: view dependent level of detail for a generated planet.
+ *
+ *          Every triangle of the planet mesh is the root of a quadtree of triangular
+ *          patches, split through the edge midpoints. update() refines the patches close to
+ *          a focus point, such as the camera or the player, and coarsens the ones far away.
+ *          Each leaf patch is a chunk of chunkSplits^2 triangles, built on the thread pool.
+ *
+ *          Neighboring leaves differ at most one level, a split first splits coarser
+ *          neighbors. On an edge next to a coarser leaf every other border point is moved onto
+ *          the coarse edge, and points on shared edges are computed from the same integer
+ *          coordinates on both sides, so the chunks have no cracks.
+ *
+ *          The number of leaves is limited so that the chunks of the displayed and the next
+ *          selection fit in the memory budget. Cached chunks that are not used are evicted,
+ *          least recently used first, when the budget is exceeded.
+ *
+ *          The planet triangles are split into groups of neighboring triangles, so that a
+ *          renderer can draw and update the chunks of a group together.
+ *
+ *          points, triangles, texcoords and planet_shape must outlive this object.
+ */
+class PlanetChunks
+{
+public:
+    struct Settings
+    {
+        Settings() : chunkSplits(8), maxLevel(10), splitDistanceFactor(3.0f), memoryBudget(128u << 20),
+            trianglesPerGroup(256), reselectDistance(0.0f) {}
+
+        int chunkSplits;            // chunk triangles per patch edge, even
+        int maxLevel;               // deepest quadtree level
+        float splitDistanceFactor;  // split when the focus is closer than this many patch sizes
+        uint64_t memoryBudget;      // bytes for all cached chunks
+        int trianglesPerGroup;      // planet triangles per group
+        float reselectDistance;     // keep the selection while the focus moves less than this
+    };
+
+    PlanetChunks(const std::vector<vmath::Vector3> &points, const std::vector<gfx::Triangle> &triangles,
+                 const std::vector<gfx::TexCoords> &texcoords, const Shape::BaseShape &planet_shape,
+                 const Settings &settings = Settings());
+    ~PlanetChunks();
+
+    PlanetChunks(const PlanetChunks&) = delete;
+    PlanetChunks &operator=(const PlanetChunks&) = delete;
+
+    /**
+     * @brief update: Select the patches for focus and start building the missing chunks.
+     *          The displayed chunks switch to the new selection once all of its chunks are
+     *          built, so a displayed set is always complete and crack free.
+     */
+    void update(const vmath::Vector3 &focus);
+
+    // block until all chunks being built are done, then update(focus) again
+    void finish(const vmath::Vector3 &focus);
+
+    const std::vector<std::shared_ptr<const PlanetChunk>> &displayedChunks() const {return mDisplayed;}
+
+    // incremented every time the displayed chunks change
+    unsigned int displayGeneration() const {return mDisplayGeneration;}
+
+    int numGroups() const {return mNumGroups;}
+    int groupOf(int base_triangle) const {return mTriangleGroups[base_triangle];}
+
+    uint64_t cachedBytes() const {return mCachedBytes;}
+    int numPendingChunks() const {return int(mPending.size());}
+
+private:
+    // base triangle, three patch corners in integer base coordinates, stitched edges
+    typedef std::array<int, 8> ChunkKey;
+
+    struct Node
+    {
+        int baseTriangle;
+        int level;
+        int firstChild; // four children, -1 for leaves
+        std::array<std::array<int, 2>, 3> corners;
+    };
+
+    struct CacheEntry
+    {
+        std::shared_ptr<const PlanetChunk> chunk;
+        unsigned int lastUsed;
+    };
+
+    const std::vector<vmath::Vector3> &mPoints;
+    const std::vector<gfx::Triangle> &mTriangles;
+    const std::vector<gfx::TexCoords> &mTexCoords;
+    const Shape::BaseShape &mPlanetShape;
+    Settings mSettings;
+
+    gfx::MeshTopology mTopology;
+
+    // integer coordinates u, v of a base triangle point run from 0 to mResolution, the
+    // weights of corner 1 and 2 are u/mResolution and v/mResolution
+    int mResolution;
+    int mMaxLeaves;
+    int mNumLeaves;
+
+    std::vector<float> mPointHeights;
+    std::vector<float> mBaseTriangleSizes;
+
+    std::vector<int> mTriangleGroups;
+    int mNumGroups;
+
+    std::vector<Node> mNodes;
+
+    std::map<ChunkKey, CacheEntry> mCache;
+    std::map<ChunkKey, std::future<std::shared_ptr<const PlanetChunk>>> mPending;
+    uint64_t mCachedBytes;
+    unsigned int mUpdateCount;
+    vmath::Vector3 mSelectionFocus;
+
+    std::vector<ChunkKey> mDisplayedKeys;
+    std::vector<std::shared_ptr<const PlanetChunk>> mDisplayed;
+    unsigned int mDisplayGeneration;
+
+    void groupTriangles();
+
+    void selectLeaves(const vmath::Vector3 &focus);
+    void split(int i_node);
+    void splitBalanced(int i_node);
+    int findLeaf(int base_triangle, int64_t u3, int64_t v3) const;
+    int neighborLeaf(int i_node, int edge) const;
+
+    float splitPriority(const Node &node, const vmath::Vector3 &focus) const;
+    ChunkKey chunkKey(int i_node) const;
+
+    void collectFinished(bool wait);
+    void evict(const std::vector<ChunkKey> &wanted_keys);
+};
+
+} // namespace AltPlanet
+
+#endif // PLANETCHUNKS_H
@@ -4,6 +4,8 @@
 #include "../common/gfx_primitives.h"
 #include "../common/macro/macroserialize.h"
 #include "../common/serialize.h"
+#include "../common/mappedarchive.h"
+#include "surfaceframes.h"
 #include <vector>
 
 namespace AltPlanet {
@@ -12,8 +14,61 @@ struct PlanetGeometry
 {
     std::vector<vmath::Vector3> points;
     std::vector<gfx::Triangle> triangles;
+
+    // optional, computeSurfaceFrames once the points are final. Not archived.
+    SurfaceFrames surface;
+};
+
+// PlanetGeometry arrays read in place from a mapped Archive
+struct PlanetGeometryView
+{
+    Archive::ArrayView<vmath::Vector3> points;
+    Archive::ArrayView<gfx::Triangle> triangles;
+
+    PlanetGeometry copy() const {return {points.toVector(), triangles.toVector(), SurfaceFrames()};}
+
+    // copy into geometry, checking on the way that every triangle indexes the points. This
+    // catches damaged files without hashing the archive first. false if it does not.
+    bool copyChecked(PlanetGeometry &geometry) const
+    {
+        geometry.points.assign(points.begin(), points.end());
+        geometry.triangles.resize(triangles.size());
+        geometry.surface = SurfaceFrames();
+        uint32_t n_points = uint32_t(points.size());
+        bool valid = true;
+        for (size_t i = 0; i<triangles.size(); i++)
+        {
+            const gfx::Triangle &tri = triangles[i];
+            valid &= uint32_t(tri[0]) < n_points && uint32_t(tri[1]) < n_points && uint32_t(tri[2]) < n_points;
+            geometry.triangles[i] = tri;
+        }
+        return valid;
+    }
 };
 
+namespace GeometryArchive {
+    static const uint32_t POINTS = Archive::tag("GPNT");
+    static const uint32_t TRIANGLES = Archive::tag("GTRI");
+}
+
+// geometry must stay alive until the writer has written
+inline void addToArchive(Archive::Writer &writer, const PlanetGeometry &geometry)
+{
+    writer.add(GeometryArchive::POINTS, geometry.points);
+    writer.add(GeometryArchive::TRIANGLES, geometry.triangles);
+}
+
+// false if the archive does not hold a PlanetGeometry
+inline bool viewFromArchive(const Archive::MappedFile &archive, PlanetGeometryView &view)
+{
+    if (!archive.hasArrayOf<vmath::Vector3>(GeometryArchive::POINTS) ||
+        !archive.hasArrayOf<gfx::Triangle>(GeometryArchive::TRIANGLES)) return false;
+
+    view.points = archive.view<vmath::Vector3>(GeometryArchive::POINTS);
+    view.triangles = archive.view<gfx::Triangle>(GeometryArchive::TRIANGLES);
+    return true;
+}
+
 }
 
 IMPL_SERIALIZABLE(AltPlanet::PlanetGeometry, points, triangles)
@@ -1,6 +1,7 @@
 #ifndef PLANETSHAPES_H
 #define PLANETSHAPES_H
 
+#include <algorithm>
 #include <cmath>
 
 #define _VECTORMATH_DEBUG
@@ -72,10 +73,13 @@ public:
 
 
     /**
-     * @brief getUV: Calculate UV coordinates according to planet shape
-     * @return: Structure representing the UV coordinates of the supplied points
+     * @brief Batch versions of the per point functions, one virtual call for a whole span of
+     *          points. The output may be the input for projectPoints and gradDirs.
      */
-    virtual std::vector<gfx::TexCoords> getUV(const std::vector<vmath::Vector3> &points) const = 0;
+    virtual void projectPoints(const vmath::Vector3 *points, vmath::Vector3 *projected, int n) const = 0;
+    virtual void heights(const vmath::Vector3 *points, float *heights_out, int n) const = 0;
+    virtual void gradDirs(const vmath::Vector3 *points, vmath::Vector3 *grad_dirs, int n) const = 0;
+    virtual void uvs(const vmath::Vector3 *points, gfx::TexCoords *uvs_out, int n) const = 0;
 
     /**
      * @brief aspectUV: Get the aspect ratio that minimizes spatial distortion in uv coordinates
@@ -135,6 +139,144 @@ public:
         SurfaceLine surface_line = shapeFunction(vmath::Vector3(1.0f, 2.0f, 3.0f)); // any point will do
         return surface_line.refHeight;
     }
+
+    /**
+     * @brief getUV: Calculate UV coordinates according to planet shape
+     * @return: Structure representing the UV coordinates of the supplied points
+     */
+    inline std::vector<gfx::TexCoords> getUV(const std::vector<vmath::Vector3> &points) const
+    {
+        std::vector<gfx::TexCoords> texco_out(points.size());
+        uvs(points.data(), texco_out.data(), int(points.size()));
+        return texco_out;
+    }
+};
+
+namespace Batch
+{
+
+// four points with the coordinates in separate registers
+struct Points4 { __m128 x, y, z; };
+
+inline Points4 load4(const vmath::Vector3 *points)
+{
+    __m128 r0 = points[0].get128(), r1 = points[1].get128(), r2 = points[2].get128(), r3 = points[3].get128();
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    return {r0, r1, r2};
+}
+
+inline void store4(const Points4 &p, vmath::Vector3 *points)
+{
+    __m128 r0 = p.x, r1 = p.y, r2 = p.z, r3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    points[0] = vmath::Vector3(r0);
+    points[1] = vmath::Vector3(r1);
+    points[2] = vmath::Vector3(r2);
+    points[3] = vmath::Vector3(r3);
+}
+
+inline Points4 sub4(const Points4 &a, const Points4 &b) {return {_mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z)};}
+inline Points4 mul4(const Points4 &a, __m128 s) {return {_mm_mul_ps(a.x, s), _mm_mul_ps(a.y, s), _mm_mul_ps(a.z, s)};}
+
+// summed in the order of vmath's dot, so the batch functions give the per point results
+// bit for bit
+inline __m128 lengthSqr4(const Points4 &p)
+{
+    return _mm_add_ps(_mm_mul_ps(p.x, p.x), _mm_add_ps(_mm_mul_ps(p.y, p.y), _mm_mul_ps(p.z, p.z)));
+}
+
+inline Points4 normalize4(const Points4 &p) {return mul4(p, newtonrapson_rsqrt4(lengthSqr4(p)));}
+
+} // namespace Batch
+
+/**
+ * @brief The BatchShape class: implements the batch functions of BaseShape for ShapeType,
+ *          four points at a time with SSE. ShapeType provides
+ *              Batch::Points4 zeroHeightPoints4(const Batch::Points4 &points) const;
+ *              float refHeight() const;
+ *              gfx::TexCoords uv(const vmath::Vector3 &point) const;
+ *          which are called without a virtual call, the surface normal is the normalized
+ *          direction from the zero height point.
+ */
+template<class ShapeType>
+class BatchShape : public BaseShape
+{
+public:
+    void projectPoints(const vmath::Vector3 *points, vmath::Vector3 *projected, int n) const
+    {
+        __m128 ref_height = _mm_set1_ps(shape().refHeight());
+        forEach4(points, n, [&](const Batch::Points4 &p, int i, int count)
+        {
+            Batch::Points4 zero = shape().zeroHeightPoints4(p);
+            Batch::Points4 normal = Batch::normalize4(Batch::sub4(p, zero));
+            Batch::Points4 normal_ref = Batch::mul4(normal, ref_height);
+            Batch::Points4 out = {_mm_add_ps(zero.x, normal_ref.x), _mm_add_ps(zero.y, normal_ref.y), _mm_add_ps(zero.z, normal_ref.z)};
+            store(out, projected + i, count);
+        });
+    }
+
+    void heights(const vmath::Vector3 *points, float *heights_out, int n) const
+    {
+        forEach4(points, n, [&](const Batch::Points4 &p, int i, int count)
+        {
+            __m128 h = _mm_sqrt_ps(Batch::lengthSqr4(Batch::sub4(p, shape().zeroHeightPoints4(p))));
+            if (count == 4)
+            {
+                _mm_storeu_ps(heights_out + i, h);
+            }
+            else
+            {
+                float h_tail[4];
+                _mm_storeu_ps(h_tail, h);
+                std::copy(h_tail, h_tail + count, heights_out + i);
+            }
+        });
+    }
+
+    void gradDirs(const vmath::Vector3 *points, vmath::Vector3 *grad_dirs, int n) const
+    {
+        forEach4(points, n, [&](const Batch::Points4 &p, int i, int count)
+        {
+            store(Batch::sub4(p, shape().zeroHeightPoints4(p)), grad_dirs + i, count);
+        });
+    }
+
+    void uvs(const vmath::Vector3 *points, gfx::TexCoords *uvs_out, int n) const
+    {
+        for (int i = 0; i<n; i++) uvs_out[i] = shape().uv(points[i]);
+    }
+
+private:
+    const ShapeType &shape() const {return static_cast<const ShapeType&>(*this);}
+
+    // func(points4, first index, number of valid points), the last block is padded by
+    // repeating its last point
+    template<class F>
+    static void forEach4(const vmath::Vector3 *points, int n, F func)
+    {
+        int i = 0;
+        for (; i+4<=n; i+=4) func(Batch::load4(points + i), i, 4);
+        if (i < n)
+        {
+            vmath::Vector3 tail[4];
+            for (int j = 0; j<4; j++) tail[j] = points[std::min(i+j, n-1)];
+            func(Batch::load4(tail), i, n-i);
+        }
+    }
+
+    static void store(const Batch::Points4 &p, vmath::Vector3 *out, int count)
+    {
+        if (count == 4)
+        {
+            Batch::store4(p, out);
+        }
+        else
+        {
+            vmath::Vector3 tail[4];
+            Batch::store4(p, tail);
+            std::copy(tail, tail + count, out);
+        }
+    }
 };
 
 /* // need shape to be 3d, reimagine the disk as a squashed sphere (with two sides, exciting)
@@ -157,7 +299,7 @@ private:
 };*/
 
 
-class Sphere : public BaseShape
+class Sphere : public BatchShape<Sphere>
 {
 public:
     Sphere(float radius) : radius(radius) {}
@@ -177,19 +319,20 @@ public:
         return point;
     }
 
-    std::vector<gfx::TexCoords> getUV(const std::vector<vmath::Vector3> &points) const
+    Batch::Points4 zeroHeightPoints4(const Batch::Points4 &) const
     {
-        std::vector<gfx::TexCoords> texco_out(points.size());
+        return {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+    }
 
-        for(int i = 0; i<texco_out.size(); i++)
-        {
-            auto d = vmath::normalize(points[i]);
-            float u = 0.5+atan2(d[2], d[0])/(2.0f*DR_M_PI);
-            float v = 0.5-asin(d[1])/DR_M_PI;
-            //texco_out[i] = {2.0f*u, v};
-            texco_out[i] = {u, v};
-        }
-        return texco_out;
+    float refHeight() const { return radius; }
+
+    gfx::TexCoords uv(const vmath::Vector3 &point) const
+    {
+        auto d = vmath::normalize(point);
+        float u = 0.5+atan2(d[2], d[0])/(2.0f*DR_M_PI);
+        float v = 0.5-asin(d[1])/DR_M_PI;
+        //return {2.0f*u, v};
+        return {u, v};
     }
 
     float aspectUV() const { return 2.0f; }
@@ -202,7 +345,7 @@ private:
     float radius;
 };
 
-class Torus : public BaseShape
+class Torus : public BatchShape<Torus>
 {
 public:
     Torus(float major_radius, float minor_radius) : major_radius(major_radius), minor_radius(minor_radius) {}
@@ -226,24 +369,26 @@ public:
         return point-circle_point;
     }
 
-    std::vector<gfx::TexCoords> getUV(const std::vector<vmath::Vector3> &points) const
+    // the closest points on the major circle
+    Batch::Points4 zeroHeightPoints4(const Batch::Points4 &points) const
     {
-        std::vector<gfx::TexCoords> texco_out(points.size());
+        Batch::Points4 flat = {points.x, _mm_setzero_ps(), points.z};
+        return Batch::mul4(Batch::normalize4(flat), _mm_set1_ps(major_radius));
+    }
 
-        for(int i = 0; i<texco_out.size(); i++)
-        {
-            const vmath::Vector3 &point = points[i];
-            vmath::Vector3 circle_point = major_radius*vmath::normalize({point[0], 0.0f, point[2]});
-            vmath::Vector3 circle_to_point = point-circle_point;
-            vmath::Vector3 circle_tangent = vmath::cross(vmath::Vector3(0.0f, 1.0f, 0.0f), circle_point);
-            float minor_angle = mathext::orientedAngle(circle_point, circle_to_point, circle_tangent);
-            float major_angle = mathext::orientedAngle(circle_point, vmath::Vector3(1.0f, 0.0f, 0.0f), vmath::Vector3(0.0f, 1.0f, 0.0f));
-
-            texco_out[i] = {0.5f+major_angle/(float)(2.0*DR_M_PI), 0.5f+minor_angle/(float)(2.0*DR_M_PI)}; // 0,1
-            //texco_out[i] = {2.0f + major_angle/(float)(DR_M_PI), 0.5f+minor_angle/(float)(4.0*DR_M_PI)}; // x scaled
-            //texco_out[i] = { major_angle/(float)(2.0*DR_M_PI), minor_angle/(float)(2.0*DR_M_PI) }; // normalized to 0 to 1
-        }
-        return texco_out;
+    float refHeight() const { return minor_radius; }
+
+    gfx::TexCoords uv(const vmath::Vector3 &point) const
+    {
+        vmath::Vector3 circle_point = major_radius*vmath::normalize({point[0], 0.0f, point[2]});
+        vmath::Vector3 circle_to_point = point-circle_point;
+        vmath::Vector3 circle_tangent = vmath::cross(vmath::Vector3(0.0f, 1.0f, 0.0f), circle_point);
+        float minor_angle = mathext::orientedAngle(circle_point, circle_to_point, circle_tangent);
+        float major_angle = mathext::orientedAngle(circle_point, vmath::Vector3(1.0f, 0.0f, 0.0f), vmath::Vector3(0.0f, 1.0f, 0.0f));
+
+        return {0.5f+major_angle/(float)(2.0*DR_M_PI), 0.5f+minor_angle/(float)(2.0*DR_M_PI)}; // 0,1
+        //return {2.0f + major_angle/(float)(DR_M_PI), 0.5f+minor_angle/(float)(4.0*DR_M_PI)}; // x scaled
+        //return { major_angle/(float)(2.0*DR_M_PI), minor_angle/(float)(2.0*DR_M_PI) }; // normalized to 0 to 1
     }
 
     float aspectUV() const { return 4.0f; }
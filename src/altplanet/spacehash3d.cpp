@@ -1,23 +1,24 @@
 #include "spacehash3d.h"
 
+#include "../common/threads/parallelfor.h"
+
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 
-SpaceHash3D::SpaceHash3D(const std::vector<vmath::Vector3> &points) :
-    mGridToPointMap(nullptr)
+SpaceHash3D::SpaceHash3D(const std::vector<vmath::Vector3> &points, Layout layout) :
+    mLayout(layout), mSparse(false), mNCells(0)
 {
     rehash(points);
 }
 
 SpaceHash3D::~SpaceHash3D()
 {
-    delete [] mGridToPointMap;
 }
 
 void SpaceHash3D::rehash(const std::vector<vmath::Vector3> &points)
 {
-    delete [] mGridToPointMap;
-    mPoints.clear();
-    mPoints = points;
+    int n_points = points.size();
 
     // find min and max
     float low_float = std::numeric_limits<float>::lowest(); // woops woops: min!=lowest
@@ -40,15 +41,15 @@ void SpaceHash3D::rehash(const std::vector<vmath::Vector3> &points)
     DEBUG_ASSERT((side_lengths[0]>0.0f && side_lengths[1]>0.0f && side_lengths[2]>0.0f ));
 
     float volume = side_lengths[0]*side_lengths[1]*side_lengths[2];
-    mPointCubeVolDensity = mPoints.size()/volume;
+    mPointCubeVolDensity = n_points/volume;
 
     float area = 2.f*(side_lengths[0]*side_lengths[1]+side_lengths[0]*side_lengths[2]+side_lengths[1]*side_lengths[2]);
-    mPointCubeAreaDensity = mPoints.size()/area;
+    mPointCubeAreaDensity = n_points/area;
 
     float xy_aspect = side_lengths[1]/side_lengths[0];
     float xz_aspect = side_lengths[2]/side_lengths[0];
 
-    mNx = cbrt((float)(mPoints.size())/(xy_aspect*xz_aspect*AV_PTS_PER_CELL_PREF));
+    mNx = cbrt((float)(n_points)/(xy_aspect*xz_aspect*AV_PTS_PER_CELL_PREF));
     mNx = std::max(mNx, 1);
     mNy = std::max(int(xy_aspect*(mNx)), 1);
     mNz = std::max(int(xz_aspect*(mNx)), 1);
@@ -60,13 +61,366 @@ void SpaceHash3D::rehash(const std::vector<vmath::Vector3> &points)
     std::cout << "nz = " << mNz << std::endl;*/
 
     mNGrid = mNx*mNy*mNz;
-    mGridToPointMap = new std::vector<int> [mNGrid];
 
-    for (int i = 0; i<mPoints.size(); i++)
+    // global grid index of every point, turned into a cell id by the layout builders
+    mPointCell.resize(n_points);
+    for (int i = 0; i<n_points; i++) mPointCell[i] = findPointCell(points[i]);
+
+    if (mLayout == Layout::Dense)
+    {
+        buildDense(points);
+    }
+    else
+    {
+        buildSparse(points);
+
+        if (mLayout == Layout::Auto && mNCells > SPARSE_MAX_OCCUPANCY*std::min(n_points, mNGrid))
+        {
+            // the points fill the volume, a dense offset array is cheaper to query
+            for (int i = 0; i<n_points; i++) mPointCell[i] = findPointCell(points[i]);
+            buildDense(points);
+        }
+    }
+}
+
+void SpaceHash3D::buildDense(const std::vector<vmath::Vector3> &points)
+{
+    int n_points = points.size();
+
+    mSparse = false;
+    mNCells = mNGrid;
+    mColumnCellStart.clear();
+    mCellK.clear();
+
+    // counting sort of the points into the cells
+    mCellStart.assign(mNGrid+1, 0);
+    for (int i = 0; i<n_points; i++) mCellStart[mPointCell[i]+1]++;
+    for (int I = 0; I<mNGrid; I++) mCellStart[I+1] += mCellStart[I];
+
+    fillSlots(points);
+}
+
+void SpaceHash3D::buildSparse(const std::vector<vmath::Vector3> &points)
+{
+    int n_points = points.size();
+    int n_columns = mNx*mNy;
+
+    mSparse = true;
+
+    // counting sort of the points into the (i,j) columns, in index order
+    mColumnCellStart.assign(n_columns+1, 0);
+    for (int i = 0; i<n_points; i++) mColumnCellStart[mPointCell[i]%n_columns+1]++;
+    for (int c = 0; c<n_columns; c++) mColumnCellStart[c+1] += mColumnCellStart[c];
+
+    mCellCursor.assign(mColumnCellStart.begin(), mColumnCellStart.end()-1);
+    mNextSlotPoint.resize(n_points);
+    for (int i = 0; i<n_points; i++) mNextSlotPoint[mCellCursor[mPointCell[i]%n_columns]++] = i;
+
+    // within a column, order the points on k (the global index) and then on point index,
+    // and run-length encode the occupied cells
+    mCellK.clear();
+    mCellStart.clear();
+    int column_begin = 0;
+    for (int c = 0; c<n_columns; c++)
+    {
+        int column_end = mColumnCellStart[c+1];
+        auto first = mNextSlotPoint.begin()+column_begin;
+        auto last = mNextSlotPoint.begin()+column_end;
+        std::sort(first, last, [&](int p0, int p1)
+        {
+            return mPointCell[p0] != mPointCell[p1] ? mPointCell[p0] < mPointCell[p1] : p0 < p1;
+        });
+
+        mColumnCellStart[c] = mCellK.size();
+        for (int slot = column_begin; slot<column_end; slot++)
+        {
+            int k = mPointCell[mNextSlotPoint[slot]]/n_columns;
+            if (slot == column_begin || k != mCellK.back())
+            {
+                mCellK.push_back(k);
+                mCellStart.push_back(slot);
+            }
+        }
+        column_begin = column_end;
+    }
+    mNCells = mCellK.size();
+    mColumnCellStart[n_columns] = mNCells;
+    mCellStart.push_back(n_points);
+
+    // the slot order is the sorted order, replace the global indices with cell ids
+    mSlotPoint.resize(n_points);
+    mSlotPosition.resize(n_points);
+    mPointSlot.resize(n_points);
+    for (int I = 0; I<mNCells; I++)
+    {
+        for (int slot = mCellStart[I]; slot<mCellStart[I+1]; slot++)
+        {
+            int i = mNextSlotPoint[slot];
+            mSlotPoint[slot] = i;
+            mSlotPosition[slot] = points[i];
+            mPointSlot[i] = slot;
+            mPointCell[i] = I;
+        }
+    }
+}
+
+void SpaceHash3D::fillSlots(const std::vector<vmath::Vector3> &points)
+{
+    int n_points = points.size();
+
+    mSlotPoint.resize(n_points);
+    mSlotPosition.resize(n_points);
+    mPointSlot.resize(n_points);
+
+    // points are visited in index order, so each cell lists its points in ascending order
+    mCellCursor.assign(mCellStart.begin(), mCellStart.end()-1);
+    for (int i = 0; i<n_points; i++)
+    {
+        int slot = mCellCursor[mPointCell[i]]++;
+        mSlotPoint[slot] = i;
+        mSlotPosition[slot] = points[i];
+        mPointSlot[i] = slot;
+    }
+}
+
+void SpaceHash3D::update(const std::vector<vmath::Vector3> &points)
+{
+    int n_points = points.size();
+    if (n_points != int(mPointCell.size()))
+    {
+        rehash(points);
+        return;
+    }
+
+    // find the points that changed cell
+    mMovedPoints.clear();
+    for (int i = 0; i<n_points; i++)
+    {
+        if (!insideGrid(points[i]))
+        {
+            // a full rehash is needed to resize the grid
+            rehash(points);
+            return;
+        }
+
+        int I = findPointCellId(points[i]);
+        if (I == -1)
+        {
+            // sparse layout and the point moved into a cell that is not stored yet,
+            // rebuild the occupied cells on the same grid
+            for (int i_p = 0; i_p<n_points; i_p++) mPointCell[i_p] = findPointCell(points[i_p]);
+            buildSparse(points);
+            return;
+        }
+        if (I != mPointCell[i]) mMovedPoints.push_back(i);
+    }
+
+    if (mMovedPoints.empty())
+    {
+        // the cell layout is unchanged, just refresh the positions
+        for (int i = 0; i<n_points; i++) mSlotPosition[mPointSlot[i]] = points[i];
+        return;
+    }
+
+    // new cell sizes: old sizes adjusted by the points that moved in or out
+    mCellCursor.resize(mNCells);
+    for (int I = 0; I<mNCells; I++) mCellCursor[I] = mCellStart[I+1]-mCellStart[I];
+    for (const int i : mMovedPoints)
+    {
+        mCellCursor[mPointCell[i]]--;
+        mPointCell[i] = findPointCellId(points[i]);
+        mCellCursor[mPointCell[i]]++;
+    }
+
+    mNextCellStart.resize(mNCells+1);
+    mNextCellStart[0] = 0;
+    for (int I = 0; I<mNCells; I++)
+    {
+        mNextCellStart[I+1] = mNextCellStart[I] + mCellCursor[I];
+        mCellCursor[I] = mNextCellStart[I];
+    }
+
+    mNextSlotPoint.resize(n_points);
+    mNextSlotPosition.resize(n_points);
+
+    auto place = [&](int i, int I)
+    {
+        int slot = mCellCursor[I]++;
+        mNextSlotPoint[slot] = i;
+        mNextSlotPosition[slot] = points[i];
+        mPointSlot[i] = slot;
+    };
+
+    // points that stayed keep their relative order within the cell...
+    for (int I = 0; I<mNCells; I++)
     {
-        int I = findPointCell(mPoints[i]);
-        mGridToPointMap[I].push_back(i);
+        for (int slot = mCellStart[I]; slot<mCellStart[I+1]; slot++)
+        {
+            int i = mSlotPoint[slot];
+            if (mPointCell[i] == I) place(i, I);
+        }
     }
+
+    // ...and the moved points are appended to their new cells
+    for (const int i : mMovedPoints) place(i, mPointCell[i]);
+
+    std::swap(mCellStart, mNextCellStart);
+    std::swap(mSlotPoint, mNextSlotPoint);
+    std::swap(mSlotPosition, mNextSlotPosition);
+}
+
+void SpaceHash3D::compact(const std::vector<int> &point_remap)
+{
+    int n_old = mPointCell.size();
+    DEBUG_ASSERT(int(point_remap.size()) == n_old);
+
+    // slots are filled in order, so cells keep listing their points in ascending order
+    int slot_new = 0;
+    for (int I = 0; I<mNCells; I++)
+    {
+        int slot_begin = mCellStart[I];
+        mCellStart[I] = slot_new;
+        for (int slot = slot_begin; slot<mCellStart[I+1]; slot++)
+        {
+            int i = point_remap[mSlotPoint[slot]];
+            if (i == -1) continue;
+
+            mSlotPoint[slot_new] = i;
+            mSlotPosition[slot_new] = mSlotPosition[slot];
+            slot_new++;
+        }
+    }
+    int n_new = slot_new;
+    mCellStart[mNCells] = n_new;
+
+    mSlotPoint.resize(n_new);
+    mSlotPosition.resize(n_new);
+
+    for (int i = 0; i<n_old; i++)
+    {
+        if (point_remap[i] != -1) mPointCell[point_remap[i]] = mPointCell[i];
+    }
+    mPointCell.resize(n_new);
+
+    mPointSlot.resize(n_new);
+    for (int slot = 0; slot<n_new; slot++) mPointSlot[mSlotPoint[slot]] = slot;
+
+    if (n_old > 0)
+    {
+        mPointCubeVolDensity *= float(n_new)/float(n_old);
+        mPointCubeAreaDensity *= float(n_new)/float(n_old);
+    }
+}
+
+void SpaceHash3D::kNearestScanCell(int I, const vmath::Vector3 &point, int k, Neighbor *heap, int &count,
+                                   float max_radius_sqr, int exclude) const
+{
+    for (int slot = mCellStart[I]; slot<mCellStart[I+1]; slot++)
+    {
+        int i_p = mSlotPoint[slot];
+        if (i_p == exclude) continue;
+
+        Neighbor candidate = {vmath::lengthSqr(mSlotPosition[slot]-point), i_p};
+        if (!(candidate.distSqr < max_radius_sqr)) continue;
+
+        // heap[0] is the worst of the current candidates
+        if (count < k)
+        {
+            heap[count++] = candidate;
+            std::push_heap(heap, heap+count);
+        }
+        else if (candidate < heap[0])
+        {
+            std::pop_heap(heap, heap+count);
+            heap[count-1] = candidate;
+            std::push_heap(heap, heap+count);
+        }
+    }
+}
+
+int SpaceHash3D::kNearest(const vmath::Vector3 &point, int k, Neighbor *neighbors_out,
+                          float max_radius, int exclude) const
+{
+    if (k <= 0) return 0;
+
+    int count = 0;
+    float max_radius_sqr = max_radius < std::numeric_limits<float>::max() ? max_radius*max_radius : max_radius;
+
+    // start from the closest cell inside the grid, the ring bound below still holds for
+    // points outside the grid since the distance to the grid is at least the distance
+    // from the clamped point
+    int i_mid = std::min(std::max(findCell_i(point), 0), mNx-1);
+    int j_mid = std::min(std::max(findCell_j(point), 0), mNy-1);
+    int k_mid = std::min(std::max(findCell_k(point), 0), mNz-1);
+
+    vmath::Vector3 side_lengths = mMax-mMin;
+    float min_cell_size = std::min(side_lengths[0]/float(mNx), std::min(side_lengths[1]/float(mNy), side_lengths[2]/float(mNz)));
+
+    int max_ring = std::max(mNx, std::max(mNy, mNz));
+    for (int r = 0; r<=max_ring; r++)
+    {
+        // visit the cells at chebyshev distance r from the middle cell
+        for (int i = std::max(i_mid-r, 0); i<=std::min(i_mid+r, mNx-1); i++)
+        {
+            for (int j = std::max(j_mid-r, 0); j<=std::min(j_mid+r, mNy-1); j++)
+            {
+                // columns on the ring need all k in range, inner columns only the two end caps
+                bool column_on_ring = std::abs(i-i_mid)==r || std::abs(j-j_mid)==r;
+                int k_lo = k_mid-r;
+                int k_hi = k_mid+r;
+
+                if (mSparse)
+                {
+                    int column = i+j*mNx;
+                    for (int c = mColumnCellStart[column]; c<mColumnCellStart[column+1]; c++)
+                    {
+                        int cell_k = mCellK[c];
+                        bool on_ring = column_on_ring ? (cell_k>=k_lo && cell_k<=k_hi) : (cell_k==k_lo || cell_k==k_hi);
+                        if (on_ring) kNearestScanCell(c, point, k, neighbors_out, count, max_radius_sqr, exclude);
+                    }
+                }
+                else if (column_on_ring)
+                {
+                    for (int cell_k = std::max(k_lo, 0); cell_k<=std::min(k_hi, mNz-1); cell_k++)
+                        kNearestScanCell(localToGlobal(i,j,cell_k), point, k, neighbors_out, count, max_radius_sqr, exclude);
+                }
+                else
+                {
+                    if (k_lo >= 0) kNearestScanCell(localToGlobal(i,j,k_lo), point, k, neighbors_out, count, max_radius_sqr, exclude);
+                    if (k_hi < mNz) kNearestScanCell(localToGlobal(i,j,k_hi), point, k, neighbors_out, count, max_radius_sqr, exclude);
+                }
+            }
+        }
+
+        // every cell in ring r+1 or further out is at least r cells away from the point
+        float ring_dist = float(r)*min_cell_size;
+        if (count == k && neighbors_out[0].distSqr <= ring_dist*ring_dist) break;
+        if (ring_dist >= max_radius) break;
+    }
+
+    std::sort_heap(neighbors_out, neighbors_out+count);
+    return count;
+}
+
+int SpaceHash3D::nearest(const vmath::Vector3 &point, float max_radius, int exclude) const
+{
+    Neighbor closest;
+    int count = kNearest(point, 1, &closest, max_radius, exclude);
+    return count > 0 ? closest.index : -1;
+}
+
+void SpaceHash3D::kNearestBatch(const vmath::Vector3 *query_points, int n_queries, int k, Neighbor *neighbors_out,
+                                float max_radius, bool exclude_query_index) const
+{
+    Threads::parallelFor(0, n_queries, [&](int q_begin, int q_end)
+    {
+        for (int q = q_begin; q<q_end; q++)
+        {
+            Neighbor *neighbors = neighbors_out + q*k;
+            int count = kNearest(query_points[q], k, neighbors, max_radius, exclude_query_index ? q : -1);
+            for (int n = count; n<k; n++) neighbors[n] = {std::numeric_limits<float>::max(), -1};
+        }
+    });
 }
 
 float SpaceHash3D::getPointDensity() const
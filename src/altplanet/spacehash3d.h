@@ -14,18 +14,70 @@ namespace vmath = Vectormath::Aos;
 class SpaceHash3D
 {
 public:
-    SpaceHash3D(const std::vector<vmath::Vector3> &points);
+    // Dense stores an offset for every grid cell. Sparse stores only the occupied cells, grouped
+    // in (i,j) columns, which keeps memory and scan cost proportional to the surface for points
+    // on a thin shell. Auto picks Sparse when the points share few occupied cells.
+    enum class Layout {Auto, Dense, Sparse};
+
+    SpaceHash3D(const std::vector<vmath::Vector3> &points, Layout layout = Layout::Auto);
     virtual ~SpaceHash3D();
 
+    // Move the hashed points to new positions. Only points that changed cell are moved in the
+    // cell storage and all allocations are reused. Falls back to rehash if the number of points
+    // changed or a point left the grid bounds.
     void update(const std::vector<vmath::Vector3> &points);
     void rehash(const std::vector<vmath::Vector3> &points);
 
+    // Drop points from the hash and renumber the rest. point_remap maps every old point index
+    // to its new index, or -1 if it is removed, and must keep the order of the kept points.
+    // The grid is kept as it is, so this is one linear pass over the cell storage.
+    void compact(const std::vector<int> &point_remap);
+
     template<class Func>
     void forEachPointInSphere(vmath::Vector3 center, float radius, Func func) const;
 
-    bool sphereCheckDelaunayGlobal(int tri_pt0, int tri_pt1, int tri_pt2) const;
+    struct Neighbor
+    {
+        float distSqr;
+        int index;
+
+        // ties are broken on index so that results do not depend on the storage order
+        bool operator<(const Neighbor &other) const
+        {
+            return distSqr < other.distSqr || (distSqr == other.distSqr && index < other.index);
+        }
+    };
+
+    /**
+     * @brief kNearest: Find the k hashed points closest to a point. The search grows ring by ring
+     *          of cells around the point and keeps the candidates in a bounded heap stored in
+     *          neighbors_out, so a query does not allocate.
+     * @param neighbors_out: Caller provided array of at least k elements, filled with the found
+     *          points sorted on increasing distance
+     * @param max_radius: Only points closer than this are considered
+     * @param exclude: Point index to skip, for example the index of the query point itself
+     * @return: The number of points found, less than k if fewer points are within max_radius
+     */
+    int kNearest(const vmath::Vector3 &point, int k, Neighbor *neighbors_out,
+                 float max_radius = std::numeric_limits<float>::max(), int exclude = -1) const;
+
+    // index of the closest hashed point, or -1 if there is none within max_radius
+    int nearest(const vmath::Vector3 &point,
+                float max_radius = std::numeric_limits<float>::max(), int exclude = -1) const;
+
+    /**
+     * @brief kNearestBatch: kNearest for many points at once, split over the thread pool
+     * @param neighbors_out: Caller provided array of n_queries*k elements, query q writes to
+     *          [q*k, (q+1)*k). Entries past the number of found points get index -1.
+     * @param exclude_query_index: If true query q skips hashed point q, for querying the hashed
+     *          points themselves
+     */
+    void kNearestBatch(const vmath::Vector3 *query_points, int n_queries, int k, Neighbor *neighbors_out,
+                       float max_radius = std::numeric_limits<float>::max(), bool exclude_query_index = false) const;
 
     float getPointDensity() const;
+
+    bool isSparse() const {return mSparse;}
     /*
     template<class F>
     void forEachCellNeighborhood(int neighborhood_size, F func) const;
@@ -37,8 +89,32 @@ protected:
 
 
 private:
-    std::vector<vmath::Vector3> mPoints;
-    std::vector<int> * mGridToPointMap;
+    // Cell storage in compressed sparse row form, the points in cell I occupy the slots
+    // [mCellStart[I], mCellStart[I+1]). Positions are stored in slot order so that a cell
+    // scan reads contiguous memory. In the dense layout the cell id is the global grid index,
+    // in the sparse layout it indexes the occupied cells only.
+    std::vector<int> mCellStart;
+    std::vector<int> mSlotPoint;                // slot -> point index
+    std::vector<vmath::Vector3> mSlotPosition;  // slot -> point position
+    std::vector<int> mPointSlot;                // point index -> slot
+    std::vector<int> mPointCell;                // point index -> cell
+
+    // sparse layout: the occupied cells of column (i,j) are [mColumnCellStart[c], mColumnCellStart[c+1])
+    // with c = i+j*mNx, sorted on k
+    std::vector<int> mColumnCellStart;
+    std::vector<int> mCellK;                    // occupied cell -> k
+
+    Layout mLayout;
+    bool mSparse;
+    int mNCells;
+
+    // scratch buffers for rebuilding the cell storage, kept to avoid reallocating
+    std::vector<int> mCellCursor;
+    std::vector<int> mNextCellStart;
+    std::vector<int> mNextSlotPoint;
+    std::vector<vmath::Vector3> mNextSlotPosition;
+    std::vector<int> mMovedPoints;
+
     int mNGrid;
 
     vmath::Vector3 mMin;
@@ -54,6 +130,20 @@ private:
 private:
     static constexpr float AV_PTS_PER_CELL_PREF = 0.2f;
 
+    // Auto layout uses the sparse layout if the number of occupied cells is at most this fraction
+    // of the most there could be, min(number of points, number of cells). Points spread through
+    // the volume mostly get a cell of their own, points on a shell share cells.
+    static constexpr float SPARSE_MAX_OCCUPANCY = 0.5f;
+
+    void kNearestScanCell(int I, const vmath::Vector3 &point, int k, Neighbor *heap, int &count,
+                          float max_radius_sqr, int exclude) const;
+
+    void buildDense(const std::vector<vmath::Vector3> &points);
+    void buildSparse(const std::vector<vmath::Vector3> &points);
+    void fillSlots(const std::vector<vmath::Vector3> &points);
+
+    inline const vmath::Vector3 &pointPosition(int i_p) const {return mSlotPosition[mPointSlot[i_p]];}
+
     inline int localToGlobal(int i, int j, int k) const {return i+j*mNx+k*mNx*mNy;}
 
     inline int findCell_i(const vmath::Vector3 &point) const {return floor((point[0]-mMin[0])/(mMax[0]-mMin[0])*float(mNx));}
@@ -67,6 +157,34 @@ private:
 
         return localToGlobal(i,j,k);
     }
+
+    inline int findSparseCell(int column, int k) const {
+        for (int c = mColumnCellStart[column]; c<mColumnCellStart[column+1]; c++)
+        {
+            if (mCellK[c] == k) return c;
+        }
+        return -1;
+    }
+
+    inline bool insideGrid(const vmath::Vector3 &point) const {
+        int i = findCell_i(point);
+        int j = findCell_j(point);
+        int k = findCell_k(point);
+
+        return i>=0 && i<mNx && j>=0 && j<mNy && k>=0 && k<mNz;
+    }
+
+    // cell id of a point inside the grid in the current layout, -1 if the
+    // layout is sparse and the cell is not occupied
+    inline int findPointCellId(const vmath::Vector3 &point) const {
+        if (!mSparse) return findPointCell(point);
+
+        int i = findCell_i(point);
+        int j = findCell_j(point);
+        int k = findCell_k(point);
+
+        return findSparseCell(i+j*mNx, k);
+    }
 };
 
 struct CircumDisk
@@ -167,48 +285,48 @@ void SpaceHash3D::forEachPointInSphere(vmath::Vector3 center, float radius, Func
     int n_half_y = ceil(radius/cell_size_y)+offset_why_needed;
     int n_half_z = ceil(radius/cell_size_z)+offset_why_needed;
 
+    int k_begin = std::max(k_mid-n_half_z,0);
+    int k_end = std::min(k_mid+n_half_z, mNz);
+
+    auto scan_cell = [&](int I) -> bool
+    {
+        for (int slot = mCellStart[I]; slot<mCellStart[I+1]; slot++)
+        {
+            if (vmath::lengthSqr(mSlotPosition[slot]-center)<radius*radius)
+            {
+                bool early_return = func(mSlotPoint[slot]);
+                if (early_return) return true;
+            }
+        }
+        return false;
+    };
+
     for (int i = std::max(i_mid-n_half_x, 0);i<std::min(i_mid+n_half_x, mNx);i++)
     {
         for (int j = std::max(j_mid-n_half_y,0);j<std::min(j_mid+n_half_y, mNy);j++)
         {
-            for (int k = std::max(k_mid-n_half_z,0);k<std::min(k_mid+n_half_z, mNz);k++)
+            if (mSparse)
+            {
+                // only visit the occupied cells of the column, they are sorted on k so
+                // the visiting order is the same as for the dense layout
+                int column = i+j*mNx;
+                for (int c = mColumnCellStart[column]; c<mColumnCellStart[column+1]; c++)
+                {
+                    if (mCellK[c] < k_begin) continue;
+                    if (mCellK[c] >= k_end) break;
+                    if (scan_cell(c)) return;
+                }
+            }
+            else
             {
-                // should check aabb sphere intersection here...
-                int I = localToGlobal(i,j,k);
-                for (const auto &pt : mGridToPointMap[I])
+                for (int k = k_begin; k<k_end; k++)
                 {
-                    if (vmath::lengthSqr(mPoints[pt]-center)<radius*radius)
-                    {
-                        bool early_return = func(pt);
-                        if (early_return) return;
-                    }
+                    // should check aabb sphere intersection here...
+                    if (scan_cell(localToGlobal(i,j,k))) return;
                 }
             }
         }
     }
 }
 
-inline bool SpaceHash3D::sphereCheckDelaunayGlobal(int tri_pt0, int tri_pt1, int tri_pt2) const
-{
-    // create the triangle circumsphere
-    CircumDisk circum_disk = getCircumDisk(mPoints[tri_pt0], mPoints[tri_pt1], mPoints[tri_pt2]);
-    const vmath::Vector3 &csphere_center = circum_disk.center;
-    const float &csphere_radius = circum_disk.radius;
-
-    // check if any points in circumsphere
-    bool is_delaunay = true;
-    forEachPointInSphere(csphere_center, csphere_radius, [&](const int &p) -> bool {
-        // if another point is inside the circumsphere, then it is not a delaunay triangle
-        bool early_return = false;
-        if (p!=tri_pt0 && p!=tri_pt1 && p!=tri_pt2)
-        {
-            is_delaunay = false;
-            early_return = true;
-        }
-        return early_return;
-    });
-
-    return is_delaunay;
-}
-
 #endif // SPACEHASH3D_H
@@ -1,16 +1,14 @@
 #include "subivide.h"
-#include <map>
 
 #include "../common/mathext.h"
 #include "../common/macro/macrodebugassert.h"
+#include "../common/threads/parallelfor.h"
 
 using namespace MathExt;
 
 namespace AltPlanet
 {
 
-using IntpairIntMapType = std::map<std::pair<int, int>, int>;
-
 inline vmath::Vector3 getMidpoint(const vmath::Vector3 &p1,
                                   const vmath::Vector3 &p2)
 {
@@ -30,111 +28,180 @@ inline vmath::Vector3 getMidpoint(const vmath::Vector3 &p1,
     return out;
 }
 
-int getSubdPointIndex(const int i1,
-                      const int i2,
-                      std::vector<vmath::Vector3> &points,
-                      IntpairIntMapType &midpoints_cache)
+void subdivideOnce(  std::vector<vmath::Vector3> &points,
+                     std::vector<gfx::Triangle> &triangles,
+                     const gfx::MeshTopology &topology)
 {
-    // ordering of subdivision edge points is irrelevant, so
-    // order i1 and i2 according to relative magnitude to avoid
-    // duplicates in cache, i.e. don't want both (i1,i2) and (i2,i1)
-    int i_lo = i1<i2 ? i1 : i2;
-    int i_hi = i1>i2 ? i1 : i2;
-    std::pair<int, int> midpoint_key = {i_lo, i_hi};
+    DEBUG_ASSERT(topology.numPoints() == points.size() && topology.numTriangles() == triangles.size());
 
-    // check if point exists in cache
-    auto midpoint_it = midpoints_cache.find(midpoint_key);
+    // every edge gets one new point, so all indices are known before anything is written
+    int n_old_points = points.size();
+    points.resize(n_old_points + topology.numEdges());
 
-    if (midpoint_it != midpoints_cache.end())
+    Threads::parallelFor(0, topology.numEdges(), [&](int begin, int end)
     {
-        // just return the point from the cache
-        return midpoint_it->second;
-    }
-    else
+        for (int i_e = begin; i_e < end; i_e++)
+        {
+            const gfx::Line &edge = topology.edge(i_e);
+            points[n_old_points + i_e] = getMidpoint(points[edge[0]], points[edge[1]]);
+        }
+    });
+
+    // create a copy of old triangles
+    std::vector<gfx::Triangle> old_triangles;
+    old_triangles.swap(triangles);
+    triangles.resize(4*old_triangles.size());
+
+    Threads::parallelFor(0, int(old_triangles.size()), [&](int begin, int end)
     {
-        // create the point
-        vmath::Vector3 mid_pt = getMidpoint(points[i_lo], points[i_hi]);
-        points.push_back( mid_pt );
-        int last_element_index = points.size() - 1;
-
-        // add it to the cache
-        midpoints_cache.insert( {midpoint_key, last_element_index} );
-        return last_element_index;
-    }
+        for (int i = begin; i < end; i++)
+        {
+            // get indices of the three new points (organized by sides)
+            gfx::Triangle const &prev_triangle = old_triangles[i];
+            int new_points_indices[] = {
+                n_old_points + topology.edgeOf(gfx::MeshTopology::halfEdge(i, 0)),
+                n_old_points + topology.edgeOf(gfx::MeshTopology::halfEdge(i, 1)),
+                n_old_points + topology.edgeOf(gfx::MeshTopology::halfEdge(i, 2))
+            };
+
+            // create the subdivided triangles, using previously existing and new corners
+            triangles[4*i+0] = {prev_triangle[0], new_points_indices[0], new_points_indices[2]};
+            triangles[4*i+1] = {prev_triangle[1], new_points_indices[1], new_points_indices[0]};
+            triangles[4*i+2] = {prev_triangle[2], new_points_indices[2], new_points_indices[1]};
+            triangles[4*i+3] = {new_points_indices[0], new_points_indices[1], new_points_indices[2]};
+        }
+    });
 }
 
 void subdivideOnce(  std::vector<vmath::Vector3> &points,
                      std::vector<gfx::Triangle> &triangles)
 {
-    // check input
-    // check num_subdivisions positive
+    subdivideOnce(points, triangles, gfx::MeshTopology(points.size(), triangles));
+}
 
-    // create a copy of old triangles
-    std::vector<gfx::Triangle> old_triangles = triangles;
-    triangles.clear();
+// Split the triangles n_splits times along every edge, where n_splits is the last entry of
+// level_splits. level_triangles[l] gets the triangles of the coarser split level_splits[l],
+// which must divide n_splits. They index the points of the finest split, so every level
+// shares one point array.
+static void splitLevels( std::vector<vmath::Vector3> &points,
+                         const std::vector<gfx::Triangle> &old_triangles,
+                         const gfx::MeshTopology &topology,
+                         const std::vector<int> &level_splits,
+                         std::vector<std::vector<gfx::Triangle>> &level_triangles)
+{
+    DEBUG_ASSERT(topology.numPoints() == points.size() && topology.numTriangles() == old_triangles.size());
 
-    // Use a cache to keep points resulting from subidiving a shared edge
-    IntpairIntMapType midpoints_cache;
+    // new points: n-1 on every edge, then (n-1)(n-2)/2 inside every triangle
+    const int n = level_splits.back();
+    const int n_edge_points = n-1;
+    const int n_inner_points = (n-1)*(n-2)/2;
 
-    // for progress tracking
-    std::cout << "[" << std::string(10, ' ') << "]";
+    int n_old_points = points.size();
+    int first_inner_point = n_old_points + topology.numEdges()*n_edge_points;
+    points.resize(first_inner_point + topology.numTriangles()*n_inner_points);
 
-    // get index of current last triangle
-    int prev_subdlvl_size = old_triangles.size();
-    for (int i = 0; i < prev_subdlvl_size; i++)
+    Threads::parallelFor(0, topology.numEdges(), [&](int begin, int end)
     {
-        // progress bar
-        int progress_often= 10.0f*((float)(i)/(float)(prev_subdlvl_size))+1;
-        if ((i)%(prev_subdlvl_size/10)==0) {
-            std::cout << std::string(11, '\b')
-                      << std::string(progress_often, '=')
-                      << std::string(10-progress_often, ' ')
-                      << "]" << std::flush;
+        for (int i_e = begin; i_e < end; i_e++)
+        {
+            const gfx::Line &edge = topology.edge(i_e);
+            for (int k = 1; k < n; k++)
+            {
+                points[n_old_points + i_e*n_edge_points + k-1] = (float(n-k)*points[edge[0]] + float(k)*points[edge[1]])/float(n);
+            }
         }
+    });
 
-        // get indices of the three new points (organized by sides)
-        gfx::Triangle const &prev_triangle = old_triangles[i];
-        int new_points_indices[] = {
-            getSubdPointIndex(prev_triangle[0], prev_triangle[1], points, midpoints_cache),
-            getSubdPointIndex(prev_triangle[1], prev_triangle[2], points, midpoints_cache),
-            getSubdPointIndex(prev_triangle[2], prev_triangle[0], points, midpoints_cache)
-        };
+    // a triangle a, b, c is split on the lattice a + i/n*(b-a) + j/n*(c-a), i+j <= n,
+    // with row j holding n+1-j lattice points
+    auto lattice_index = [n](int i, int j) {return j*(n+1) - j*(j-1)/2 + i;};
+    const int n_lattice = (n+1)*(n+2)/2;
 
-        // create the subdivided triangles, using previously existing and new corners
-        triangles.push_back(
+    level_triangles.resize(level_splits.size());
+    for (size_t l = 0; l < level_splits.size(); l++)
+    {
+        DEBUG_ASSERT(n % level_splits[l] == 0);
+        level_triangles[l].resize(level_splits[l]*level_splits[l]*old_triangles.size());
+    }
+
+    Threads::parallelFor(0, int(old_triangles.size()), [&](int begin, int end)
+    {
+        std::vector<int> lattice(n_lattice);
+
+        for (int i_t = begin; i_t < end; i_t++)
+        {
+            const gfx::Triangle &tri = old_triangles[i_t];
+
+            // point k segments along the edge of half-edge j, counted from its start tri[j]
+            auto edge_point = [&](int j, int k)
             {
-                prev_triangle[0],
-                new_points_indices[0],
-                new_points_indices[2]
-            }
-        );
+                int i_e = topology.edgeOf(gfx::MeshTopology::halfEdge(i_t, j));
+                if (topology.edge(i_e)[0] != tri[j]) k = n-k;
+                return n_old_points + i_e*n_edge_points + k-1;
+            };
 
-        triangles.push_back(
+            lattice[lattice_index(0, 0)] = tri[0];
+            lattice[lattice_index(n, 0)] = tri[1];
+            lattice[lattice_index(0, n)] = tri[2];
+            for (int k = 1; k < n; k++)
             {
-                prev_triangle[1],
-                new_points_indices[1],
-                new_points_indices[0]
+                lattice[lattice_index(k, 0)] = edge_point(0, k);
+                lattice[lattice_index(n-k, k)] = edge_point(1, k);
+                lattice[lattice_index(0, n-k)] = edge_point(2, k);
             }
-        );
 
-        triangles.push_back(
+            int i_inner = first_inner_point + i_t*n_inner_points;
+            for (int j = 1; j < n-1; j++)
             {
-                prev_triangle[2],
-                new_points_indices[2],
-                new_points_indices[1]
+                for (int i = 1; i < n-j; i++)
+                {
+                    lattice[lattice_index(i, j)] = i_inner;
+                    points[i_inner++] = (float(n-i-j)*points[tri[0]] + float(i)*points[tri[1]] + float(j)*points[tri[2]])/float(n);
+                }
             }
-        );
 
-        triangles.push_back(
+            // s^2 triangles with the orientation of the parent, pointing up and down in each row,
+            // on every (n/s)th lattice point
+            for (size_t l = 0; l < level_splits.size(); l++)
             {
-                new_points_indices[0],
-                new_points_indices[1],
-                new_points_indices[2]
+                const int m = level_splits[l];
+                const int d = n/m;
+                auto corner = [&](int i, int j) {return lattice[lattice_index(d*i, d*j)];};
+
+                gfx::Triangle *out = &level_triangles[l][m*m*i_t];
+                for (int j = 0; j < m; j++)
+                {
+                    for (int i = 0; i < m-j; i++)
+                    {
+                        *out++ = {corner(i, j), corner(i+1, j), corner(i, j+1)};
+                        if (i < m-j-1)
+                        {
+                            *out++ = {corner(i+1, j), corner(i+1, j+1), corner(i, j+1)};
+                        }
+                    }
+                }
             }
-        );
-    } // for (int i = 0; i < prev_subdlvl_size; i++)
+        }
+    });
+}
+
+void subdivideSplit( std::vector<vmath::Vector3> &points,
+                     std::vector<gfx::Triangle> &triangles,
+                     const gfx::MeshTopology &topology,
+                     const int n_splits)
+{
+    if (n_splits < 2) return;
 
-    std::cout << std::endl;
+    std::vector<std::vector<gfx::Triangle>> level_triangles;
+    splitLevels(points, triangles, topology, {n_splits}, level_triangles);
+    triangles.swap(level_triangles.back());
+}
+
+void subdivideSplit( std::vector<vmath::Vector3> &points,
+                     std::vector<gfx::Triangle> &triangles,
+                     const int n_splits)
+{
+    subdivideSplit(points, triangles, gfx::MeshTopology(points.size(), triangles), n_splits);
 }
 
 
@@ -152,80 +219,16 @@ void subdivideGeometry(  std::vector<vmath::Vector3> &points,
     // Create subdivision level zero by creating Icosahedron
     triangles_subd_lvls.push_back(triangles);
 
-    // Subsequently subdivide triangles
-    for (int k = 1; k < num_subdivisions + 1; k++)
+    // Split all levels in one pass, level k halves the edges of level k-1. The points are
+    // where repeated subdivideOnce calls would put them.
+    if (num_subdivisions > 0)
     {
-        std::cout << "subdividing level " << k << ": ";
-        triangles_subd_lvls.push_back(std::vector<gfx::Triangle>());
-
-        // Use a cache to keep points resulting from subidiving a shared edge
-        IntpairIntMapType midpoints_cache;
-
-        // for progress tracking
-        std::cout << "[" << std::string(10, ' ') << "]";
-
-        // get index of current last triangle
-        int prev_subdlvl_size = triangles_subd_lvls[k-1].size();
-        for (int i = 0; i < prev_subdlvl_size; i++)
-        {
-            // progress bar
-            int progress_often= 10.0f*((float)(i)/(float)(prev_subdlvl_size))+1;
-            if ((i)%(prev_subdlvl_size/10)==0) {
-                std::cout << std::string(11, '\b')
-                          << std::string(progress_often, '=')
-                          << std::string(10-progress_often, ' ')
-                          << "]" << std::flush;
-            }
-
-            // get indices of the three new points (organized by sides)
-            gfx::Triangle const &prev_triangle = triangles_subd_lvls[k-1][i];
-            int new_points_indices[] = {
-                getSubdPointIndex(prev_triangle[0], prev_triangle[1], points, midpoints_cache),
-                getSubdPointIndex(prev_triangle[1], prev_triangle[2], points, midpoints_cache),
-                getSubdPointIndex(prev_triangle[2], prev_triangle[0], points, midpoints_cache)
-            };
-
-            // create the subdivided triangles, using previously existing and new corners
-            triangles_subd_lvls[k].push_back(
-                {
-                    prev_triangle[0],
-                    new_points_indices[0],
-                    new_points_indices[2]
-                }
-            );
-
-            triangles_subd_lvls[k].push_back(
-                {
-                    prev_triangle[1],
-                    new_points_indices[1],
-                    new_points_indices[0]
-                }
-            );
-
-            triangles_subd_lvls[k].push_back(
-                {
-                    prev_triangle[2],
-                    new_points_indices[2],
-                    new_points_indices[1]
-                }
-            );
-
-            triangles_subd_lvls[k].push_back(
-                {
-                    new_points_indices[0],
-                    new_points_indices[1],
-                    new_points_indices[2]
-                }
-            );
-        } // for (int i = 0; i < prev_subdlvl_size; i++)
-
-        std::cout << std::endl;
+        std::vector<int> level_splits;
+        for (int k = 1; k < num_subdivisions + 1; k++) level_splits.push_back(1 << k);
 
-//        // compare cache size with cache initial reserved capacity
-//        std::cout << "size of cached points ends up as" << midpoints_cache.size()
-//                  << " cached points" << std::endl;
-//        std::cout << "reserved capacity for " << num_cache_points_max
-//                  << " cached points" << std::endl;
+        std::vector<std::vector<gfx::Triangle>> level_triangles;
+        splitLevels(points, triangles, gfx::MeshTopology(points.size(), triangles), level_splits, level_triangles);
+        for (auto &level : level_triangles) triangles_subd_lvls.push_back(std::move(level));
     }
 
     // copy the highest subdivision level to the resulting triangles
@@ -3,19 +3,39 @@
 
 #include <vector>
 #include "../common/gfx_primitives.h"
+#include "../common/meshtopology.h"
 
 namespace AltPlanet
 {
 
+// subd_triangles gets the triangles of every level 0..num_subdivisions, all indexing points,
+// and triangles is left with the finest level. Split in one pass by subdivideSplit.
 void subdivideGeometry(  std::vector<vmath::Vector3> &points,
                          std::vector<gfx::Triangle> &triangles,
                          std::vector<std::vector<gfx::Triangle>> &subd_triangles,
                          const int num_subdivisions);
 
+// split every triangle in four through its edge midpoints. The midpoint of edge i_e of the
+// topology gets point index n_points + i_e.
+void subdivideOnce(  std::vector<vmath::Vector3> &points,
+                     std::vector<gfx::Triangle> &triangles,
+                     const gfx::MeshTopology &topology);
 
 void subdivideOnce(  std::vector<vmath::Vector3> &points,
                      std::vector<gfx::Triangle> &triangles);
 
+// split every edge into n_splits segments and every triangle into n_splits^2 triangles in one
+// pass. With n_splits = 2^k the points end up where k calls to subdivideOnce would put them,
+// only numbered differently.
+void subdivideSplit( std::vector<vmath::Vector3> &points,
+                     std::vector<gfx::Triangle> &triangles,
+                     const gfx::MeshTopology &topology,
+                     const int n_splits);
+
+void subdivideSplit( std::vector<vmath::Vector3> &points,
+                     std::vector<gfx::Triangle> &triangles,
+                     const int n_splits);
+
 } // namespace AltPlanet
 
 
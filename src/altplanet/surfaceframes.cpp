@@ -0,0 +1,43 @@
+#include "surfaceframes.h"
+
+#include "planetshapes.h"
+#include "../common/threads/parallelfor.h"
+
+namespace AltPlanet {
+
+bool SurfaceFrames::covers(const std::vector<vmath::Vector3> &points) const
+{
+    if (heights.size() != points.size()) return false;
+
+    // relative to the distance from the origin, the frames only round off that much
+    const float tolerance_sqr = 1e-10f;
+    for (size_t i = 0; i<points.size(); i++)
+    {
+        float error_sqr = vmath::lengthSqr(points[i] - atHeight(i, heights[i]));
+        if (error_sqr > tolerance_sqr*(vmath::lengthSqr(points[i]) + 1.0f)) return false;
+    }
+    return true;
+}
+
+SurfaceFrames computeSurfaceFrames(const std::vector<vmath::Vector3> &points, const Shape::BaseShape &planet_shape)
+{
+    SurfaceFrames frames;
+    frames.heights.resize(points.size());
+    frames.normals.resize(points.size());
+    frames.zeroHeightPoints.resize(points.size());
+
+    Threads::parallelFor(0, int(points.size()), [&](int begin, int end)
+    {
+        for (int i = begin; i<end; i++)
+        {
+            Shape::BaseShape::SurfaceLine surface_line = planet_shape.shapeFunction(points[i]);
+            frames.heights[i] = vmath::length(points[i] - surface_line.zeroHeightPt);
+            frames.normals[i] = surface_line.surfNormal;
+            frames.zeroHeightPoints[i] = surface_line.zeroHeightPt;
+        }
+    });
+
+    return frames;
+}
+
+} // namespace AltPlanet
@@ -0,0 +1,40 @@
+#ifndef SURFACEFRAMES_H
+#define SURFACEFRAMES_H
+
+#include <vector>
+
+#include "../common/gfx_primitives.h"
+
+namespace AltPlanet {
+
+namespace Shape { class BaseShape; }
+
+/**
+ * @brief The SurfaceFrames struct: the shape's surface line through every planet point,
+ *          one array per field, so the stages that need heights and normals read them
+ *          instead of calling the shape and normalizing for every point again.
+ *          The frames belong to the points they were computed from and have to be computed
+ *          again if the points move.
+ */
+struct SurfaceFrames
+{
+    std::vector<float> heights;                     // Shape::BaseShape::getHeight
+    std::vector<vmath::Vector3> normals;            // unit surface normal, the direction of getGradDir
+    std::vector<vmath::Vector3> zeroHeightPoints;
+
+    bool empty() const {return heights.empty();}
+
+    // computed from these points: every point still lies at its height on its surface line.
+    // The cache is optional and may be missing or left behind by points that moved since.
+    bool covers(const std::vector<vmath::Vector3> &points) const;
+
+    // point i moved to height along its surface line, like Shape::BaseShape::setHeight
+    vmath::Vector3 atHeight(int i, float height) const {return zeroHeightPoints[i] + normals[i]*height;}
+};
+
+// the frames of all points, computed on the thread pool
+SurfaceFrames computeSurfaceFrames(const std::vector<vmath::Vector3> &points, const Shape::BaseShape &planet_shape);
+
+} // namespace AltPlanet
+
+#endif // SURFACEFRAMES_H
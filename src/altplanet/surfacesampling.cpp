@@ -0,0 +1,163 @@
+#include "surfacesampling.h"
+
+#include "../common/mathext.h"
+#include "../common/procedural/counterrng.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+
+using namespace MathExt;
+
+namespace AltPlanet
+{
+
+namespace
+{
+
+// candidates thrown around an active point before it is retired
+const int N_CANDIDATES = 16;
+
+// consecutive failed random seeds before the surface is considered covered
+const int N_SEED_ATTEMPTS = 64;
+
+// grid with cell size min_distance that only stores the occupied cells, a thin shell
+// would otherwise need a cubic number of cells
+class SparseGrid
+{
+public:
+    SparseGrid(float cell_size, const std::vector<vmath::Vector3> &points) :
+        mCellSize(cell_size), mPoints(points) {}
+
+    void insert(int i_p) {mCells[cellKey(cellCoord(mPoints[i_p]))].push_back(i_p);}
+
+    // is any stored point closer than min_distance, the cell size
+    bool anyWithin(const vmath::Vector3 &point) const
+    {
+        float min_distance_sqr = mCellSize*mCellSize;
+        std::array<int, 3> c = cellCoord(point);
+        for (int dk = -1; dk<=1; dk++)
+        for (int dj = -1; dj<=1; dj++)
+        for (int di = -1; di<=1; di++)
+        {
+            auto cell = mCells.find(cellKey({c[0]+di, c[1]+dj, c[2]+dk}));
+            if (cell == mCells.end()) continue;
+            for (int i_p : cell->second)
+            {
+                if (vmath::lengthSqr(mPoints[i_p]-point) < min_distance_sqr) return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    float mCellSize;
+    const std::vector<vmath::Vector3> &mPoints;
+    std::unordered_map<uint64_t, std::vector<int>> mCells;
+
+    std::array<int, 3> cellCoord(const vmath::Vector3 &point) const
+    {
+        return {int(std::floor(point[0]/mCellSize)), int(std::floor(point[1]/mCellSize)), int(std::floor(point[2]/mCellSize))};
+    }
+
+    static uint64_t cellKey(const std::array<int, 3> &c)
+    {
+        // 21 bits per axis, offset to make the coordinates positive
+        const int64_t offset = 1 << 20;
+        return  uint64_t(c[0]+offset) | (uint64_t(c[1]+offset) << 21) | (uint64_t(c[2]+offset) << 42);
+    }
+};
+
+vmath::Vector3 randomProjectedPoint(const Shape::BaseShape &planet_shape, const Procedural::CounterRng &rng, uint64_t i_draw)
+{
+    Shape::AABB aabb = planet_shape.getAABB();
+    vmath::Vector3 point = {rng.uniform(i_draw, 0, -aabb.width *0.75f, aabb.width *0.75f),
+                            rng.uniform(i_draw, 1, -aabb.height*0.75f, aabb.height*0.75f),
+                            rng.uniform(i_draw, 2, -aabb.width *0.75f, aabb.width *0.75f)};
+    return planet_shape.projectPoint(point);
+}
+
+} // anonymous namespace
+
+std::vector<vmath::Vector3> poissonDiskSurface(float min_distance, const Shape::BaseShape &planet_shape,
+                                               unsigned int seed, unsigned int substream)
+{
+    // the algorithm is sequential, so the numbers are indexed by a running draw count
+    Procedural::CounterRng rng(seed, Procedural::RngStage::PoissonDisk, substream);
+    uint64_t i_draw = 0;
+
+    std::vector<vmath::Vector3> points;
+    SparseGrid grid(min_distance, points);
+    std::vector<int> active;
+
+    int n_failed_seeds = 0;
+    while (n_failed_seeds < N_SEED_ATTEMPTS)
+    {
+        vmath::Vector3 seed_point = randomProjectedPoint(planet_shape, rng, i_draw++);
+        if (grid.anyWithin(seed_point))
+        {
+            n_failed_seeds++;
+            continue;
+        }
+        n_failed_seeds = 0;
+
+        points.push_back(seed_point);
+        grid.insert(points.size()-1);
+        active.push_back(points.size()-1);
+
+        // grow from the seed until its part of the surface is covered
+        while (!active.empty())
+        {
+            int i_active = rng.below(i_draw++, 0, active.size());
+            vmath::Vector3 origin = points[active[i_active]];
+
+            // tangent plane of the surface at the active point
+            vmath::Vector3 normal = vmath::normalize(planet_shape.getGradDir(origin));
+            vmath::Vector3 axis = std::abs(normal[0]) < 0.9f ? vmath::Vector3(1.0f, 0.0f, 0.0f) : vmath::Vector3(0.0f, 1.0f, 0.0f);
+            vmath::Vector3 t1 = vmath::normalize(vmath::cross(axis, normal));
+            vmath::Vector3 t2 = vmath::cross(normal, t1);
+
+            bool found = false;
+            for (int c = 0; c<N_CANDIDATES && !found; c++)
+            {
+                float angle = rng.uniform(i_draw, 0, 0.0f, 2.0f*DR_M_PI);
+                // uniform in the area of the annulus [r, 2r]
+                float radius = min_distance*std::sqrt(rng.uniform(i_draw, 1, 1.0f, 4.0f));
+                i_draw++;
+                vmath::Vector3 candidate = origin + radius*(std::cos(angle)*t1 + std::sin(angle)*t2);
+                candidate = planet_shape.projectPoint(candidate);
+
+                if (grid.anyWithin(candidate)) continue;
+
+                points.push_back(candidate);
+                grid.insert(points.size()-1);
+                active.push_back(points.size()-1);
+                found = true;
+            }
+
+            if (!found)
+            {
+                active[i_active] = active.back();
+                active.pop_back();
+            }
+        }
+    }
+
+    return points;
+}
+
+std::vector<vmath::Vector3> poissonDiskSurface(unsigned int n_points, const Shape::BaseShape &planet_shape, unsigned int seed)
+{
+    // coarse pass aiming at a quarter of the points, with the distance guessed from the AABB...
+    Shape::AABB aabb = planet_shape.getAABB();
+    float coarse_distance = aabb.width*std::sqrt(4.0f/float(std::max(n_points, 1u)));
+    int n_coarse = poissonDiskSurface(coarse_distance, planet_shape, seed, 0).size();
+
+    // ...then the number of points scales with the inverse square of the distance
+    float min_distance = coarse_distance*std::sqrt(float(n_coarse)/float(std::max(n_points, 1u)));
+    return poissonDiskSurface(min_distance, planet_shape, seed, 1);
+}
+
+}
@@ -0,0 +1,34 @@
+#ifndef SURFACESAMPLING_H
+#define SURFACESAMPLING_H
+
+#include <vector>
+
+#define _VECTORMATH_DEBUG
+#include "../dep/vecmath/vectormath_aos.h"
+#include "planetshapes.h"
+
+namespace AltPlanet
+{
+
+/**
+ * @brief poissonDiskSurface: Blue noise points on a planet shape surface, no two closer than
+ *          min_distance. Bridson's algorithm on the surface: new points are thrown in an annulus
+ *          [min_distance, 2*min_distance] on the tangent plane (from getGradDir) of an active
+ *          point and projected onto the shape with projectPoint, until no active points remain.
+ *          Seeds are random projected points, so every connected part of the shape is covered.
+ *          The random numbers come from the PoissonDisk stream of seed and substream.
+ * @return: Points on the surface, every surface point lies within 2*min_distance of one of them
+ */
+std::vector<vmath::Vector3> poissonDiskSurface(float min_distance, const Shape::BaseShape &planet_shape,
+                                               unsigned int seed, unsigned int substream = 0);
+
+/**
+ * @brief poissonDiskSurface: Blue noise points on a planet shape surface, with min_distance
+ *          chosen to give approximately n_points points. The shape area is not known, so a
+ *          coarse sampling is done first to measure it.
+ */
+std::vector<vmath::Vector3> poissonDiskSurface(unsigned int n_points, const Shape::BaseShape &planet_shape, unsigned int seed);
+
+}
+
+#endif // SURFACESAMPLING_H
@@ -0,0 +1,482 @@
+#include "surfacetriangulate.h"
+
+#include "../common/meshtopology.h"
+#include "../common/threads/parallelfor.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Triangulate
+{
+
+namespace
+{
+
+// number of nearest neighbours a Voronoi cell is first clipped with, doubled up to
+// MAX_NEIGHBORS if the cell turns out not to be final
+const int START_NEIGHBORS = 16;
+const int MAX_NEIGHBORS = 64;
+
+struct Vec2 { float x, y; };
+
+inline float dot2(const Vec2 &a, const Vec2 &b) { return a.x*b.x + a.y*b.y; }
+
+// convex polygon with a label per edge, edge i goes from vertex i to vertex i+1 and
+// was cut by the bisector with neighbour label[i], or the bounding box if -1
+struct LabelledPolygon
+{
+    std::array<Vec2, 4+MAX_NEIGHBORS> vertices;
+    std::array<int, 4+MAX_NEIGHBORS> labels;
+    int size;
+};
+
+// clip the polygon to the half plane y.d <= c, edges along the clip line get label
+void clipPolygon(const LabelledPolygon &in, LabelledPolygon &out, const Vec2 &d, float c, int label)
+{
+    out.size = 0;
+    for (int i = 0; i<in.size; i++)
+    {
+        const Vec2 &cur = in.vertices[i];
+        const Vec2 &nxt = in.vertices[(i+1)%in.size];
+        float cur_side = dot2(cur, d) - c;
+        float nxt_side = dot2(nxt, d) - c;
+        bool cur_in = cur_side <= 0.0f;
+        bool nxt_in = nxt_side <= 0.0f;
+
+        if (cur_in)
+        {
+            out.vertices[out.size] = cur;
+            out.labels[out.size++] = in.labels[i];
+        }
+
+        if (cur_in != nxt_in)
+        {
+            float t = cur_side/(cur_side - nxt_side);
+            Vec2 x = {cur.x + t*(nxt.x-cur.x), cur.y + t*(nxt.y-cur.y)};
+            out.vertices[out.size] = x;
+            // leaving: the clip line follows, entering: the rest of the original edge follows
+            out.labels[out.size++] = cur_in ? label : in.labels[i];
+        }
+    }
+}
+
+struct TangentFrame
+{
+    vmath::Vector3 origin;
+    vmath::Vector3 t1;
+    vmath::Vector3 t2;
+    vmath::Vector3 normal;
+    float sphereRadius; // > 0 for stereographic projection on a sphere centered in the origin
+};
+
+TangentFrame tangentFrame(const vmath::Vector3 &point, const AltPlanet::Shape::BaseShape &planet_shape, bool sphere)
+{
+    TangentFrame frame;
+    frame.origin = point;
+    frame.normal = vmath::normalize(planet_shape.getGradDir(point));
+
+    // pick the axis least aligned with the normal to build the tangent basis
+    vmath::Vector3 axis(1.0f, 0.0f, 0.0f);
+    float nx = std::abs(frame.normal[0]), ny = std::abs(frame.normal[1]), nz = std::abs(frame.normal[2]);
+    if (ny <= nx && ny <= nz) axis = vmath::Vector3(0.0f, 1.0f, 0.0f);
+    else if (nz <= nx && nz <= ny) axis = vmath::Vector3(0.0f, 0.0f, 1.0f);
+
+    frame.t1 = vmath::normalize(vmath::cross(axis, frame.normal));
+    frame.t2 = vmath::cross(frame.normal, frame.t1); // (t1, t2, normal) is right handed
+    frame.sphereRadius = sphere ? vmath::length(point) : 0.0f;
+    return frame;
+}
+
+inline Vec2 project(const TangentFrame &frame, const vmath::Vector3 &point)
+{
+    if (frame.sphereRadius > 0.0f)
+    {
+        // stereographic projection from the antipode onto the tangent plane
+        float R = frame.sphereRadius;
+        float s = 2.0f*R/(R + vmath::dot(point, frame.normal));
+        return {s*vmath::dot(point, frame.t1), s*vmath::dot(point, frame.t2)};
+    }
+    vmath::Vector3 diff = point - frame.origin;
+    return {vmath::dot(diff, frame.t1), vmath::dot(diff, frame.t2)};
+}
+
+// Delaunay star of point i_p: neighbour indices in counter clockwise order, -1 where
+// the Voronoi cell is open, appended to star. Returns the star length.
+int delaunayStar(int i_p, const std::vector<vmath::Vector3> &points, const SpaceHash3D &spacehash,
+                 const AltPlanet::Shape::BaseShape &planet_shape, bool sphere,
+                 std::vector<SpaceHash3D::Neighbor> &neighbors, std::vector<int> &star)
+{
+    TangentFrame frame = tangentFrame(points[i_p], planet_shape, sphere);
+
+    LabelledPolygon polys[2];
+    int n_neighbors = START_NEIGHBORS;
+    int final_poly = 0;
+    while (true)
+    {
+        int n_found = spacehash.kNearest(points[i_p], n_neighbors, &neighbors[0],
+                                         std::numeric_limits<float>::max(), i_p);
+        if (n_found == 0) return 0;
+
+        // start from a box well outside any bisector
+        float far_dist = std::sqrt(neighbors[n_found-1].distSqr);
+        float box = sphere ? 4.0f*far_dist : 2.0f*far_dist;
+        polys[0].size = 4;
+        polys[0].vertices[0] = {-box, -box};
+        polys[0].vertices[1] = { box, -box};
+        polys[0].vertices[2] = { box,  box};
+        polys[0].vertices[3] = {-box,  box};
+        polys[0].labels.fill(-1);
+
+        int cur = 0;
+        for (int n = 0; n<n_found; n++)
+        {
+            // off the sphere the 3D bisector is cut with the tangent plane (tangential Delaunay),
+            // which agrees between neighbouring stars far better than projecting the points
+            Vec2 d = project(frame, points[neighbors[n].index]);
+            float c = sphere ? 0.5f*dot2(d, d) : 0.5f*neighbors[n].distSqr;
+            if (c <= 0.0f) continue;
+            clipPolygon(polys[cur], polys[1-cur], d, c, neighbors[n].index);
+            cur = 1-cur;
+        }
+        final_poly = cur;
+
+        // the cell is final if no neighbour further away than the ones used can cut it,
+        // a bisector of a point at distance r only cuts the cell beyond r/2
+        float max_vertex_sqr = 0.0f;
+        for (int v = 0; v<polys[cur].size; v++)
+            max_vertex_sqr = std::max(max_vertex_sqr, dot2(polys[cur].vertices[v], polys[cur].vertices[v]));
+
+        bool all_points_used = n_found < n_neighbors;
+        if (all_points_used || 4.0f*max_vertex_sqr <= neighbors[n_found-1].distSqr || n_neighbors >= MAX_NEIGHBORS) break;
+        n_neighbors = std::min(2*n_neighbors, MAX_NEIGHBORS);
+    }
+
+    // one star entry per cell edge, the cell has at most 4+MAX_NEIGHBORS edges
+    const LabelledPolygon &cell = polys[final_poly];
+    size_t star_begin = star.size();
+    for (int e = 0; e<cell.size; e++)
+    {
+        // skip repeated labels from near degenerate (zero length) edges
+        if (star.size() > star_begin && star.back() == cell.labels[e]) continue;
+        star.push_back(cell.labels[e]);
+    }
+    if (star.size() > star_begin+1 && star.back() == star[star_begin]) star.pop_back();
+
+    return int(star.size() - star_begin);
+}
+
+// rotate a triangle so that its smallest index comes first, keeping the orientation
+inline gfx::Triangle rotateToMin(int a, int b, int c)
+{
+    if (a < b && a < c) return {a, b, c};
+    if (b < a && b < c) return {b, c, a};
+    return {c, a, b};
+}
+
+inline uint64_t directedEdgeKey(int from, int to)
+{
+    return (static_cast<uint64_t>(static_cast<uint32_t>(from)) << 32) | static_cast<uint32_t>(to);
+}
+
+inline float cross2(const Vec2 &a, const Vec2 &b) { return a.x*b.y - a.y*b.x; }
+inline Vec2 sub2(const Vec2 &a, const Vec2 &b) { return {a.x-b.x, a.y-b.y}; }
+
+// Keep only the largest fan of triangles around every point and remove the others, so each
+// point ends up with one fan, closed or open. Removing a triangle can split the fans of its
+// other corners, so this repeats until nothing changes. Returns the number of triangles removed.
+int removeExtraFans(int n_points, std::vector<gfx::Triangle> &triangles)
+{
+    int n_removed = 0;
+    std::vector<int> fan;
+    std::vector<int> fan_sizes;
+    std::vector<int> stack;
+    while (true)
+    {
+        gfx::MeshTopology topology(n_points, triangles);
+        std::vector<char> removed(triangles.size(), 0);
+
+        for (int i_p = 0; i_p<n_points; i_p++)
+        {
+            gfx::IndexLists::Range around = topology.pointTriangles()[i_p];
+            if (around.size() < 2) continue;
+
+            // two triangles around i_p are in the same fan if they share an edge at i_p
+            auto share_edge = [&](int i_t0, int i_t1)
+            {
+                int n_shared = 0;
+                for (int j0 = 0; j0<3; j0++)
+                    for (int j1 = 0; j1<3; j1++) n_shared += triangles[i_t0][j0] == triangles[i_t1][j1];
+                return n_shared >= 2;
+            };
+
+            fan.assign(around.size(), -1);
+            fan_sizes.clear();
+            for (int t = 0; t<around.size(); t++)
+            {
+                if (fan[t] >= 0) continue;
+                fan[t] = fan_sizes.size();
+                fan_sizes.push_back(0);
+                stack.assign(1, t);
+                while (!stack.empty())
+                {
+                    int u = stack.back();
+                    stack.pop_back();
+                    fan_sizes.back()++;
+                    for (int w = 0; w<around.size(); w++)
+                    {
+                        if (fan[w] < 0 && share_edge(around[u], around[w])) { fan[w] = fan[t]; stack.push_back(w); }
+                    }
+                }
+            }
+            if (fan_sizes.size() < 2) continue;
+
+            int keep = std::max_element(fan_sizes.begin(), fan_sizes.end()) - fan_sizes.begin();
+            for (int t = 0; t<around.size(); t++) if (fan[t] != keep) removed[around[t]] = 1;
+        }
+
+        int n_kept = 0;
+        for (int i_t = 0; i_t<triangles.size(); i_t++) if (!removed[i_t]) triangles[n_kept++] = triangles[i_t];
+        if (n_kept == int(triangles.size())) break;
+
+        n_removed += triangles.size() - n_kept;
+        triangles.resize(n_kept);
+    }
+    return n_removed;
+}
+
+// Close every boundary loop by ear clipping in the tangent plane at the loop centre. The best
+// shaped convex ear that does not contain other loop points goes first, ears whose new edge is
+// already in the mesh are never taken. Returns the number of triangles added.
+int fillHoles(const std::vector<vmath::Vector3> &points, const AltPlanet::Shape::BaseShape &planet_shape,
+              std::vector<gfx::Triangle> &triangles)
+{
+    std::unordered_set<uint64_t> used_edges;
+    used_edges.reserve(3*triangles.size());
+    for (const auto &tri : triangles)
+        for (int j = 0; j<3; j++) used_edges.insert(directedEdgeKey(tri[j], tri[(j+1)%3]));
+
+    auto has_edge = [&](int a, int b) {return used_edges.count(directedEdgeKey(a, b)) || used_edges.count(directedEdgeKey(b, a));};
+
+    // a hole runs against the boundary edges of the triangles around it. With one fan per
+    // point every boundary point has exactly one next point.
+    std::unordered_map<int, int> hole_next;
+    std::vector<int> hole_points;
+    for (const auto &tri : triangles)
+    {
+        for (int j = 0; j<3; j++)
+        {
+            int from = tri[(j+1)%3], to = tri[j];
+            if (used_edges.count(directedEdgeKey(from, to))) continue;
+            hole_next[from] = to;
+            hole_points.push_back(from);
+        }
+    }
+    std::sort(hole_points.begin(), hole_points.end()); // independent of the hash order
+
+    int n_added = 0;
+    int n_open = 0;
+    std::unordered_set<int> visited;
+    std::vector<int> loop;
+    std::vector<Vec2> loop_2d;
+    for (int start : hole_points)
+    {
+        if (visited.count(start)) continue;
+
+        loop.clear();
+        for (int i_p = start; !visited.count(i_p); i_p = hole_next[i_p])
+        {
+            visited.insert(i_p);
+            loop.push_back(i_p);
+        }
+        if (loop.size() < 3) { n_open++; continue; }
+
+        vmath::Vector3 centre(0.0f, 0.0f, 0.0f);
+        for (int i_p : loop) centre += points[i_p];
+        TangentFrame frame = tangentFrame(centre/float(loop.size()), planet_shape, false);
+
+        loop_2d.clear();
+        for (int i_p : loop) loop_2d.push_back(project(frame, points[i_p]));
+
+        while (loop.size() > 3)
+        {
+            int n = loop.size();
+            int best = -1;
+            float best_quality = 0.0f;
+            for (int i = 0; i<n; i++)
+            {
+                int prev = (i+n-1)%n, next = (i+1)%n;
+                const Vec2 &a = loop_2d[prev], &b = loop_2d[i], &c = loop_2d[next];
+                float area = cross2(sub2(b, a), sub2(c, a));
+                if (area <= 0.0f || has_edge(loop[prev], loop[next])) continue;
+
+                bool empty = true;
+                for (int k = 0; k<n && empty; k++)
+                {
+                    if (k == prev || k == i || k == next) continue;
+                    const Vec2 &q = loop_2d[k];
+                    empty = cross2(sub2(b, a), sub2(q, a)) < 0.0f || cross2(sub2(c, b), sub2(q, b)) < 0.0f ||
+                            cross2(sub2(a, c), sub2(q, c)) < 0.0f;
+                }
+                if (!empty) continue;
+
+                // largest for an equilateral triangle
+                float quality = area/(dot2(sub2(b, a), sub2(b, a)) + dot2(sub2(c, b), sub2(c, b)) + dot2(sub2(a, c), sub2(a, c)));
+                if (quality > best_quality) { best_quality = quality; best = i; }
+            }
+            if (best < 0) break;
+
+            int prev = loop[(best+n-1)%n], next = loop[(best+1)%n];
+            triangles.push_back({prev, loop[best], next});
+            used_edges.insert(directedEdgeKey(prev, loop[best]));
+            used_edges.insert(directedEdgeKey(loop[best], next));
+            used_edges.insert(directedEdgeKey(next, prev));
+            loop.erase(loop.begin()+best);
+            loop_2d.erase(loop_2d.begin()+best);
+            n_added++;
+        }
+
+        if (loop.size() == 3)
+        {
+            triangles.push_back({loop[0], loop[1], loop[2]});
+            for (int j = 0; j<3; j++) used_edges.insert(directedEdgeKey(loop[j], loop[(j+1)%3]));
+            n_added++;
+        }
+        else n_open++;
+    }
+
+    if (n_open > 0) std::cout << "surface delaunay: " << n_open << " holes could not be closed" << std::endl;
+    return n_added;
+}
+
+} // anonymous namespace
+
+std::vector<gfx::Triangle> surfaceDelaunay(const std::vector<vmath::Vector3> &points,
+                                           const SpaceHash3D &spacehash,
+                                           const AltPlanet::Shape::BaseShape &planet_shape)
+{
+    int n_points = points.size();
+    bool sphere = dynamic_cast<const AltPlanet::Shape::Sphere*>(&planet_shape) != nullptr;
+
+    // find the star of every point. Each chunk appends the stars of its points to its own
+    // buffer, which is the range of its points in the flat star array.
+    std::vector<int> star_sizes(n_points);
+    std::vector<std::pair<int, std::vector<int>>> chunk_stars;
+    std::mutex chunk_mutex;
+
+    Threads::parallelFor(0, n_points, [&](int i_begin, int i_end)
+    {
+        std::vector<SpaceHash3D::Neighbor> neighbors(MAX_NEIGHBORS);
+        std::vector<int> chunk;
+        for (int i_p = i_begin; i_p<i_end; i_p++)
+        {
+            star_sizes[i_p] = delaunayStar(i_p, points, spacehash, planet_shape, sphere, neighbors, chunk);
+        }
+
+        std::lock_guard<std::mutex> lock(chunk_mutex);
+        chunk_stars.push_back({i_begin, std::move(chunk)});
+    });
+
+    std::vector<int> star_offsets(n_points+1, 0);
+    for (int i_p = 0; i_p<n_points; i_p++) star_offsets[i_p+1] = star_offsets[i_p] + star_sizes[i_p];
+
+    std::vector<int> stars(star_offsets[n_points]);
+    for (const auto &chunk : chunk_stars) std::copy(chunk.second.begin(), chunk.second.end(), stars.begin() + star_offsets[chunk.first]);
+    chunk_stars.clear();
+
+    // every triangle of a star is a vote, a consistent triangle gets one vote per corner.
+    // The votes of a point go to its own range of the candidates, so they are written in
+    // parallel and the radix sort makes the order independent of the threads.
+    auto is_vote = [&](int i_p, int e)
+    {
+        const int *star = &stars[star_offsets[i_p]];
+        int a = star[e];
+        int b = star[(e+1)%star_sizes[i_p]];
+        return star_sizes[i_p] >= 2 && a >= 0 && b >= 0 && a != b;
+    };
+
+    std::vector<int> vote_offsets(n_points+1, 0);
+    Threads::parallelFor(0, n_points, [&](int i_begin, int i_end)
+    {
+        for (int i_p = i_begin; i_p<i_end; i_p++)
+        {
+            for (int e = 0; e<star_sizes[i_p]; e++) vote_offsets[i_p+1] += is_vote(i_p, e);
+        }
+    });
+    for (int i_p = 0; i_p<n_points; i_p++) vote_offsets[i_p+1] += vote_offsets[i_p];
+
+    std::vector<gfx::Triangle> candidates(vote_offsets[n_points]);
+    Threads::parallelFor(0, n_points, [&](int i_begin, int i_end)
+    {
+        for (int i_p = i_begin; i_p<i_end; i_p++)
+        {
+            const int *star = &stars[star_offsets[i_p]];
+            int i_out = vote_offsets[i_p];
+            for (int e = 0; e<star_sizes[i_p]; e++)
+            {
+                if (is_vote(i_p, e)) candidates[i_out++] = rotateToMin(i_p, star[e], star[(e+1)%star_sizes[i_p]]);
+            }
+        }
+    });
+
+    radixSortTriangles(candidates, n_points);
+
+    std::vector<gfx::Triangle> voted[3]; // [0]: three votes, [1]: two votes, [2]: one vote
+    for (int r = 0; r<candidates.size();)
+    {
+        int run_end = r+1;
+        while (run_end<candidates.size() && candidates[run_end] == candidates[r]) run_end++;
+        int votes = run_end - r;
+        if (votes >= 3) voted[0].push_back(candidates[r]);
+        else if (votes == 2) voted[1].push_back(candidates[r]);
+        else voted[2].push_back(candidates[r]);
+        r = run_end;
+    }
+
+    // stitch: in an oriented manifold every directed edge is used by exactly one triangle
+    std::vector<gfx::Triangle> triangles;
+    triangles.reserve(voted[0].size() + voted[1].size());
+    std::unordered_set<uint64_t> used_edges;
+    used_edges.reserve(3*(voted[0].size() + voted[1].size()));
+
+    int n_rejected = 0;
+    int n_filled = 0;
+    for (int tier = 0; tier<3; tier++)
+    {
+        for (const auto &tri : voted[tier])
+        {
+            bool free = true;
+            int n_bordering = 0;
+            for (int j = 0; j<3 && free; j++)
+            {
+                free = used_edges.find(directedEdgeKey(tri[j], tri[(j+1)%3])) == used_edges.end();
+                n_bordering += used_edges.count(directedEdgeKey(tri[(j+1)%3], tri[j]));
+            }
+
+            if (tier < 2 && !free) { n_rejected++; continue; }
+            // triangles in a single star only fill holes that are bordered on two sides
+            if (tier == 2 && (!free || n_bordering < 2)) continue;
+            if (tier == 2) n_filled++;
+
+            for (int j = 0; j<3; j++) used_edges.insert(directedEdgeKey(tri[j], tri[(j+1)%3]));
+            triangles.push_back(tri);
+        }
+    }
+
+    // the stitching can leave a point with more than one fan of triangles around it and
+    // holes where the stars disagree, repair both so the mesh is a closed manifold
+    int n_unpinched = removeExtraFans(n_points, triangles);
+    n_filled += fillHoles(points, planet_shape, triangles);
+
+    std::cout << "surface delaunay: " << voted[0].size() << " consistent, " << voted[1].size()
+              << " partially consistent, " << n_rejected << " rejected, " << n_unpinched << " removed at pinched points, "
+              << n_filled << " hole filling triangles" << std::endl;
+
+    return triangles;
+}
+
+} // namespace Triangulate
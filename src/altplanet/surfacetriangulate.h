@@ -0,0 +1,64 @@
+#ifndef SURFACETRIANGULATE_H
+#define SURFACETRIANGULATE_H
+
+#include <algorithm>
+#include <vector>
+
+#include "../common/gfx_primitives.h"
+#include "planetshapes.h"
+#include "spacehash3d.h"
+
+namespace Triangulate
+{
+
+// sort triangles lexicographically on their indices, all indices must be in [0, n_points).
+// LSD radix sort with 11 bit digits, least significant index first, so the passes for
+// each index only cover the bits actually used by n_points
+inline void radixSortTriangles(std::vector<gfx::Triangle> &tris, int n_points)
+{
+    const int DIGIT_BITS = 11;
+    const int N_BUCKETS = 1 << DIGIT_BITS;
+
+    int index_bits = 1;
+    while (index_bits < 31 && (1 << index_bits) < n_points) index_bits++;
+
+    std::vector<gfx::Triangle> buffer(tris.size());
+    std::vector<int> bucket_start(N_BUCKETS);
+
+    for (int j = 2; j>=0; j--)
+    {
+        for (int shift = 0; shift<index_bits; shift += DIGIT_BITS)
+        {
+            std::fill(bucket_start.begin(), bucket_start.end(), 0);
+            for (const auto &tri : tris) bucket_start[(tri[j] >> shift) & (N_BUCKETS-1)]++;
+
+            int sum = 0;
+            for (auto &b : bucket_start) { int count = b; b = sum; sum += count; }
+
+            for (const auto &tri : tris) buffer[bucket_start[(tri[j] >> shift) & (N_BUCKETS-1)]++] = tri;
+            tris.swap(buffer);
+        }
+    }
+}
+
+/**
+ * @brief surfaceDelaunay: Delaunay triangulation of points lying on a planet shape surface.
+ *          For every point the Delaunay star (the ring of Delaunay neighbours) is found by
+ *          clipping its Voronoi cell among its nearest neighbours with the tangent plane.
+ *          For a Shape::Sphere the stereographic projection from the antipode is used,
+ *          which maps empty circumcircles on the sphere to empty circles in the plane, so the
+ *          stars agree with the convex hull. The stars are then stitched: a triangle is kept if
+ *          it is in the stars of at least two of its corners and does not make an edge
+ *          non-manifold, and holes bordered on two sides are filled from single stars. Points
+ *          left with more than one fan keep only their largest, and the remaining holes of any
+ *          length are closed by ear clipping in their tangent plane. Cost is linear in the
+ *          number of points.
+ * @return: Triangles of a closed manifold, oriented counter clockwise seen from outside the shape
+ */
+std::vector<gfx::Triangle> surfaceDelaunay(const std::vector<vmath::Vector3> &points,
+                                           const SpaceHash3D &spacehash,
+                                           const AltPlanet::Shape::BaseShape &planet_shape);
+
+} // namespace Triangulate
+
+#endif // SURFACETRIANGULATE_H
@@ -1,7 +1,9 @@
 #include "watersystem.h"
 #include "../common/graph_tools.h"
 #include "../common/macro/macrodebugassert.h"
-#include <functional>
+#include "../common/procedural/counterrng.h"
+#include "../common/unionfind.h"
+#include <algorithm>
 
 using namespace gfx;
 typedef vmath::Vector3 Vector3; // Why not "using vmath::Vector3 as Vector 3", or something obvious?
@@ -21,9 +23,11 @@ namespace AltPlanet
 {
 
 WaterSystem::WaterGeometry WaterSystem::generateWaterSystem(const AltPlanet::PlanetGeometry &planet_geometry,
+                                                            const gfx::MeshTopology &topology,
                                                             const Shape::BaseShape &planet_shape,
                                                             float ocean_fraction,
-                                                            int num_river_springs)
+                                                            int num_river_springs,
+                                                            unsigned int seed)
 {
     // Deconstruct input
     const vector<Vector3> &points = planet_geometry.points;
@@ -35,22 +39,29 @@ WaterSystem::WaterGeometry WaterSystem::generateWaterSystem(const AltPlanet::Pla
     WaterSystem::WaterGeometry::Freshwater &freshwater = water_geometry.freshwater;
 
 
-    // generate adjacency
+    // adjacency of the planet mesh
     // TODO: Fix lack of typesafety for these point and triangle indices
-    // TODO: Dislodge the dependency on "topology" source files
-    vector<vector<int>> point_to_point_adjacency = Adjacancy::createAdjacencyList(points, triangles);
-    vector<vector<int>> point_tri_adjacency = Adjacancy::createPointToTriAdjacency(points, triangles);
+    const IndexLists &point_to_point_adjacency = topology.pointPoints();
+    const IndexLists &point_tri_adjacency = topology.pointTriangles();
+
+    // heights and surface normals, from the geometry if it has them
+    SurfaceFrames computed_surface;
+    if (!planet_geometry.surface.covers(points)) computed_surface = computeSurfaceFrames(points, planet_shape);
+    const SurfaceFrames &surface = computed_surface.empty() ? planet_geometry.surface : computed_surface;
+
+    // one flood over the planet, the ocean, lakes and rivers all follow from it
+    water_geometry.drainage = computeDrainage(point_to_point_adjacency, surface.heights);
 
     // generate ocean
     WaterSystem::GenOceanResult ocean_result = generateOcean(planet_geometry.triangles, planet_geometry.points,
-                                                             point_tri_adjacency, point_to_point_adjacency, ocean_fraction,
-                                                             planet_shape);
+                                                             point_tri_adjacency, water_geometry.drainage, surface,
+                                                             ocean_fraction);
     // Woops copy
     ocean = ocean_result.ocean;
 
     // generate lakes and rivers
-    freshwater = generateFreshwater(&ocean_result.landWaterTypes, triangles, points, point_to_point_adjacency,
-                                    point_tri_adjacency, num_river_springs, planet_shape);
+    freshwater = generateFreshwater(&ocean_result.landWaterTypes, triangles, points, point_to_point_adjacency, point_tri_adjacency,
+                                    water_geometry.drainage, surface, num_river_springs, seed);
 
     // copy the landWaterTypes into return
     water_geometry.landWaterTypes = ocean_result.landWaterTypes;
@@ -59,16 +70,77 @@ WaterSystem::WaterGeometry WaterSystem::generateWaterSystem(const AltPlanet::Pla
 
 }
 
+WaterSystem::Drainage WaterSystem::computeDrainage(const IndexLists &point_to_point_adjacency,
+                                                   const vector<float> &heights)
+{
+    int n_points = heights.size();
+
+    Drainage drainage;
+    drainage.waterLevel.resize(n_points);
+    drainage.receiver.resize(n_points);
+
+    // priority flood: expand the lowest water level first, a point is reached at its own
+    // height or the level of the point it is reached from, whichever is higher
+    graphtools::search_workspace workspace;
+    workspace.begin(n_points);
+    auto flood_from = [&](int i_start)
+    {
+        drainage.waterLevel[i_start] = heights[i_start];
+        workspace.visit(i_start, -1, heights[i_start]);
+
+        while (!workspace.open_empty())
+        {
+            int i_p = workspace.expand_next();
+            for (int i_adj : point_to_point_adjacency[i_p])
+            {
+                if (workspace.visited(i_adj)) continue;
+
+                float level = std::max(heights[i_adj], drainage.waterLevel[i_p]);
+                drainage.waterLevel[i_adj] = level;
+                workspace.visit(i_adj, i_p, level);
+            }
+        }
+    };
+
+    // start at the lowest point, and again for every part of the mesh that is not connected
+    while (int(workspace.sequence().size()) < n_points)
+    {
+        int i_start = -1;
+        for (int i = 0; i<n_points; i++)
+        {
+            if (!workspace.visited(i) && (i_start == -1 || heights[i] < heights[i_start])) i_start = i;
+        }
+        flood_from(i_start);
+    }
+
+    drainage.floodOrder = workspace.sequence();
+    for (int i = 0; i<n_points; i++)
+    {
+        optional<int> parent = workspace.parent(i);
+        drainage.receiver[i] = parent.exists() ? parent.get() : -1;
+    }
+
+    // accumulate upstream first
+    drainage.accumulation.assign(n_points, 1.0f);
+    for (int i = n_points-1; i>=0; i--)
+    {
+        int i_p = drainage.floodOrder[i];
+        if (drainage.receiver[i_p] >= 0) drainage.accumulation[drainage.receiver[i_p]] += drainage.accumulation[i_p];
+    }
+
+    return drainage;
+}
+
 const float max_ocean_fraction = 0.95f;
 const float min_ocean_fraction = 0.00f;
 
 
 WaterSystem::GenOceanResult WaterSystem::generateOcean(const vector<Triangle> &triangles,
                                                 const vector<Vector3> &points,
-                                                const vector<vector<int>> &point_tri_adjacency,
-                                                const vector<vector<int>> &point_to_point_adjacency,
-                                                float ocean_fraction,
-                                                const Shape::BaseShape &planet_shape)
+                                                const IndexLists &point_tri_adjacency,
+                                                const Drainage &drainage,
+                                                const SurfaceFrames &surface,
+                                                float ocean_fraction)
 {
     WaterSystem::GenOceanResult result_out;
     vector<Vector3> &ocean_points = result_out.ocean.points;
@@ -84,59 +156,31 @@ WaterSystem::GenOceanResult WaterSystem::generateOcean(const vector<Triangle> &t
         std::cerr << "setting ocean fraction to " << ocean_fraction << std::endl;
     }
 
-    // find the deepest point on the planet as starting point
-    int start_point = -1;
-    float smallest_length = std::numeric_limits<float>::max();
-    for (int i = 0 ; i<points.size(); i++)
-    {
-        float length = planet_shape.getHeight(points[i]);
-        if (length < smallest_length) { start_point = i; smallest_length = length; }
-    }
-
-    // do a search to certain depth, TODO: change to % triangle cover
-    auto flow_graph = graphtools::make_graph(points, point_to_point_adjacency);
-
-    auto heuristic = [&](const int &i)
-    {
-        return planet_shape.getHeight(points[i]);
-    };
-
-    auto it = flow_graph.search(start_point, heuristic);
-
     // initialize the point_sea_water_types
     point_land_water_types = vector<LandWaterType>(points.size(), LandWaterType::Land);
 
-    // save the search sequence
-    vector<int> search_sequence;
-    search_sequence.push_back(it.get_index());
-
     // save list of triangle indices
     vector<tri_index> search_tris;
 
-    //float current_sea_level = length(points[it.get_index()]);
-    //while (current_sea_level < sealevel_radius && !it.search_end())
-
+    // the flood starts at the deepest point on the planet, the sea rises along the flood
+    // order until it covers the ocean fraction and the basin it is filling is full
     unsigned int num_ocean_points = 0;
     float current_sea_coverage = 0.f;
     float highest_ocean_lvl = 0.f;
     float latest_ocean_lvl = 0.f;
     int rising_global_sealevel = true;
-    while ((  current_sea_coverage < ocean_fraction || (!rising_global_sealevel) ) &&
-            !it.search_end())
+    for (int i = 0; i<drainage.floodOrder.size() &&
+                    (current_sea_coverage < ocean_fraction || (!rising_global_sealevel)); i++)
     {
-        ++it;
-
-        int this_index = it.get_index();
-        search_sequence.push_back(this_index);
+        int this_index = drainage.floodOrder[i];
 
         // set the land/water type
         point_land_water_types[this_index] = LandWaterType::Sea;
 
-        //current_sea_level = length(points[it.get_index()]);
         num_ocean_points++;
         current_sea_coverage = (float)(num_ocean_points)/(float)(points.size());
 
-        latest_ocean_lvl = planet_shape.getHeight(points[this_index]);
+        latest_ocean_lvl = surface.heights[this_index];
         if (latest_ocean_lvl > highest_ocean_lvl)
         {
             rising_global_sealevel = true;
@@ -176,8 +220,9 @@ WaterSystem::GenOceanResult WaterSystem::generateOcean(const vector<Triangle> &t
             // map the point index
             if (point_ocean_map[i_p_unmapped] == -1)
             {
+                // the ocean points are at sea level
                 point_ocean_map[i_p_unmapped] = ocean_points.size();
-                ocean_points.push_back(points[i_p_unmapped]);
+                ocean_points.push_back(surface.atHeight(i_p_unmapped, highest_ocean_lvl));
             }
 
             // change the triangle->point index from unmapped to mapped
@@ -185,189 +230,192 @@ WaterSystem::GenOceanResult WaterSystem::generateOcean(const vector<Triangle> &t
         }
     }
 
-    // normalise the ocean points length to sea level
-    for (int i = 0 ; i<ocean_points.size(); i++)
-    {
-        planet_shape.setHeight(ocean_points[i], highest_ocean_lvl);
-    }
-
     return result_out;
 }
 
-template<class T>
-void push_back_if_unique(vector<T> &v, const T &e)
-{
-    if (std::find(v.begin(), v.end(), e) == v.end()) v.push_back(e);
-}
-
-
 WaterSystem::WaterGeometry::Freshwater WaterSystem::generateFreshwater(vector<LandWaterType>  * const point_land_water_types,
                                                                        const vector<Triangle> &triangles,
                                                                        const vector<Vector3> &points,
-                                                                       const vector<vector<int>> &point_to_point_adjacency,
-                                                                       const vector<vector<int>> &point_tri_adjacency,
+                                                                       const IndexLists &point_to_point_adjacency,
+                                                                       const IndexLists &point_tri_adjacency,
+                                                                       const Drainage &drainage,
+                                                                       const SurfaceFrames &surface,
                                                                        const unsigned int n_springs,
-                                                                       const Shape::BaseShape &planet_shape)
+                                                                       unsigned int seed)
 {
+    Procedural::CounterRng rng(seed, Procedural::RngStage::RiverSprings);
+
     WaterGeometry::Freshwater freshwater;
     vector<Vector3> &lake_points = freshwater.lakes.points;
     vector<Triangle> &lake_triangles = freshwater.lakes.triangles;
+    vector<WaterGeometry::Freshwater::Lake> &lakes = freshwater.lakes.bodies;
+    vector<int> &point_lakes = freshwater.lakes.pointLakes;
     vector<gfx::Line> &river_lines = freshwater.rivers.lines;
 
+    int n_points = points.size();
+
+    // depressions the flood filled above the ground, away from the sea
+    auto is_lake = [&](point_index i_p)
+    {
+        return drainage.waterLevel[i_p] > surface.heights[i_p] && (*point_land_water_types)[i_p] != LandWaterType::Sea;
+    };
+
+    // every lake drains through the first point below it that is not in the lake, its outlet
+    vector<point_index> lake_outlet(n_points, -1);
+    for (point_index i_p : drainage.floodOrder)
+    {
+        point_index i_r = drainage.receiver[i_p];
+        if (is_lake(i_p) && i_r >= 0) lake_outlet[i_p] = is_lake(i_r) ? lake_outlet[i_r] : i_r;
+    }
+
+    // follow each spring downstream until it reaches the sea or an earlier river, so all
+    // springs together walk each point once at most
+    vector<char> river_visited(n_points, 0);
+    vector<char> outlet_has_lake(n_points, 0);
+
     for (int i_springs = 0; i_springs<n_springs; i_springs++)
     {
+        // spring i_springs draws candidates until it hits land
         point_index start_point;
+        unsigned int i_draw = 0;
         do
         {
-            start_point = rand() % points.size();
+            start_point = rng.below(i_springs, i_draw++, n_points);
         } while ((*point_land_water_types)[int(start_point)] != LandWaterType::Land);
         // The start_point should be guaranteed to be on land
 
-        auto flow_graph = graphtools::make_graph(points, point_to_point_adjacency);
-
-        auto heuristic = [&](const point_index &i)
+        point_index i_p = start_point;
+        while (!river_visited[i_p] && (*point_land_water_types)[i_p] != LandWaterType::Sea)
         {
-            return planet_shape.getHeight(points[int(i)]);
-        };
-
-        auto it = flow_graph.search(start_point, heuristic);
+            river_visited[i_p] = 1;
 
-        // save the search sequence
-        vector<point_index> search_sequence;
-        search_sequence.push_back(it.get_index());
-
-        // save the search result bi-directional graph
-        vector<optional<point_index>> search_parents(points.size());
-        vector<vector<point_index>> search_children(points.size());
-
-        while ((*point_land_water_types)[it.get_index()] == LandWaterType::Land && !it.search_end())
-        {
-            ++it;
-            point_index this_index = it.get_index();
+            // a river running into a depression fills it
+            if (is_lake(i_p)) outlet_has_lake[lake_outlet[i_p]] = 1;
+            else (*point_land_water_types)[i_p] = LandWaterType::River;
 
-            search_sequence.push_back(this_index);
+            point_index i_next = drainage.receiver[i_p];
+            if (i_next < 0) break;
 
-            optional<point_index> parent_index = it.get_parent_index();
-            search_parents[this_index] = parent_index;
-            if (parent_index.exists()) search_children[parent_index.get()].push_back(this_index);
+            // no river lines across lakes
+            if (!(is_lake(i_p) && is_lake(i_next))) river_lines.push_back(gfx::Line{i_p, i_next});
+            i_p = i_next;
         }
+    }
 
-        // reverse the search and set the height to water height
-        vector<optional<float>> water_height(points.size());
-
-        { // separate scope for safety
-
-            float highest_water_level = 0.0f;
+    // the filled points of the depressions the rivers run into are under water
+    auto is_flooded = [&](point_index i_p)
+    {
+        return is_lake(i_p) && outlet_has_lake[lake_outlet[i_p]];
+    };
 
-            for (auto rit = search_sequence.rbegin(); rit!=search_sequence.rend(); rit++)
+    // a lake is a connected set of flooded points at one water level
+    stdext::union_find lake_sets(n_points);
+    for (point_index i_p = 0; i_p<n_points; i_p++)
+    {
+        if (!is_flooded(i_p)) continue;
+        for (point_index i_adj : point_to_point_adjacency[i_p])
+        {
+            if (i_adj < i_p && is_flooded(i_adj) && drainage.waterLevel[i_adj] == drainage.waterLevel[i_p])
             {
-                point_index rev_search_index = *rit;
-
-                if (planet_shape.getHeight(points[rev_search_index]) > highest_water_level)
-                {
-                    highest_water_level = planet_shape.getHeight(points[rev_search_index]);
-                }
-
-                // set the highest water level
-                water_height[rev_search_index] = make_optional(highest_water_level);
+                lake_sets.unite(i_p, i_adj);
             }
         }
+    }
 
-        // all drainage system points should now have a water level
+    // number the lakes in the order of their lowest point index
+    point_lakes.assign(n_points, -1);
+    for (point_index i_p = 0; i_p<n_points; i_p++)
+    {
+        if (!is_flooded(i_p)) continue;
 
-        // store resulting triangles
-        vector<Triangle> this_lake_triangles;
+        point_index i_root = lake_sets.find(i_p);
+        if (point_lakes[i_root] == -1)
+        {
+            point_lakes[i_root] = lakes.size();
+            lakes.push_back({0, 0, 0, 0, drainage.waterLevel[i_p], lake_outlet[i_p]});
+        }
+        point_lakes[i_p] = point_lakes[i_root];
+    }
 
-        { // separate scope for safety
+    // every triangle around a flooded point goes to the highest lake among its corners
+    vector<int> triangle_lakes(triangles.size(), -1);
+    vector<int> lake_triangle_indices;
+    for (point_index i_p = 0; i_p<n_points; i_p++)
+    {
+        if (point_lakes[i_p] == -1) continue;
 
-            point_index for_search_index = start_point;
+        for (int i_t : point_tri_adjacency[i_p])
+        {
+            if (triangle_lakes[i_t] != -1) continue;
 
-            std::function<void (point_index)> do_for_children = [&] (point_index i_p)
+            int i_lake = -1;
+            for (int j = 0; j<3; j++)
             {
-                // assume water_height[i_p] exists!
-                if (water_height[i_p].get() > planet_shape.getHeight(points[i_p])) // if water height > terrain hight
+                int i_corner_lake = point_lakes[triangles[i_t][j]];
+                if (i_corner_lake != -1 && (i_lake == -1 || lakes[i_corner_lake].waterLevel > lakes[i_lake].waterLevel))
                 {
-                    // the point is a lake point
-                    (*point_land_water_types)[i_p] == LandWaterType::Lake;
-
-                    // iterate over all triangles adjacent to point
-                    for (const auto &adj_tri : point_tri_adjacency[i_p])
-                    {
-                        push_back_if_unique(this_lake_triangles, triangles[int(adj_tri)]);
-                    }
-
-                    // if the parent exists...
-                    if (search_parents[i_p].exists())
-                    {
-                        point_index prev = search_parents[i_p].get();
-                        // ...and is a river point...
-                        if (!(water_height[prev].get() > planet_shape.getHeight(points[prev])))
-                        {
-                            // ...add a river line as well!
-                            river_lines.push_back(gfx::Line{prev, i_p});
-                        }
-                    }
+                    i_lake = i_corner_lake;
                 }
-                else
-                {
-                    // the point is a river point
-                    (*point_land_water_types)[i_p] == LandWaterType::River;
-
-                    // if the point has a parent, make a river
-                    if (search_parents[i_p].exists())
-                    {
-                        river_lines.push_back(gfx::Line{search_parents[i_p].get(), i_p});
-                    }
-
-                }
-
-                for (const auto &i_c : search_children[i_p]) do_for_children(i_c);
-            };
-
-            do_for_children(for_search_index);
+            }
+            triangle_lakes[i_t] = i_lake;
+            lake_triangle_indices.push_back(i_t);
+            lakes[i_lake].numTriangles++;
         }
+    }
 
-        // remap the triangles/points to create a sparse point/triangle representation for just the lakes
-        vector<point_index> point_lake_map(points.size(), -1);
+    // sort the triangles by lake, keeping their order within a lake
+    int n_lake_triangles = 0;
+    for (auto &lake : lakes)
+    {
+        lake.firstTriangle = n_lake_triangles;
+        n_lake_triangles += lake.numTriangles;
+        lake.numTriangles = 0;
+    }
+    vector<int> sorted_lake_triangles(n_lake_triangles);
+    for (int i_t : lake_triangle_indices)
+    {
+        auto &lake = lakes[triangle_lakes[i_t]];
+        sorted_lake_triangles[lake.firstTriangle + lake.numTriangles++] = i_t;
+    }
 
-        for (int i = 0 ; i<this_lake_triangles.size(); i++)
+    // remap the triangles/points to create a sparse point/triangle representation for each lake,
+    // the points at the water level of their lake
+    lake_triangles.resize(n_lake_triangles);
+    vector<point_index> point_lake_map(n_points, -1);
+    for (auto &lake : lakes)
+    {
+        lake.firstPoint = lake_points.size();
+        for (int i = lake.firstTriangle; i<lake.firstTriangle+lake.numTriangles; i++)
         {
-            float lake_height = -1.0f;
+            const Triangle &triangle = triangles[sorted_lake_triangles[i]];
             for (int j = 0; j<3; j++)
             {
-                point_index i_p_unmapped = (this_lake_triangles)[i][j];
-                if (water_height[i_p_unmapped].exists()) lake_height = water_height[i_p_unmapped].get();
-            }
-            DEBUG_ASSERT(lake_height > 0.0f);
-
-            for (int j = 0; j<3; j++)
-            {
-                point_index i_p_unmapped = (this_lake_triangles)[i][j];
-                //float lake_height = water_height[i_p_unmapped].get();
-
-                // Not all points in a sea triangle are below sealevel, therefore extra check
-                if (planet_shape.getHeight(points[i_p_unmapped]) < lake_height)
-                {
-                    (*point_land_water_types)[i_p_unmapped] = LandWaterType::Lake;
-                }
+                point_index i_p_unmapped = triangle[j];
 
                 // map the point index
                 if (point_lake_map[i_p_unmapped] == -1)
                 {
                     point_lake_map[i_p_unmapped] = lake_points.size();
-
-                    //Vector3 lake_point = lake_height * normalize(points[i_p_unmapped]);
-                    Vector3 lake_point = points[i_p_unmapped];
-                    planet_shape.setHeight(lake_point, lake_height);
-                    lake_points.push_back(lake_point);
+                    lake_points.push_back(surface.atHeight(i_p_unmapped, lake.waterLevel));
                 }
 
                 // change the triangle->point index from unmapped to mapped
-                (this_lake_triangles)[i][j] = point_lake_map[i_p_unmapped];
+                lake_triangles[i][j] = point_lake_map[i_p_unmapped];
             }
         }
+        lake.numPoints = int(lake_points.size()) - lake.firstPoint;
+
+        // the next lake maps its own shore points
+        for (int i = lake.firstTriangle; i<lake.firstTriangle+lake.numTriangles; i++)
+        {
+            for (int j = 0; j<3; j++) point_lake_map[triangles[sorted_lake_triangles[i]][j]] = -1;
+        }
+    }
 
-        lake_triangles.insert(lake_triangles.end(), this_lake_triangles.begin(), this_lake_triangles.end());
+    // Not all points in a lake triangle are below the water, only the flooded ones are lake
+    for (point_index i_p = 0; i_p<n_points; i_p++)
+    {
+        if (point_lakes[i_p] != -1) (*point_land_water_types)[i_p] = LandWaterType::Lake;
     }
 
     return freshwater;
@@ -8,7 +8,7 @@
 #include "../common/typetag.h"
 #include "planetshapes.h"
 #include "planetgeometry.h"
-#include "adjacency.h"
+#include "../common/meshtopology.h"
 
 namespace AltPlanet
 {
@@ -27,6 +27,20 @@ class WaterSystem final // where is C#'s static class or private namespace when
 public:
 
 
+    /**
+     * @brief The Drainage struct: where water goes on the whole planet, from one priority
+     *          flood over the mesh starting at the lowest point. Points are filled in order of
+     *          their water level, so every depression fills up to the height where it spills
+     *          and each point drains to the neighbor it was reached from.
+     */
+    struct Drainage
+    {
+        std::vector<float> waterLevel;      // the height water stands at, above ground in depressions
+        std::vector<int> receiver;          // downstream neighbor, -1 where the flood started
+        std::vector<int> floodOrder;        // points in flood order, every receiver before the points draining to it
+        std::vector<float> accumulation;    // number of points draining through each point, itself included
+    };
+
     struct WaterGeometry
     {
         struct Ocean {
@@ -35,9 +49,22 @@ public:
         } ocean;
 
         struct Freshwater {
+            // one connected body of still water, its points and triangles are ranges of the
+            // lake points and triangles, the triangles only use the points of their own lake
+            struct Lake {
+                int firstPoint;
+                int numPoints;
+                int firstTriangle;
+                int numTriangles;
+                float waterLevel;
+                int outlet;         // planet point the lake spills through
+            };
+
             struct Lakes {
                 std::vector<vmath::Vector3> points;
                 std::vector<gfx::Triangle> triangles;
+                std::vector<Lake> bodies;
+                std::vector<int> pointLakes;    // lake of each planet point under water, -1 for the others
             } lakes;
             struct Rivers {
                 //std::vector<vmath::Vector3> points;
@@ -46,12 +73,16 @@ public:
         } freshwater;
 
         std::vector<LandWaterType>  landWaterTypes;
+
+        Drainage drainage;
     };
 
     static WaterGeometry generateWaterSystem(const AltPlanet::PlanetGeometry &planet_geometry,
+                                             const gfx::MeshTopology &topology,
                                              const Shape::BaseShape &planet_shape,
                                              float ocean_fraction,
-                                             int num_river_springs);
+                                             int num_river_springs,
+                                             unsigned int seed);
 
 
 private:
@@ -73,20 +104,25 @@ private:
         float seaLevel;
     };
 
+    static Drainage computeDrainage(const gfx::IndexLists &point_to_point_adjacency,
+                                    const std::vector<float> &heights);
+
     static GenOceanResult generateOcean(const std::vector<gfx::Triangle> &triangles,
                                         const std::vector<vmath::Vector3> &points,
-                                        const std::vector<std::vector<int>> &point_tri_adjacency,
-                                        const std::vector<std::vector<int>> &point_to_point_adjacency,
-                                        float ocean_fraction,
-                                        const Shape::BaseShape &planet_shape);
+                                        const gfx::IndexLists &point_tri_adjacency,
+                                        const Drainage &drainage,
+                                        const SurfaceFrames &surface,
+                                        float ocean_fraction);
 
     static WaterGeometry::Freshwater generateFreshwater(std::vector<LandWaterType>  * const point_land_water_types,
                                                         const std::vector<gfx::Triangle> &triangles,
                                                         const std::vector<vmath::Vector3> &points,
-                                                        const std::vector<std::vector<int>> &point_point_adjacency,
-                                                        const std::vector<std::vector<int>> &point_tri_adjacency,
+                                                        const gfx::IndexLists &point_to_point_adjacency,
+                                                        const gfx::IndexLists &point_tri_adjacency,
+                                                        const Drainage &drainage,
+                                                        const SurfaceFrames &surface,
                                                         const unsigned int n_springs,
-                                                        const Shape::BaseShape &planet_shape);
+                                                        unsigned int seed);
 
 };
 
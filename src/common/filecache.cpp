@@ -0,0 +1,172 @@
+#include "filecache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+namespace FileCache
+{
+
+namespace
+{
+
+const char *ENTRY_EXTENSION = ".entry";
+
+// Archive::Writer writes to filename.tmp<pid> and renames it into place
+const char *TEMPORARY_MARK = ".tmp";
+
+// a temporary file this old belongs to a write that was interrupted
+const time_t STALE_TEMPORARY_SECONDS = 600;
+
+// section holding the full key of an entry
+const uint32_t KEY_SECTION = Archive::tag("CKEY");
+
+bool endsWith(const std::string &str, const std::string &suffix)
+{
+    return str.size() >= suffix.size() && str.compare(str.size()-suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// create the directory and its parents if they do not exist
+bool makeDirectories(const std::string &path)
+{
+    for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos+1))
+    {
+        std::string dir = path.substr(0, pos);
+#ifdef _WIN32
+        if (!dir.empty() && _mkdir(dir.c_str()) != 0 && errno != EEXIST) return false;
+#else
+        if (!dir.empty() && mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) return false;
+#endif
+        if (pos == std::string::npos) return true;
+    }
+}
+
+// remove the temporary files of interrupted writes, they never become entries and would
+// otherwise stay in the directory without counting towards the size limit
+void removeStaleTemporaries(const std::string &path)
+{
+    DIR *dir = opendir(path.c_str());
+    if (!dir) return;
+
+    time_t now = time(nullptr);
+    while (dirent *dir_entry = readdir(dir))
+    {
+        std::string name = dir_entry->d_name;
+        size_t mark = name.rfind(TEMPORARY_MARK);
+        if (mark == std::string::npos || !endsWith(name.substr(0, mark), ENTRY_EXTENSION)) continue;
+
+        std::string filename = path + "/" + name;
+        struct stat file_stat;
+        if (stat(filename.c_str(), &file_stat) == 0 && now - file_stat.st_mtime > STALE_TEMPORARY_SECONDS)
+        {
+            std::cout << "removing interrupted cache write " << filename << std::endl;
+            unlink(filename.c_str());
+        }
+    }
+    closedir(dir);
+}
+
+} // anonymous namespace
+
+Directory::Directory(const std::string &path, uint64_t max_bytes) : mPath(path), mMaxBytes(max_bytes)
+{
+    // recent ones may still be written by another process
+    removeStaleTemporaries(mPath);
+}
+
+std::string Directory::entryFilename(const Serial::StreamType &key) const
+{
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)Archive::hashBytes(key.data(), key.size()));
+    return mPath + "/" + name + ENTRY_EXTENSION;
+}
+
+bool Directory::load(const Serial::StreamType &key, Archive::MappedFile &entry, bool verify) const
+{
+    std::string filename = entryFilename(key);
+    if (access(filename.c_str(), F_OK) != 0) return false;
+
+    bool valid = entry.open(filename);
+    if (valid)
+    {
+        Archive::ArrayView<uint8_t> stored_key = entry.view<uint8_t>(KEY_SECTION);
+        valid = stored_key.size() == key.size() && std::equal(key.begin(), key.end(), stored_key.begin());
+    }
+    valid = valid && (!verify || entry.verify());
+
+    if (!valid)
+    {
+        std::cout << "removing stale cache entry " << filename << std::endl;
+        entry.close();
+        unlink(filename.c_str());
+        return false;
+    }
+
+    // bump the modification time, eviction goes by least recently used
+    utime(filename.c_str(), nullptr);
+    return true;
+}
+
+bool Directory::store(const Serial::StreamType &key, Archive::Writer &writer)
+{
+    if (!makeDirectories(mPath)) return false;
+
+    std::string filename = entryFilename(key);
+    writer.add(KEY_SECTION, key);
+    if (!writer.write(filename)) return false;
+
+    evict(filename);
+    return true;
+}
+
+void Directory::evict(const std::string &keep_filename) const
+{
+    struct Entry
+    {
+        std::string filename;
+        uint64_t size;
+        time_t lastUsed;
+    };
+    std::vector<Entry> entries;
+    uint64_t total_size = 0;
+
+    DIR *dir = opendir(mPath.c_str());
+    if (!dir) return;
+    while (dirent *dir_entry = readdir(dir))
+    {
+        std::string filename = mPath + "/" + dir_entry->d_name;
+        struct stat file_stat;
+        if (!endsWith(filename, ENTRY_EXTENSION) || stat(filename.c_str(), &file_stat) != 0) continue;
+
+        entries.push_back({filename, uint64_t(file_stat.st_size), file_stat.st_mtime});
+        total_size += file_stat.st_size;
+    }
+    closedir(dir);
+
+    // oldest first
+    std::sort(entries.begin(), entries.end(), [](const Entry &e0, const Entry &e1)
+    {
+        return e0.lastUsed != e1.lastUsed ? e0.lastUsed < e1.lastUsed : e0.filename < e1.filename;
+    });
+
+    for (const auto &entry : entries)
+    {
+        if (total_size <= mMaxBytes) break;
+        if (entry.filename == keep_filename) continue;
+        if (unlink(entry.filename.c_str()) == 0) total_size -= entry.size;
+    }
+}
+
+}
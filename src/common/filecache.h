@@ -0,0 +1,53 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mappedarchive.h"
+#include "serialize.h"
+
+namespace FileCache
+{
+
+/**
+ * @brief The Directory class: content addressed cache of Archive files in a directory. An
+ *          entry is found through a hash of its key, and the full key is stored in the entry so
+ *          hash collisions and stale entries are detected. Entries are written to a temporary
+ *          file and renamed into place, so a reader never sees a half written entry. When the
+ *          total size goes above max_bytes the least recently used entries are evicted.
+ *          Temporary files left by interrupted writes are removed when the directory is opened.
+ */
+class Directory
+{
+public:
+    Directory(const std::string &path, uint64_t max_bytes);
+
+    /**
+     * @brief load: Map the entry for key.
+     * @param verify: Also check the section checksums, which reads the whole entry
+     * @return: true if a valid entry exists, its sections can then be read from entry.
+     *          Entries that do not match the key or fail the checksums are deleted.
+     */
+    bool load(const Serial::StreamType &key, Archive::MappedFile &entry, bool verify = true) const;
+
+    /**
+     * @brief store: Atomically write the sections in writer as the entry for key, then evict
+     *          old entries if needed. The key is added to writer as an extra section.
+     * @return: false if the entry could not be written, the cache is only an optimization
+     *          so callers can ignore this.
+     */
+    bool store(const Serial::StreamType &key, Archive::Writer &writer);
+
+private:
+    std::string mPath;
+    uint64_t mMaxBytes;
+
+    std::string entryFilename(const Serial::StreamType &key) const;
+    void evict(const std::string &keep_filename) const;
+};
+
+}
+
+#endif // FILECACHE_H
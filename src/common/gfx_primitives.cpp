@@ -1,4 +1,5 @@
 #include "gfx_primitives.h"
+#include "meshtopology.h"
 
 namespace gfx
 {
@@ -7,6 +8,14 @@ template<>
 void generateNormals<Triangle>(std::vector<vmath::Vector4> * const normals,
                      const std::vector<vmath::Vector4> &vertices,
                      const std::vector<Triangle> &triangles)
+{
+    generateNormals(normals, vertices, triangles, MeshTopology(vertices.size(), triangles));
+}
+
+void generateNormals(std::vector<vmath::Vector4> * const normals,
+                     const std::vector<vmath::Vector4> &vertices,
+                     const std::vector<Triangle> &triangles,
+                     const MeshTopology &topology)
 {
     std::cout << "generating triangle normals " << std::endl;
     if (normals->size() < vertices.size())
@@ -14,18 +23,6 @@ void generateNormals<Triangle>(std::vector<vmath::Vector4> * const normals,
         normals->resize(vertices.size());
     }
 
-    // create vertex to triangle adjacency
-    std::vector<std::vector<int>> vertices_triangles_adjacency(vertices.size());
-    for (int i = 0; i<triangles.size(); i++)
-    {
-        for (int j = 0; j<3; j++)
-        {
-            auto &tri_adj_list = vertices_triangles_adjacency[triangles[i][j]];
-            auto it = std::find(tri_adj_list.begin(), tri_adj_list.end(), i);
-            if (it==tri_adj_list.end()) tri_adj_list.push_back(i);
-        }
-    }
-
     // create per triangle normals
     std::vector<vmath::Vector3> triangle_normals(triangles.size());
     for (int i = 0; i<triangles.size(); i++)
@@ -40,13 +37,13 @@ void generateNormals<Triangle>(std::vector<vmath::Vector4> * const normals,
     }
 
     // vertex normal is average of surrounding triangle normals
+    const IndexLists &vertices_triangles_adjacency = topology.pointTriangles();
     for (int i = 0; i<vertices.size(); i++)
     {
-        auto &tri_adj_list = vertices_triangles_adjacency[i];
         auto n_tri_sum = vmath::Vector3(0.0f);
-        for (int j = 0; j<tri_adj_list.size(); j++)
+        for (int i_t : vertices_triangles_adjacency[i])
         {
-            n_tri_sum += triangle_normals[tri_adj_list[j]];
+            n_tri_sum += triangle_normals[i_t];
         }
         (*normals)[i] = vmath::Vector4(vmath::normalize(n_tri_sum), 0.0f);
     }
@@ -55,6 +52,14 @@ void generateNormals<Triangle>(std::vector<vmath::Vector4> * const normals,
 void generateNormals(std::vector<vmath::Vector3> * const normals,
                      const std::vector<vmath::Vector3> &vertices,
                      const std::vector<Triangle> &triangles)
+{
+    generateNormals(normals, vertices, triangles, MeshTopology(vertices.size(), triangles));
+}
+
+void generateNormals(std::vector<vmath::Vector3> * const normals,
+                     const std::vector<vmath::Vector3> &vertices,
+                     const std::vector<Triangle> &triangles,
+                     const MeshTopology &topology)
 {
     //std::cout << "generating triangle normals " << std::endl;
     if (normals->size() < vertices.size())
@@ -62,18 +67,6 @@ void generateNormals(std::vector<vmath::Vector3> * const normals,
         normals->resize(vertices.size());
     }
 
-    // create vertex to triangle adjacency
-    std::vector<std::vector<int>> vertices_triangles_adjacency(vertices.size());
-    for (int i = 0; i<triangles.size(); i++)
-    {
-        for (int j = 0; j<3; j++)
-        {
-            auto &tri_adj_list = vertices_triangles_adjacency[triangles[i][j]];
-            auto it = std::find(tri_adj_list.begin(), tri_adj_list.end(), i);
-            if (it==tri_adj_list.end()) tri_adj_list.push_back(i);
-        }
-    }
-
     // create per triangle normals
     std::vector<vmath::Vector3> triangle_normals(triangles.size());
     for (int i = 0; i<triangles.size(); i++)
@@ -88,13 +81,13 @@ void generateNormals(std::vector<vmath::Vector3> * const normals,
     }
 
     // vertex normal is average of surrounding triangle normals
+    const IndexLists &vertices_triangles_adjacency = topology.pointTriangles();
     for (int i = 0; i<vertices.size(); i++)
     {
-        auto &tri_adj_list = vertices_triangles_adjacency[i];
         auto n_tri_sum = vmath::Vector3(0.0f);
-        for (int j = 0; j<tri_adj_list.size(); j++)
+        for (int i_t : vertices_triangles_adjacency[i])
         {
-            n_tri_sum += triangle_normals[tri_adj_list[j]];
+            n_tri_sum += triangle_normals[i_t];
         }
         (*normals)[i] = vmath::normalize(n_tri_sum);
     }
@@ -9,6 +9,8 @@
 #include <iostream>
 #include <array>
 
+#include "serialize.h"
+
 namespace vmath = Vectormath::Aos;
 
 namespace gfx
@@ -62,6 +64,8 @@ namespace gfx
         int index;
     };
 
+    class MeshTopology;
+
     template<class PrimitiveType>
     void generateNormals(std::vector<vmath::Vector4> * const normal_data,
                          const std::vector<vmath::Vector4> &position_data,
@@ -89,9 +93,26 @@ namespace gfx
     void generateNormals(std::vector<vmath::Vector3> * const normals,
                          const std::vector<vmath::Vector3> &vertices,
                          const std::vector<Triangle> &triangles);
+
+    // as above, with the point to triangle adjacency taken from an existing topology of the mesh
+    void generateNormals(std::vector<vmath::Vector4> * const normals,
+                         const std::vector<vmath::Vector4> &vertices,
+                         const std::vector<Triangle> &triangles,
+                         const MeshTopology &topology);
+
+    void generateNormals(std::vector<vmath::Vector3> * const normals,
+                         const std::vector<vmath::Vector3> &vertices,
+                         const std::vector<Triangle> &triangles,
+                         const MeshTopology &topology);
 }
 
 
+namespace Serial
+{
+    // plain data, the copy constructor is only user defined for the SIMD register
+    template<> struct is_bitwise_serializable<vmath::Vector3> : std::true_type {};
+}
+
 namespace std
 {
     // inject triangle hash into std namespace
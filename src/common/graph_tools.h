@@ -1,144 +1,96 @@
 #ifndef GRAPH_TOOLS_H
 #define GRAPH_TOOLS_H
 
-#include <queue>
-#include <assert.h>
+#include <algorithm>
+#include <cstdint>
 #include <functional>
+#include <utility>
+#include <vector>
 #include "optional.h"
 #include "macro/macrodebugassert.h"
 
 namespace graphtools
 {
 
-template<class node_type, class index_type>
-class graph
+// the state of a best first search, kept between searches so repeated searches over the
+// same graph do not allocate. The per node arrays are stamped with the search they were
+// written in, so starting a search is O(1) and a search costs what it touches.
+class search_workspace
 {
 public:
-    graph(const std::vector<node_type> &_nodes,
-          const std::vector<std::vector<index_type>> &_adjacency) :
-        nodes(_nodes), adjacency(_adjacency) {} // makes copies of the lists
+    search_workspace() : epoch(0) {}
 
-    template<class heuristic_type>
-    struct compare_functor;
-
-    template<class heuristic_type>
-    class iterator
+    // starts a new search over a graph of n nodes
+    void begin(int n)
     {
-    public:
-        iterator(index_type _index, heuristic_type _heuristic,
-                 const std::vector<node_type> &_nodes, const std::vector<std::vector<index_type>> &_adjacency) :
-            index(_index), heuristic(_heuristic), nodes(_nodes), adjacency(_adjacency),
-            open_points_queue(compare_functor<heuristic_type>(_heuristic))
-        {
-            search_parents = std::vector<optional<index_type>>(_nodes.size());
-
-            // start;
-            visit(_index);
-            ++(*this);
-        }
-
-        float heuristic_eval()
+        if (int(stamps.size()) < n)
         {
-           if (open_points_queue.empty())
-           {
-               return std::numeric_limits<float>::max();
-           }
-           else
-           {
-               heuristic(index);
-           }
+            stamps.resize(n, 0);
+            parents.resize(n);
+            orders.resize(n);
         }
 
-        bool search_end() {return open_points_queue.empty();}
-
-        iterator& operator++()
+        if (++epoch == 0)
         {
-            DEBUG_ASSERT((!open_points_queue.empty()));
-
-            // actual increment takes place here
-//            if (!open_points_queue.empty())
-//            {
-                prev_sequence_index = make_optional(index);
-                index = open_points_queue.top();
-                open_points_queue.pop();
-
-                for (auto const &i_adj : adjacency[int(index)])
-                {
-                    if (!search_parents[int(i_adj)].exists())
-                    {
-                        visit(i_adj);
-                    }
-                }
-//            }
-            return *this;
+            // wrapped around, old stamps could look current
+            std::fill(stamps.begin(), stamps.end(), 0u);
+            epoch = 1;
         }
 
-        // Iterator copying is expensive, therefore avoided
-        // iterator& operator++(int)
-
-        const node_type& operator*() const { return nodes[int(index)]; }
-        const node_type* operator->() const { return &nodes[int(index)]; }
-
-        const index_type get_index() const { return index; }
-        const optional<index_type> get_prev_index() const{ return prev_sequence_index; }
-        const optional<index_type> get_parent_index() const{ return search_parents[index]; }
-        //TODO: distinguish between search parent-hierarchy and search order!!!
-
-    private:
-        std::priority_queue<index_type, std::vector<index_type>, compare_functor<heuristic_type>> open_points_queue;
-
-        heuristic_type heuristic;
-
-        index_type index;
+        open.clear();
+        expanded.clear();
+    }
 
-        const std::vector<node_type> &nodes;
-        const std::vector<std::vector<index_type>> &adjacency; // maps to nodes
+    // the node has been queued in this search
+    bool visited(int i) const {return stamps[i] == epoch;}
 
-        std::vector<optional<index_type>> search_parents; // maps to nodes
+    // the node that queued i, none for the start and nodes not visited
+    optional<int> parent(int i) const
+    {
+        return (visited(i) && parents[i] >= 0) ? make_optional(parents[i]) : optional<int>();
+    }
 
-        // next up
-        optional<index_type> prev_sequence_index;
-        //size_t distance;
+    // position of i in sequence(), -1 if it has not been expanded in this search
+    int order(int i) const {return visited(i) ? orders[i] : -1;}
 
-        void visit(index_type _index)
-        {
-            search_parents[int(_index)] = make_optional(index);
-            open_points_queue.push(_index);
-        }
-    };
+    // expanded nodes in search order, every parent comes before its children
+    const std::vector<int> &sequence() const {return expanded;}
 
-    // second order compare function created from the heuristic function
-    template<class heuristic_type>
-    struct compare_functor
+    // queues an unvisited node with its priority, lowest first
+    void visit(int i, int parent, float key)
     {
-        compare_functor(heuristic_type _heuristic) : heuristic(_heuristic) {}
-        bool operator()(index_type i1, index_type i2) {return heuristic(i1) > heuristic(i2);}
+        DEBUG_ASSERT(!visited(i));
+        stamps[i] = epoch;
+        parents[i] = parent;
+        orders[i] = -1;
+        open.push_back(std::make_pair(key, i));
+        std::push_heap(open.begin(), open.end(), std::greater<std::pair<float, int>>());
+    }
 
-    private:
-        heuristic_type heuristic;
-    };
+    bool open_empty() const {return open.empty();}
 
-    template<class heuristic_type>
-    iterator<heuristic_type> search(  index_type start_index,
-                                      heuristic_type heuristic)
+    // removes the lowest queued node, equal keys are taken by index
+    int expand_next()
     {
-
-        return iterator<heuristic_type>(start_index, heuristic,
-                                        nodes, adjacency);
+        DEBUG_ASSERT(!open.empty());
+        std::pop_heap(open.begin(), open.end(), std::greater<std::pair<float, int>>());
+        int i = open.back().second;
+        open.pop_back();
+
+        orders[i] = int(expanded.size());
+        expanded.push_back(i);
+        return i;
     }
 
-
 private:
-    const std::vector<node_type> nodes;
-    const std::vector<std::vector<index_type>> adjacency;
-};
+    uint32_t epoch;
+    std::vector<uint32_t> stamps;
+    std::vector<int> parents;
+    std::vector<int> orders;
 
-template<class node_type, class index_type>
-graph<node_type, index_type> make_graph(const std::vector<node_type> &_nodes,
-                                        const std::vector<std::vector<index_type>> &_adjacency)
-{
-    return graph<node_type, index_type>(_nodes, _adjacency);
-}
+    std::vector<std::pair<float, int>> open;
+    std::vector<int> expanded;
+};
 
 } // namespace graphtools
 
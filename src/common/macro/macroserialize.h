@@ -5,6 +5,7 @@
 
 #define SERIALIZE_MEMBER(MEMBER) serialize(obj.MEMBER, res);
 #define DESERIALIZE_MEMBER(MEMBER) obj.MEMBER = deserialize<decltype(obj.MEMBER)>(it, res.cend());
+#define READ_MEMBER(MEMBER) obj.MEMBER = deserialize<decltype(obj.MEMBER)>(in);
 
 /**
  * Serialization macro
@@ -31,6 +32,20 @@ inline CLASS deserialize<CLASS>(const StreamType &res)
     return obj;                                                                 \
 }                                                                               \
                                                                                 \
+template<>                                                                      \
+inline void serialize<CLASS>(const CLASS &obj, FileWriter &res)                 \
+{                                                                               \
+    FOR_EACH(SERIALIZE_MEMBER,__VA_ARGS__)                                      \
+}                                                                               \
+                                                                                \
+template<>                                                                      \
+inline CLASS deserialize<CLASS>(FileReader &in)                                 \
+{                                                                               \
+    CLASS obj;                                                                  \
+    FOR_EACH(READ_MEMBER,__VA_ARGS__)                                           \
+    return obj;                                                                 \
+}                                                                               \
+                                                                                \
 }
 
 
@@ -0,0 +1,290 @@
+#include "mappedarchive.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#include <process.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Archive
+{
+
+namespace
+{
+
+const char FILE_MAGIC[8] = {'D','R','A','R','C','H','I','V'};
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrderMark;
+    uint32_t nSections;
+    uint32_t reserved;
+    uint64_t fileSize;
+};
+
+inline uint64_t alignUp(uint64_t offset) {return (offset + SECTION_ALIGNMENT-1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;}
+
+bool hostIsLittleEndian()
+{
+    uint32_t one = 1;
+    uint8_t first_byte;
+    std::memcpy(&first_byte, &one, 1);
+    return first_byte == 1;
+}
+
+bool writeAll(int fd, const uint8_t *data, size_t size)
+{
+    while (size > 0)
+    {
+#ifdef _WIN32
+        int written = ::_write(fd, data, unsigned(std::min<size_t>(size, 1u<<30)));
+#else
+        ssize_t written = ::write(fd, data, size);
+#endif
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// the platform specific parts: writing the temporary file, replacing the target with it and
+// mapping a file read only
+#ifdef _WIN32
+
+int openForWrite(const std::string &filename) {return ::_open(filename.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);}
+bool syncAndClose(int fd) {bool synced = ::_commit(fd) == 0; return ::_close(fd) == 0 && synced;}
+int processId() {return ::_getpid();}
+
+// rename does not replace an existing file on windows
+bool replaceFile(const std::string &from, const std::string &to)
+{
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+
+const uint8_t *mapFile(const std::string &filename, size_t min_size, size_t &size)
+{
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || uint64_t(file_size.QuadPart) < min_size)
+    {
+        CloseHandle(file);
+        return nullptr;
+    }
+
+    // the view keeps the mapping and the file open
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) return nullptr;
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view) return nullptr;
+
+    size = size_t(file_size.QuadPart);
+    return static_cast<const uint8_t*>(view);
+}
+
+void unmapFile(const uint8_t *data, size_t) {UnmapViewOfFile(data);}
+
+#else
+
+int openForWrite(const std::string &filename) {return ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);}
+bool syncAndClose(int fd) {bool synced = fsync(fd) == 0; return ::close(fd) == 0 && synced;}
+int processId() {return getpid();}
+bool replaceFile(const std::string &from, const std::string &to) {return rename(from.c_str(), to.c_str()) == 0;}
+
+const uint8_t *mapFile(const std::string &filename, size_t min_size, size_t &size)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || size_t(file_stat.st_size) < min_size)
+    {
+        ::close(fd);
+        return nullptr;
+    }
+
+    void *mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file open
+    if (mapping == MAP_FAILED) return nullptr;
+
+    size = file_stat.st_size;
+    return static_cast<const uint8_t*>(mapping);
+}
+
+void unmapFile(const uint8_t *data, size_t size) {munmap(const_cast<uint8_t*>(data), size);}
+
+#endif
+
+} // anonymous namespace
+
+uint64_t hashBytes(const uint8_t *data, size_t size, uint64_t hash)
+{
+    for (size_t i = 0; i<size; i++)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+////////////
+// Writer //
+////////////
+
+void Writer::addBytes(uint32_t section_tag, uint32_t element_size, uint64_t count, const void *data)
+{
+    mSections.push_back({section_tag, element_size, count, static_cast<const uint8_t*>(data)});
+}
+
+bool Writer::write(const std::string &filename) const
+{
+    // the format is little-endian and sections are written as they are in memory
+    if (!hostIsLittleEndian()) return false;
+
+    uint64_t table_end = sizeof(FileHeader) + mSections.size()*sizeof(MappedFile::SectionEntry);
+
+    std::vector<MappedFile::SectionEntry> table(mSections.size());
+    uint64_t offset = alignUp(table_end);
+    for (size_t s = 0; s<mSections.size(); s++)
+    {
+        const Section &section = mSections[s];
+        uint64_t n_bytes = section.count*section.elementSize;
+        table[s] = {section.tag, section.elementSize, section.count, offset, hashBytes(section.data, n_bytes)};
+        offset = alignUp(offset + n_bytes);
+    }
+
+    FileHeader header;
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version = FORMAT_VERSION;
+    header.byteOrderMark = BYTE_ORDER_MARK;
+    header.nSections = mSections.size();
+    header.reserved = 0;
+    header.fileSize = offset;
+
+    std::string tmp_filename = filename + ".tmp" + std::to_string(processId());
+    int fd = openForWrite(tmp_filename);
+    if (fd < 0) return false;
+
+    static const uint8_t padding[SECTION_ALIGNMENT] = {};
+    bool written = writeAll(fd, reinterpret_cast<const uint8_t*>(&header), sizeof(header)) &&
+                   writeAll(fd, reinterpret_cast<const uint8_t*>(table.data()), table.size()*sizeof(table[0]));
+
+    uint64_t position = table_end;
+    for (size_t s = 0; s<mSections.size() && written; s++)
+    {
+        written = writeAll(fd, padding, table[s].offset - position);
+        uint64_t n_bytes = table[s].count*table[s].elementSize;
+        written = written && writeAll(fd, mSections[s].data, n_bytes);
+        position = table[s].offset + n_bytes;
+    }
+    written = written && writeAll(fd, padding, header.fileSize - position);
+    written = syncAndClose(fd) && written;
+
+    // the rename is atomic, readers see either the old file or the complete new one
+    if (!written || !replaceFile(tmp_filename, filename))
+    {
+        std::remove(tmp_filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+////////////////
+// MappedFile //
+////////////////
+
+MappedFile::MappedFile() : mData(nullptr), mSize(0), mSections(nullptr), mNSections(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string &filename)
+{
+    close();
+    if (!hostIsLittleEndian()) return false;
+
+    mData = mapFile(filename, sizeof(FileHeader), mSize);
+    if (!mData) return false;
+
+    // check the header and the section table before handing out any views
+    const FileHeader &header = *reinterpret_cast<const FileHeader*>(mData);
+    bool valid = std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0 &&
+                 header.version == FORMAT_VERSION &&
+                 header.byteOrderMark == BYTE_ORDER_MARK &&
+                 header.fileSize == mSize &&
+                 sizeof(FileHeader) + uint64_t(header.nSections)*sizeof(SectionEntry) <= mSize;
+
+    if (valid)
+    {
+        mSections = reinterpret_cast<const SectionEntry*>(mData + sizeof(FileHeader));
+        mNSections = header.nSections;
+        for (uint32_t s = 0; s<mNSections && valid; s++)
+        {
+            const SectionEntry &section = mSections[s];
+            valid = section.offset % SECTION_ALIGNMENT == 0 && section.offset <= mSize &&
+                    (section.elementSize == 0 || section.count <= (mSize - section.offset)/section.elementSize);
+        }
+    }
+
+    if (!valid) close();
+    return valid;
+}
+
+void MappedFile::close()
+{
+    if (mData) unmapFile(mData, mSize);
+    mData = nullptr;
+    mSize = 0;
+    mSections = nullptr;
+    mNSections = 0;
+}
+
+const MappedFile::SectionEntry *MappedFile::findSection(uint32_t section_tag) const
+{
+    for (uint32_t s = 0; s<mNSections; s++)
+    {
+        if (mSections[s].tag == section_tag) return &mSections[s];
+    }
+    return nullptr;
+}
+
+bool MappedFile::verify() const
+{
+    for (uint32_t s = 0; s<mNSections; s++)
+    {
+        const SectionEntry &section = mSections[s];
+        if (hashBytes(mData + section.offset, section.count*section.elementSize) != section.checksum) return false;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,156 @@
+#ifndef MAPPEDARCHIVE_H
+#define MAPPEDARCHIVE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Archive: binary container of flat arrays that can be memory mapped and read in place.
+ *
+ * Layout, all little-endian:
+ *   FileHeader                      magic, format version, byte order mark, section count, file size
+ *   SectionEntry[section count]     tag, element size, element count, offset, checksum
+ *   section data                    every section starts at a multiple of SECTION_ALIGNMENT
+ *
+ * A section is identified by a four character tag and stores count elements of
+ * element_size bytes, written as they are in memory. Only element types that can be copied
+ * with memcpy can be stored.
+ */
+namespace Archive
+{
+
+static const uint32_t FORMAT_VERSION = 1;
+static const uint64_t SECTION_ALIGNMENT = 64;
+
+// four character section tag, e.g. tag("PNTS")
+inline uint32_t tag(const char (&name)[5])
+{
+    return uint32_t(uint8_t(name[0])) | uint32_t(uint8_t(name[1])) << 8 |
+           uint32_t(uint8_t(name[2])) << 16 | uint32_t(uint8_t(name[3])) << 24;
+}
+
+// 64 bit FNV-1a
+uint64_t hashBytes(const uint8_t *data, size_t size, uint64_t hash = 0xcbf29ce484222325ull);
+
+// read only view of an array, for example of a section in a mapped file
+template<class T>
+class ArrayView
+{
+public:
+    typedef T value_type;
+
+    ArrayView() : mData(nullptr), mSize(0) {}
+    ArrayView(const T *data, size_t size) : mData(data), mSize(size) {}
+
+    const T *data() const {return mData;}
+    size_t size() const {return mSize;}
+    bool empty() const {return mSize == 0;}
+
+    const T &operator[](size_t i) const {return mData[i];}
+    const T *begin() const {return mData;}
+    const T *end() const {return mData+mSize;}
+
+    std::vector<T> toVector() const {return std::vector<T>(begin(), end());}
+
+private:
+    const T *mData;
+    size_t mSize;
+};
+
+/**
+ * @brief The Writer class: collects sections and writes them to a file. Sections refer to
+ *          the caller's data, which must stay alive until write() returns.
+ */
+class Writer
+{
+public:
+    template<class T>
+    void add(uint32_t section_tag, const std::vector<T> &data)
+    {
+        addBytes(section_tag, sizeof(T), data.size(), data.data());
+    }
+
+    void addBytes(uint32_t section_tag, uint32_t element_size, uint64_t count, const void *data);
+
+    // write to a temporary file and rename it into place, false on failure
+    bool write(const std::string &filename) const;
+
+private:
+    struct Section
+    {
+        uint32_t tag;
+        uint32_t elementSize;
+        uint64_t count;
+        const uint8_t *data;
+    };
+    std::vector<Section> mSections;
+};
+
+/**
+ * @brief The MappedFile class: an archive file mapped read only into memory. Sections are
+ *          returned as views into the mapping, so opening costs page faults on access rather
+ *          than a read and parse of the whole file. Views are valid until the file is closed.
+ */
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+
+    // map the file and check the header and section table, false if it is not a valid archive
+    bool open(const std::string &filename);
+    void close();
+    bool isOpen() const {return mData != nullptr;}
+
+    bool has(uint32_t section_tag) const {return findSection(section_tag) != nullptr;}
+
+    // the section exists and stores elements of T
+    template<class T>
+    bool hasArrayOf(uint32_t section_tag) const
+    {
+        const SectionEntry *section = findSection(section_tag);
+        return section && section->elementSize == sizeof(T);
+    }
+
+    // empty view if the section is missing or its element size does not match T
+    template<class T>
+    ArrayView<T> view(uint32_t section_tag) const
+    {
+        const SectionEntry *section = findSection(section_tag);
+        if (!section || section->elementSize != sizeof(T)) return ArrayView<T>();
+        return ArrayView<T>(reinterpret_cast<const T*>(mData + section->offset), section->count);
+    }
+
+    template<class T>
+    std::vector<T> copy(uint32_t section_tag) const {return view<T>(section_tag).toVector();}
+
+    // compare the checksums of all sections, this reads the whole file
+    bool verify() const;
+
+private:
+    struct SectionEntry
+    {
+        uint32_t tag;
+        uint32_t elementSize;
+        uint64_t count;
+        uint64_t offset;
+        uint64_t checksum;
+    };
+
+    const uint8_t *mData;
+    size_t mSize;
+    const SectionEntry *mSections;
+    uint32_t mNSections;
+
+    const SectionEntry *findSection(uint32_t section_tag) const;
+
+    friend class Writer;
+};
+
+}
+
+#endif // MAPPEDARCHIVE_H
@@ -12,11 +12,6 @@
 namespace MathExt
 {
 
-inline float frand(float LO, float HI)
-{
-    return LO + static_cast <float> (rand())/( static_cast <float> (RAND_MAX/(HI-LO)));
-}
-
 inline bool isnan_lame(float x)
 {
     return x != x;
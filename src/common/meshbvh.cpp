@@ -0,0 +1,531 @@
+#include "meshbvh.h"
+
+#include "macro/macrodebugassert.h"
+#include "threads/parallelfor.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace gfx
+{
+
+namespace
+{
+
+const int N_BINS = 16;
+const int MAX_LEAF_TRIANGLES = 8;
+const float TRAVERSAL_COST = 1.0f; // relative to one triangle test
+const int STACK_SIZE = 128;
+
+// stands in for 1/0 so that 0*inverse stays 0 in the slab tests
+const float LARGE_INVERSE = 1e30f;
+
+struct Bounds
+{
+    float min[3];
+    float max[3];
+
+    Bounds()
+    {
+        for (int a = 0; a<3; a++) {min[a] = std::numeric_limits<float>::max(); max[a] = -std::numeric_limits<float>::max();}
+    }
+
+    void grow(const float p[3])
+    {
+        for (int a = 0; a<3; a++) {min[a] = std::min(min[a], p[a]); max[a] = std::max(max[a], p[a]);}
+    }
+
+    void grow(const Bounds &other)
+    {
+        for (int a = 0; a<3; a++) {min[a] = std::min(min[a], other.min[a]); max[a] = std::max(max[a], other.max[a]);}
+    }
+
+    float halfArea() const
+    {
+        float d[3];
+        for (int a = 0; a<3; a++) d[a] = std::max(0.0f, max[a] - min[a]);
+        return d[0]*d[1] + d[1]*d[2] + d[2]*d[0];
+    }
+};
+
+struct BuildTriangle
+{
+    Bounds bounds;
+    float centroid[3];
+};
+
+class Builder
+{
+public:
+    Builder(const std::vector<BuildTriangle> &triangles, std::vector<int> &order, std::vector<MeshBvh::Node> &nodes) :
+        mTriangles(triangles), mOrder(order), mNodes(nodes) {}
+
+    // builds the subtree of order[begin, end) depth first, returns its root
+    int build(int begin, int end)
+    {
+        int i_node = mNodes.size();
+        mNodes.push_back(MeshBvh::Node());
+
+        Bounds bounds, centroid_bounds;
+        for (int i = begin; i<end; i++)
+        {
+            bounds.grow(mTriangles[mOrder[i]].bounds);
+            centroid_bounds.grow(mTriangles[mOrder[i]].centroid);
+        }
+        for (int a = 0; a<3; a++)
+        {
+            mNodes[i_node].boundsMin[a] = bounds.min[a];
+            mNodes[i_node].boundsMax[a] = bounds.max[a];
+        }
+
+        int n = end - begin;
+        int mid = n > 2 ? findSplit(begin, end, bounds, centroid_bounds) : begin;
+        if (mid == begin)
+        {
+            if (n <= MAX_LEAF_TRIANGLES) return makeLeaf(i_node, begin, end);
+            mid = begin + n/2; // all centroids in one bin, any split will do
+        }
+
+        build(begin, mid);
+        int second_child = build(mid, end);
+        mNodes[i_node].secondChild = second_child;
+        mNodes[i_node].numTriangles = 0;
+        return i_node;
+    }
+
+private:
+    const std::vector<BuildTriangle> &mTriangles;
+    std::vector<int> &mOrder;
+    std::vector<MeshBvh::Node> &mNodes;
+
+    int makeLeaf(int i_node, int begin, int end)
+    {
+        mNodes[i_node].secondChild = -1;
+        mNodes[i_node].firstTriangle = begin;
+        mNodes[i_node].numTriangles = end - begin;
+        return i_node;
+    }
+
+    // partitions order[begin, end) at the cheapest binned SAH split and returns the partition
+    // point, or begin if a leaf is cheaper
+    int findSplit(int begin, int end, const Bounds &bounds, const Bounds &centroid_bounds)
+    {
+        int n = end - begin;
+        float best_cost = float(n);
+        int best_axis = -1;
+        int best_bin = 0;
+
+        for (int a = 0; a<3; a++)
+        {
+            float extent = centroid_bounds.max[a] - centroid_bounds.min[a];
+            if (extent <= 0.0f) continue;
+            float bin_scale = float(N_BINS)/extent;
+
+            Bounds bin_bounds[N_BINS];
+            int bin_counts[N_BINS] = {0};
+            for (int i = begin; i<end; i++)
+            {
+                const BuildTriangle &tri = mTriangles[mOrder[i]];
+                int bin = std::min(N_BINS-1, int((tri.centroid[a] - centroid_bounds.min[a])*bin_scale));
+                bin_counts[bin]++;
+                bin_bounds[bin].grow(tri.bounds);
+            }
+
+            // sweep from the right, then evaluate every split from the left
+            float right_areas[N_BINS];
+            int right_counts[N_BINS];
+            Bounds right;
+            int right_count = 0;
+            for (int bin = N_BINS-1; bin>0; bin--)
+            {
+                right.grow(bin_bounds[bin]);
+                right_count += bin_counts[bin];
+                right_areas[bin] = right.halfArea();
+                right_counts[bin] = right_count;
+            }
+
+            Bounds left;
+            int left_count = 0;
+            for (int bin = 1; bin<N_BINS; bin++)
+            {
+                left.grow(bin_bounds[bin-1]);
+                left_count += bin_counts[bin-1];
+                if (left_count == 0 || right_counts[bin] == 0) continue;
+
+                float cost = TRAVERSAL_COST + (left.halfArea()*left_count + right_areas[bin]*right_counts[bin])/bounds.halfArea();
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = a;
+                    best_bin = bin;
+                }
+            }
+        }
+
+        if (best_axis < 0) return begin;
+
+        float bin_scale = float(N_BINS)/(centroid_bounds.max[best_axis] - centroid_bounds.min[best_axis]);
+        auto it = std::partition(mOrder.begin()+begin, mOrder.begin()+end, [&](int i_t)
+        {
+            float c = mTriangles[i_t].centroid[best_axis];
+            return std::min(N_BINS-1, int((c - centroid_bounds.min[best_axis])*bin_scale)) < best_bin;
+        });
+        return int(it - mOrder.begin());
+    }
+};
+
+inline void cross(const float a[3], const float b[3], float out[3])
+{
+    out[0] = a[1]*b[2] - a[2]*b[1];
+    out[1] = a[2]*b[0] - a[0]*b[2];
+    out[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+inline float dot(const float a[3], const float b[3])
+{
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+// the ray in plain floats
+struct ScalarRay
+{
+    float origin[3];
+    float direction[3];
+    float inverse[3];
+    float tMin, tMax;
+
+    explicit ScalarRay(const Ray &ray) : tMin(ray.tMin), tMax(ray.tMax)
+    {
+        for (int a = 0; a<3; a++)
+        {
+            origin[a] = ray.origin[a];
+            direction[a] = ray.direction[a];
+            inverse[a] = direction[a] != 0.0f ? 1.0f/direction[a] : LARGE_INVERSE;
+        }
+    }
+};
+
+// true if the ray hits the node bounds within [tMin, tMax], t_entry is where it enters them
+inline bool hitsBounds(const MeshBvh::Node &node, const ScalarRay &ray, float &t_entry)
+{
+    float t_near = ray.tMin;
+    float t_far = ray.tMax;
+    for (int a = 0; a<3; a++)
+    {
+        float t1 = (node.boundsMin[a] - ray.origin[a])*ray.inverse[a];
+        float t2 = (node.boundsMax[a] - ray.origin[a])*ray.inverse[a];
+        t_near = std::max(t_near, std::min(t1, t2));
+        t_far = std::min(t_far, std::max(t1, t2));
+    }
+    t_entry = t_near;
+    return t_near <= t_far;
+}
+
+} // anonymous namespace
+
+void MeshBvh::build(const std::vector<vmath::Vector3> &points, const std::vector<Triangle> &triangles)
+{
+    std::vector<BuildTriangle> build_triangles(triangles.size());
+    for (int i_t = 0; i_t<int(triangles.size()); i_t++)
+    {
+        BuildTriangle &bt = build_triangles[i_t];
+        for (int j = 0; j<3; j++)
+        {
+            const vmath::Vector3 &p = points[triangles[i_t][j]];
+            float corner[3] = {p.getX(), p.getY(), p.getZ()};
+            bt.bounds.grow(corner);
+        }
+        for (int a = 0; a<3; a++) bt.centroid[a] = 0.5f*(bt.bounds.min[a] + bt.bounds.max[a]);
+    }
+
+    std::vector<int> order(triangles.size());
+    for (int i_t = 0; i_t<int(order.size()); i_t++) order[i_t] = i_t;
+
+    mNodes.clear();
+    mTriangles.clear();
+    if (triangles.empty()) return;
+
+    mNodes.reserve(2*triangles.size()/MAX_LEAF_TRIANGLES + 1);
+    Builder(build_triangles, order, mNodes).build(0, int(triangles.size()));
+
+    // triangles in leaf order
+    mTriangles.resize(triangles.size());
+    for (int i = 0; i<int(order.size()); i++)
+    {
+        const Triangle &tri = triangles[order[i]];
+        BvhTriangle &bt = mTriangles[i];
+        for (int a = 0; a<3; a++)
+        {
+            bt.v0[a] = points[tri[0]][a];
+            bt.e1[a] = points[tri[1]][a] - bt.v0[a];
+            bt.e2[a] = points[tri[2]][a] - bt.v0[a];
+        }
+        bt.index = order[i];
+    }
+}
+
+namespace
+{
+
+// Moller-Trumbore, t in [tMin, tMax]
+template<class Triangle>
+inline bool intersectTriangle(const Triangle &tri, const ScalarRay &ray, float &t, float &u, float &v)
+{
+    float p[3], s[3], q[3];
+    cross(ray.direction, tri.e2, p);
+    float det = dot(tri.e1, p);
+    if (det == 0.0f) return false;
+    float inverse_det = 1.0f/det;
+
+    for (int a = 0; a<3; a++) s[a] = ray.origin[a] - tri.v0[a];
+    u = dot(s, p)*inverse_det;
+    if (u < 0.0f || u > 1.0f) return false;
+
+    cross(s, tri.e1, q);
+    v = dot(ray.direction, q)*inverse_det;
+    if (v < 0.0f || u + v > 1.0f) return false;
+
+    t = dot(tri.e2, q)*inverse_det;
+    return t >= ray.tMin && t <= ray.tMax;
+}
+
+} // anonymous namespace
+
+bool MeshBvh::intersect(const Ray &ray, RayHit &hit) const
+{
+    if (mNodes.empty()) return false;
+
+    ScalarRay r(ray);
+    bool found = false;
+
+    int stack[STACK_SIZE];
+    int stack_size = 0;
+    int i_node = 0;
+    float t_entry;
+    if (!hitsBounds(mNodes[0], r, t_entry)) return false;
+
+    while (true)
+    {
+        const Node &node = mNodes[i_node];
+        if (node.numTriangles > 0)
+        {
+            for (int i = node.firstTriangle; i<node.firstTriangle+node.numTriangles; i++)
+            {
+                float t, u, v;
+                if (intersectTriangle(mTriangles[i], r, t, u, v))
+                {
+                    // only closer hits from here on
+                    r.tMax = t;
+                    hit = {mTriangles[i].index, t, u, v};
+                    found = true;
+                }
+            }
+        }
+        else
+        {
+            // visit the nearer child first
+            int children[2] = {i_node+1, node.secondChild};
+            float t_children[2];
+            bool hits[2] = {hitsBounds(mNodes[children[0]], r, t_children[0]),
+                            hitsBounds(mNodes[children[1]], r, t_children[1])};
+            if (hits[0] && hits[1])
+            {
+                int near = t_children[0] <= t_children[1] ? 0 : 1;
+                DEBUG_ASSERT(stack_size < STACK_SIZE);
+                stack[stack_size++] = children[1-near];
+                i_node = children[near];
+                continue;
+            }
+            if (hits[0] || hits[1])
+            {
+                i_node = children[hits[0] ? 0 : 1];
+                continue;
+            }
+        }
+
+        // pop, skipping nodes that start beyond the closest hit so far
+        do
+        {
+            if (stack_size == 0) return found;
+            i_node = stack[--stack_size];
+        } while (!hitsBounds(mNodes[i_node], r, t_entry));
+    }
+}
+
+bool MeshBvh::occluded(const Ray &ray) const
+{
+    if (mNodes.empty()) return false;
+
+    ScalarRay r(ray);
+
+    int stack[STACK_SIZE];
+    int stack_size = 0;
+    int i_node = 0;
+
+    while (true)
+    {
+        const Node &node = mNodes[i_node];
+        float t_entry;
+        if (hitsBounds(node, r, t_entry))
+        {
+            if (node.numTriangles > 0)
+            {
+                for (int i = node.firstTriangle; i<node.firstTriangle+node.numTriangles; i++)
+                {
+                    float t, u, v;
+                    if (intersectTriangle(mTriangles[i], r, t, u, v)) return true;
+                }
+            }
+            else
+            {
+                DEBUG_ASSERT(stack_size < STACK_SIZE);
+                stack[stack_size++] = node.secondChild;
+                i_node = i_node+1;
+                continue;
+            }
+        }
+
+        if (stack_size == 0) return false;
+        i_node = stack[--stack_size];
+    }
+}
+
+int MeshBvh::occludedPacket(const Ray rays[4], int active_mask) const
+{
+    active_mask &= 0xF;
+    if (mNodes.empty() || active_mask == 0) return 0;
+
+#ifdef __SSE2__
+    // the four rays in structure of arrays form
+    __m128 origin[3], direction[3], inverse[3];
+    for (int a = 0; a<3; a++)
+    {
+        origin[a] = _mm_setr_ps(rays[0].origin[a], rays[1].origin[a], rays[2].origin[a], rays[3].origin[a]);
+        direction[a] = _mm_setr_ps(rays[0].direction[a], rays[1].direction[a], rays[2].direction[a], rays[3].direction[a]);
+        float inv[4];
+        for (int i = 0; i<4; i++)
+        {
+            float d = rays[i].direction[a];
+            inv[i] = d != 0.0f ? 1.0f/d : LARGE_INVERSE;
+        }
+        inverse[a] = _mm_loadu_ps(inv);
+    }
+    const __m128 t_min = _mm_setr_ps(rays[0].tMin, rays[1].tMin, rays[2].tMin, rays[3].tMin);
+    const __m128 t_max = _mm_setr_ps(rays[0].tMax, rays[1].tMax, rays[2].tMax, rays[3].tMax);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    int occluded_mask = 0;
+
+    int stack[STACK_SIZE];
+    int stack_size = 0;
+    int i_node = 0;
+
+    while (true)
+    {
+        const Node &node = mNodes[i_node];
+
+        __m128 t_near = t_min;
+        __m128 t_far = t_max;
+        for (int a = 0; a<3; a++)
+        {
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin[a]), origin[a]), inverse[a]);
+            __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax[a]), origin[a]), inverse[a]);
+            t_near = _mm_max_ps(t_near, _mm_min_ps(t1, t2));
+            t_far = _mm_min_ps(t_far, _mm_max_ps(t1, t2));
+        }
+
+        if (_mm_movemask_ps(_mm_cmple_ps(t_near, t_far)) & active_mask)
+        {
+            if (node.numTriangles > 0)
+            {
+                for (int i = node.firstTriangle; i<node.firstTriangle+node.numTriangles; i++)
+                {
+                    const BvhTriangle &tri = mTriangles[i];
+                    __m128 e1[3], e2[3], s[3];
+                    for (int a = 0; a<3; a++)
+                    {
+                        e1[a] = _mm_set1_ps(tri.e1[a]);
+                        e2[a] = _mm_set1_ps(tri.e2[a]);
+                        s[a] = _mm_sub_ps(origin[a], _mm_set1_ps(tri.v0[a]));
+                    }
+
+                    // Moller-Trumbore on all lanes, as in intersectTriangle
+                    __m128 p[3], q[3];
+                    for (int a = 0; a<3; a++)
+                    {
+                        int b = (a+1)%3, c = (a+2)%3;
+                        p[a] = _mm_sub_ps(_mm_mul_ps(direction[b], e2[c]), _mm_mul_ps(direction[c], e2[b]));
+                        q[a] = _mm_sub_ps(_mm_mul_ps(s[b], e1[c]), _mm_mul_ps(s[c], e1[b]));
+                    }
+                    auto dot3 = [](const __m128 x[3], const __m128 y[3])
+                    {
+                        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x[0], y[0]), _mm_mul_ps(x[1], y[1])), _mm_mul_ps(x[2], y[2]));
+                    };
+
+                    __m128 det = dot3(e1, p);
+                    __m128 inverse_det = _mm_div_ps(one, det);
+                    __m128 u = _mm_mul_ps(dot3(s, p), inverse_det);
+                    __m128 v = _mm_mul_ps(dot3(direction, q), inverse_det);
+                    __m128 t = _mm_mul_ps(dot3(e2, q), inverse_det);
+
+                    __m128 hit = _mm_cmpneq_ps(det, zero);
+                    hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+                    hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+                    hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+                    hit = _mm_and_ps(hit, _mm_cmpge_ps(t, t_min));
+                    hit = _mm_and_ps(hit, _mm_cmple_ps(t, t_max));
+
+                    int hit_mask = _mm_movemask_ps(hit) & active_mask;
+                    occluded_mask |= hit_mask;
+                    active_mask &= ~hit_mask;
+                    if (active_mask == 0) return occluded_mask;
+                }
+            }
+            else
+            {
+                DEBUG_ASSERT(stack_size < STACK_SIZE);
+                stack[stack_size++] = node.secondChild;
+                i_node = i_node+1;
+                continue;
+            }
+        }
+
+        if (stack_size == 0) return occluded_mask;
+        i_node = stack[--stack_size];
+    }
+#else
+    int occluded_mask = 0;
+    for (int i = 0; i<4; i++)
+    {
+        if ((active_mask & (1 << i)) && occluded(rays[i])) occluded_mask |= 1 << i;
+    }
+    return occluded_mask;
+#endif
+}
+
+void MeshBvh::occluded(const std::vector<Ray> &rays, std::vector<char> &occluded_out) const
+{
+    int n_rays = rays.size();
+    occluded_out.resize(n_rays);
+
+    Threads::parallelFor(0, (n_rays+3)/4, [&](int begin, int end)
+    {
+        for (int i_packet = begin; i_packet<end; i_packet++)
+        {
+            int first = 4*i_packet;
+            int n = std::min(4, n_rays - first);
+            Ray packet[4];
+            for (int i = 0; i<n; i++) packet[i] = rays[first+i];
+
+            int mask = occludedPacket(packet, (1 << n) - 1);
+            for (int i = 0; i<n; i++) occluded_out[first+i] = (mask >> i) & 1;
+        }
+    });
+}
+
+} // namespace gfx
@@ -0,0 +1,97 @@
+#ifndef MESHBVH_H
+#define MESHBVH_H
+
+#include <limits>
+#include <vector>
+
+#include "gfx_primitives.h"
+
+namespace gfx
+{
+
+struct Ray
+{
+    Ray() : tMin(0.0f), tMax(std::numeric_limits<float>::max()) {}
+    Ray(const vmath::Vector3 &origin, const vmath::Vector3 &direction,
+        float t_min = 0.0f, float t_max = std::numeric_limits<float>::max()) :
+        origin(origin), direction(direction), tMin(t_min), tMax(t_max) {}
+
+    vmath::Vector3 origin;
+    vmath::Vector3 direction;  // any length, t is measured in direction lengths
+    float tMin;
+    float tMax;
+};
+
+struct RayHit
+{
+    int triangle;   // index into the triangles the bvh was built from
+    float t;        // hit point = origin + t*direction
+    float u, v;     // barycentric weights of corners 1 and 2
+};
+
+/**
+ * @brief The MeshBvh class: bounding volume hierarchy over the triangles of a mesh, for ray
+ *          casts such as shadows, picking, line of sight and physics probes.
+ *
+ *          Built top down with the surface area heuristic evaluated in centroid bins. The
+ *          nodes are stored depth first in one array: the first child of an inner node
+ *          follows it, the second is at secondChild. Leaves own a range of the triangle
+ *          array, which holds a copy of every triangle as corner and edge vectors in leaf
+ *          order, so traversal does not touch the mesh.
+ *
+ *          occludedPacket() traces four rays together with SSE2 and is fastest when the rays
+ *          are coherent, like rays from one point towards nearby directions. The stream
+ *          version splits a ray array into packets over the thread pool.
+ *          The bvh does not reference the mesh after building.
+ */
+class MeshBvh
+{
+public:
+    // one node of the flattened tree
+    struct Node
+    {
+        float boundsMin[3];
+        int secondChild;    // inner nodes
+        float boundsMax[3];
+        int firstTriangle;  // leaves
+        int numTriangles;   // 0 for inner nodes
+    };
+
+    MeshBvh() {}
+    MeshBvh(const std::vector<vmath::Vector3> &points, const std::vector<Triangle> &triangles) {build(points, triangles);}
+
+    void build(const std::vector<vmath::Vector3> &points, const std::vector<Triangle> &triangles);
+
+    int numNodes() const {return int(mNodes.size());}
+    int numTriangles() const {return int(mTriangles.size());}
+
+    // closest hit with t in [tMin, tMax], false if there is none
+    bool intersect(const Ray &ray, RayHit &hit) const;
+
+    // true if any triangle is hit with t in [tMin, tMax]
+    bool occluded(const Ray &ray) const;
+
+    // bit i of the result is set if rays[i] is occluded. Rays without their bit in
+    // active_mask are not traced and report 0.
+    int occludedPacket(const Ray rays[4], int active_mask = 0xF) const;
+
+    // occluded_out[i] = occluded(rays[i]), traced in packets of four on the thread pool
+    void occluded(const std::vector<Ray> &rays, std::vector<char> &occluded_out) const;
+
+private:
+    // corner 0 and the edges to corners 1 and 2
+    struct BvhTriangle
+    {
+        float v0[3];
+        float e1[3];
+        float e2[3];
+        int index;
+    };
+
+    std::vector<Node> mNodes;
+    std::vector<BvhTriangle> mTriangles;
+};
+
+} // namespace gfx
+
+#endif // MESHBVH_H
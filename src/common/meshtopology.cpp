@@ -0,0 +1,125 @@
+#include "meshtopology.h"
+
+namespace gfx
+{
+
+namespace
+{
+
+// list items 0..n_items-1 by key in [0, n_keys), items with the same key keep their order
+template<class KeyFunc>
+void countingSort(IndexLists &lists, int n_keys, int n_items, KeyFunc key)
+{
+    lists.offsets.assign(n_keys+1, 0);
+    for (int i = 0; i<n_items; i++) lists.offsets[key(i)+1]++;
+    for (int k = 0; k<n_keys; k++) lists.offsets[k+1] += lists.offsets[k];
+
+    lists.indices.resize(n_items);
+    std::vector<int> next(lists.offsets.begin(), lists.offsets.end()-1);
+    for (int i = 0; i<n_items; i++) lists.indices[next[key(i)]++] = i;
+}
+
+} // anonymous namespace
+
+void MeshTopology::build(int n_points, const std::vector<Triangle> &triangles)
+{
+    mNumPoints = n_points;
+    mNumTriangles = triangles.size();
+    int n_half_edges = numHalfEdges();
+
+    auto from = [&](int i_h) {return triangles[triangleOf(i_h)][cornerOf(i_h)];};
+    auto to = [&](int i_h) {return triangles[triangleOf(i_h)][(cornerOf(i_h)+1)%3];};
+
+    // point to triangle, each triangle listed at its three corners
+    IndexLists point_corners;
+    countingSort(point_corners, n_points, n_half_edges, from);
+    mPointTriangles = point_corners;
+    for (int &i_corner : mPointTriangles.indices) i_corner = triangleOf(i_corner);
+
+    // point to point, walking the edges of the adjacent triangles in order. last_visitor
+    // marks the neighbors already added to the current point
+    std::vector<int> last_visitor(n_points, -1);
+    mPointPoints.offsets.assign(1, 0);
+    mPointPoints.indices.clear();
+    mPointPoints.indices.reserve(n_half_edges + n_half_edges/6);
+    for (int i_p = 0; i_p<n_points; i_p++)
+    {
+        auto add_neighbor = [&](int i_n)
+        {
+            if (i_n == i_p || last_visitor[i_n] == i_p) return;
+            last_visitor[i_n] = i_p;
+            mPointPoints.indices.push_back(i_n);
+        };
+
+        for (int i_t : mPointTriangles[i_p])
+        {
+            const Triangle &tri = triangles[i_t];
+            for (int j = 0; j<3; j++)
+            {
+                if (tri[j] == i_p) add_neighbor(tri[(j+1)%3]);
+                if (tri[(j+1)%3] == i_p) add_neighbor(tri[j]);
+            }
+        }
+        mPointPoints.offsets.push_back(mPointPoints.indices.size());
+    }
+
+    // edges, found by going through the half-edges grouped by their smallest end point
+    IndexLists min_point_half_edges;
+    countingSort(min_point_half_edges, n_points, n_half_edges, [&](int i_h) {return std::min(from(i_h), to(i_h));});
+
+    std::fill(last_visitor.begin(), last_visitor.end(), -1);
+    std::vector<int> edge_to(n_points);
+    mEdges.clear();
+    mHalfEdgeEdges.resize(n_half_edges);
+    for (int i_p = 0; i_p<n_points; i_p++)
+    {
+        for (int i_h : min_point_half_edges[i_p])
+        {
+            int i_other = std::max(from(i_h), to(i_h));
+            if (last_visitor[i_other] != i_p)
+            {
+                last_visitor[i_other] = i_p;
+                edge_to[i_other] = mEdges.size();
+                mEdges.push_back(Line{{i_p, i_other}});
+            }
+            mHalfEdgeEdges[i_h] = edge_to[i_other];
+        }
+    }
+
+    // renumber the edges in the order they are first met walking the half-edges, so edge
+    // numbers follow the triangle order like the old edge maps did
+    std::vector<int> edge_order(mEdges.size(), -1);
+    std::vector<Line> ordered_edges(mEdges.size());
+    int n_ordered = 0;
+    for (int &i_e : mHalfEdgeEdges)
+    {
+        if (edge_order[i_e] < 0)
+        {
+            edge_order[i_e] = n_ordered;
+            ordered_edges[n_ordered++] = mEdges[i_e];
+        }
+        i_e = edge_order[i_e];
+    }
+    mEdges.swap(ordered_edges);
+
+    countingSort(mEdgeHalfEdges, mEdges.size(), n_half_edges, [&](int i_h) {return mHalfEdgeEdges[i_h];});
+
+    // twins
+    mNumNonManifoldEdges = 0;
+    mHalfEdgeTwins.assign(n_half_edges, -1);
+    for (int i_e = 0; i_e<numEdges(); i_e++)
+    {
+        IndexLists::Range half_edges = mEdgeHalfEdges[i_e];
+        if (half_edges.size() == 2)
+        {
+            mHalfEdgeTwins[half_edges[0]] = half_edges[1];
+            mHalfEdgeTwins[half_edges[1]] = half_edges[0];
+        }
+        else
+        {
+            mNumNonManifoldEdges++;
+        }
+    }
+}
+
+} // namespace gfx
@@ -0,0 +1,122 @@
+#ifndef MESHTOPOLOGY_H
+#define MESHTOPOLOGY_H
+
+#include <vector>
+
+#include "gfx_primitives.h"
+
+namespace gfx
+{
+
+/**
+ * @brief The IndexLists class: a list of index lists stored in compressed sparse row form,
+ *          one offsets array and one flat indices array instead of a vector per list.
+ *          lists[i] gives a range that can be iterated and indexed like a vector.
+ */
+class IndexLists
+{
+public:
+    typedef int index_type;
+
+    class Range
+    {
+    public:
+        Range(const int *first, const int *last) : mFirst(first), mLast(last) {}
+
+        const int *begin() const {return mFirst;}
+        const int *end() const {return mLast;}
+        int size() const {return int(mLast-mFirst);}
+        bool empty() const {return mFirst == mLast;}
+        int operator[](int i) const {return mFirst[i];}
+
+    private:
+        const int *mFirst;
+        const int *mLast;
+    };
+
+    IndexLists() : offsets(1, 0) {}
+
+    Range operator[](int i) const {return Range(indices.data()+offsets[i], indices.data()+offsets[i+1]);}
+    int size() const {return int(offsets.size())-1;}
+
+    // offsets[i] to offsets[i+1] is the range of list i in indices
+    std::vector<int> offsets;
+    std::vector<int> indices;
+};
+
+/**
+ * @brief The MeshTopology class: connectivity of a triangle mesh, built once and shared by
+ *          everything that walks the mesh. Construction is linear in the mesh size, all lists
+ *          are filled with counting sorts into flat arrays.
+ *
+ *          Half-edge h = 3*i_t + j runs from triangles[i_t][j] to triangles[i_t][(j+1)%3], so
+ *          its triangle and corner follow from the index and no half-edge records are stored.
+ *          Every undirected edge has an index, in the order the edges are first met walking
+ *          the half-edges, with the half-edges on it listed per edge.
+ *          A manifold edge has two half-edges which are each others twin, boundary and
+ *          non-manifold edges have no twin.
+ */
+class MeshTopology
+{
+public:
+    MeshTopology() : mNumPoints(0), mNumTriangles(0), mNumNonManifoldEdges(0) {}
+    MeshTopology(int n_points, const std::vector<Triangle> &triangles) {build(n_points, triangles);}
+
+    void build(int n_points, const std::vector<Triangle> &triangles);
+
+    int numPoints() const {return mNumPoints;}
+    int numTriangles() const {return mNumTriangles;}
+    int numEdges() const {return int(mEdges.size());}
+    int numHalfEdges() const {return 3*mNumTriangles;}
+
+    // neighbors of each point, in the order they first appear walking the triangles in index order
+    const IndexLists &pointPoints() const {return mPointPoints;}
+
+    // triangles around each point, in index order
+    const IndexLists &pointTriangles() const {return mPointTriangles;}
+
+    // half-edges on each edge
+    const IndexLists &edgeHalfEdges() const {return mEdgeHalfEdges;}
+
+    // edge end points, the smallest index first
+    const Line &edge(int i_e) const {return mEdges[i_e];}
+    int edgeOf(int i_h) const {return mHalfEdgeEdges[i_h];}
+    int edgeTriangleCount(int i_e) const {return mEdgeHalfEdges[i_e].size();}
+
+    // -1 on boundary and non-manifold edges
+    int twin(int i_h) const {return mHalfEdgeTwins[i_h];}
+
+    static int halfEdge(int i_t, int j) {return 3*i_t+j;}
+    static int triangleOf(int i_h) {return i_h/3;}
+    static int cornerOf(int i_h) {return i_h%3;}
+
+    // triangle across edge (triangles[i_t][j], triangles[i_t][(j+1)%3]), -1 if there is no single one
+    int triangleAcross(int i_t, int j) const
+    {
+        int i_twin = mHalfEdgeTwins[halfEdge(i_t, j)];
+        return i_twin < 0 ? -1 : triangleOf(i_twin);
+    }
+
+    int eulerCharacteristic() const {return mNumPoints - numEdges() + mNumTriangles;}
+
+    // every edge has exactly two triangles
+    bool isClosedManifold() const {return mNumNonManifoldEdges == 0;}
+    int numNonManifoldEdges() const {return mNumNonManifoldEdges;}
+
+private:
+    int mNumPoints;
+    int mNumTriangles;
+    int mNumNonManifoldEdges;
+
+    IndexLists mPointPoints;
+    IndexLists mPointTriangles;
+    IndexLists mEdgeHalfEdges;
+
+    std::vector<Line> mEdges;
+    std::vector<int> mHalfEdgeEdges;
+    std::vector<int> mHalfEdgeTwins;
+};
+
+} // namespace gfx
+
+#endif // MESHTOPOLOGY_H
@@ -0,0 +1,179 @@
+#ifndef COUNTERRNG_H
+#define COUNTERRNG_H
+
+#include <array>
+#include <cstdint>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace Procedural
+{
+
+// every generation stage draws from its own stream, so adding draws to one stage does not
+// change the numbers any other stage gets
+enum class RngStage : uint32_t
+{
+    PointSampling = 1,
+    PoissonDisk,
+    Jitter,
+    Noise,
+    RiverSprings,
+    Resources,
+    Spawn
+};
+
+/**
+ * @brief The CounterRng class: stateless random numbers, Philox4x32-10.
+ *
+ *          A number is a pure function of (seed, stage, substream, index, draw), there is no
+ *          state that advances. Elements processed in any order or on any thread get the same
+ *          numbers, which makes a generation stage reproducible per seed and safe to run in
+ *          parallel. index is the element a number belongs to, such as a point index, and draw
+ *          numbers the values used for the same element. Each (index, draw/4) pair is one
+ *          Philox block of four values.
+ *
+ *          uniformBatch() and uniformGather() compute four blocks at a time with SSE2 and give
+ *          bit identical results to uniform().
+ */
+class CounterRng
+{
+public:
+    typedef std::array<uint32_t, 4> Block;
+
+    CounterRng(uint32_t seed, RngStage stage, uint32_t substream = 0) :
+        mKey{{seed, (uint32_t(stage) << 16) ^ substream}} {}
+
+    Block block(uint64_t index, uint32_t draw_block = 0) const
+    {
+        Block ctr = {{uint32_t(index), uint32_t(index >> 32), draw_block, 0u}};
+        uint32_t k0 = mKey[0], k1 = mKey[1];
+        for (int round = 0; round<N_ROUNDS; round++)
+        {
+            if (round > 0) {k0 += W0; k1 += W1;}
+            uint64_t p0 = uint64_t(M0)*ctr[0];
+            uint64_t p1 = uint64_t(M1)*ctr[2];
+            ctr = {{uint32_t(p1 >> 32) ^ ctr[1] ^ k0, uint32_t(p1),
+                    uint32_t(p0 >> 32) ^ ctr[3] ^ k1, uint32_t(p0)}};
+        }
+        return ctr;
+    }
+
+    // 32 random bits
+    uint32_t bits(uint64_t index, uint32_t draw = 0) const
+    {
+        return block(index, draw >> 2)[draw & 3];
+    }
+
+    // uniform in [0, 1), 24 bits so every value is exact in a float
+    float uniform(uint64_t index, uint32_t draw = 0) const
+    {
+        return bitsToUnit(bits(index, draw));
+    }
+
+    // uniform in [lo, hi)
+    float uniform(uint64_t index, uint32_t draw, float lo, float hi) const
+    {
+        return lo + uniform(index, draw)*(hi - lo);
+    }
+
+    // uniform integer in [0, n)
+    uint32_t below(uint64_t index, uint32_t draw, uint32_t n) const
+    {
+        return uint32_t((uint64_t(bits(index, draw))*n) >> 32);
+    }
+
+    // out[i] = uniform(first_index + i, draw, lo, hi) for i in [0, n)
+    void uniformBatch(uint64_t first_index, int n, uint32_t draw, float lo, float hi, float *out) const
+    {
+        int i = 0;
+#ifdef __SSE2__
+        for (; i+4 <= n; i += 4)
+        {
+            uint64_t index = first_index + i;
+            uint64_t indices[4] = {index, index+1, index+2, index+3};
+            uniformFour(indices, draw, lo, hi, out + i);
+        }
+#endif
+        for (; i<n; i++) out[i] = uniform(first_index + i, draw, lo, hi);
+    }
+
+    // out[i] = uniform(indices[i], draw, lo, hi) for i in [0, n)
+    void uniformGather(const uint64_t *indices, int n, uint32_t draw, float lo, float hi, float *out) const
+    {
+        int i = 0;
+#ifdef __SSE2__
+        for (; i+4 <= n; i += 4) uniformFour(indices + i, draw, lo, hi, out + i);
+#endif
+        for (; i<n; i++) out[i] = uniform(indices[i], draw, lo, hi);
+    }
+
+private:
+    static const int N_ROUNDS = 10;
+    static const uint32_t M0 = 0xD2511F53u;
+    static const uint32_t M1 = 0xCD9E8D57u;
+    static const uint32_t W0 = 0x9E3779B9u;
+    static const uint32_t W1 = 0xBB67AE85u;
+    static constexpr float UNIT = 1.0f/16777216.0f;
+
+    std::array<uint32_t, 2> mKey;
+
+    static float bitsToUnit(uint32_t bits)
+    {
+        return float(bits >> 8)*UNIT;
+    }
+
+#ifdef __SSE2__
+    // four Philox blocks, one lane per index, keeping the word selected by draw
+    void uniformFour(const uint64_t indices[4], uint32_t draw, float lo, float hi, float *out) const
+    {
+        // the counter words split into four vectors
+        __m128i c0 = _mm_setr_epi32(int(uint32_t(indices[0])), int(uint32_t(indices[1])),
+                                    int(uint32_t(indices[2])), int(uint32_t(indices[3])));
+        __m128i c1 = _mm_setr_epi32(int(uint32_t(indices[0] >> 32)), int(uint32_t(indices[1] >> 32)),
+                                    int(uint32_t(indices[2] >> 32)), int(uint32_t(indices[3] >> 32)));
+        __m128i c2 = _mm_set1_epi32(int(draw >> 2));
+        __m128i c3 = _mm_setzero_si128();
+        __m128i k0 = _mm_set1_epi32(int(mKey[0]));
+        __m128i k1 = _mm_set1_epi32(int(mKey[1]));
+
+        for (int round = 0; round<N_ROUNDS; round++)
+        {
+            if (round > 0)
+            {
+                k0 = _mm_add_epi32(k0, _mm_set1_epi32(int(W0)));
+                k1 = _mm_add_epi32(k1, _mm_set1_epi32(int(W1)));
+            }
+            __m128i hi0, lo0, hi1, lo1;
+            mulHiLo(c0, M0, hi0, lo0);
+            mulHiLo(c2, M1, hi1, lo1);
+            c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), k0);
+            c1 = lo1;
+            c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), k1);
+            c3 = lo0;
+        }
+
+        __m128i words = (draw & 3) == 0 ? c0 : (draw & 3) == 1 ? c1 : (draw & 3) == 2 ? c2 : c3;
+
+        // same arithmetic as bitsToUnit and uniform, the top 24 bits convert exactly
+        __m128 unit = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(words, 8)), _mm_set1_ps(UNIT));
+        _mm_storeu_ps(out, _mm_add_ps(_mm_set1_ps(lo), _mm_mul_ps(unit, _mm_set1_ps(hi - lo))));
+    }
+
+    // 32x32 -> 64 bit products of all four lanes with m, split in high and low words
+    static void mulHiLo(__m128i a, uint32_t m, __m128i &hi, __m128i &lo)
+    {
+        const __m128i m4 = _mm_set1_epi32(int(m));
+        const __m128i low_mask = _mm_set_epi32(0, -1, 0, -1);
+        __m128i p02 = _mm_mul_epu32(a, m4);
+        __m128i p13 = _mm_mul_epu32(_mm_srli_epi64(a, 32), m4);
+        lo = _mm_or_si128(_mm_and_si128(p02, low_mask), _mm_slli_epi64(p13, 32));
+        hi = _mm_or_si128(_mm_srli_epi64(p02, 32), _mm_andnot_si128(low_mask, p13));
+    }
+#endif
+};
+
+} // namespace Procedural
+
+#endif // COUNTERRNG_H
@@ -1,9 +1,15 @@
 #include "noise3d.h"
+#include "counterrng.h"
 #include "../mathext.h"
 #include "../interpolation.hpp"
+#include "../threads/parallelfor.h"
 
 #include <algorithm>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 using namespace MathExt;
 
 inline int getNumSidePts(int grid_lvl)
@@ -11,46 +17,53 @@ inline int getNumSidePts(int grid_lvl)
     return 1 + pow(2, grid_lvl); // is this double -> int conversion a timebomb?
 }
 
-inline int getNumGridPts(int grid_lvl)
+inline int64_t getNumGridPts(int grid_lvl)
 {
-    int num_side = getNumSidePts(grid_lvl);
+    int64_t num_side = getNumSidePts(grid_lvl);
     return num_side * num_side * num_side;
 }
 
-Noise3D::Noise3D(float width, float height, float min_noise_scale, int seed) :
-    mMaxDim(std::max(width, height))
+inline float getLevelScaleFactor(int grid_lvl)
 {
-    // Seed the pseudo-random number generator
-    //srand(seed);
+    return grid_lvl == 0 ? 0.0f : 1.0f/static_cast<float>(grid_lvl);
+}
 
+Noise3D::Noise3D(float width, float height, float min_noise_scale, unsigned int seed, Storage storage) :
+    mStorage(storage),
+    mSeed(seed),
+    mGridLevels(nullptr),
+    mMaxDim(std::max(width, height))
+{
     // find min and max points
     float half_max_dim = mMaxDim/2.0f;
     mMax = vmath::Vector3(half_max_dim, half_max_dim, half_max_dim);
     mMin = -mMax;
 
-    // construct the grid
     mNumGridLevels = ceil(log2(mMaxDim/min_noise_scale));
-    mGridLevels = new float* [mNumGridLevels];
 
     //std::cout << "mNumGridLevels: " << mNumGridLevels << std::endl;
 
+    if (mStorage == Storage::Hashed) return;
+
+    // construct the grid
+    mGridLevels = new float* [mNumGridLevels];
     for (int i_lvl = 0; i_lvl<mNumGridLevels; i_lvl++)
     {
         float* &gridPts = mGridLevels[i_lvl];
-        int num_grid_pts = getNumGridPts(i_lvl);
+        int64_t num_grid_pts = getNumGridPts(i_lvl);
         gridPts = new float [num_grid_pts];
 
-        float noise_lvl_scalefactor = i_lvl == 0 ? 0.0f : 1.0f/static_cast<float>(i_lvl);
-        // assign the grid points random value
-        for (int i_pts = 0; i_pts<num_grid_pts; i_pts++)
-        {
-            gridPts[i_pts] = frand(-noise_lvl_scalefactor, noise_lvl_scalefactor);
-        }
+        float noise_lvl_scalefactor = getLevelScaleFactor(i_lvl);
+        // assign the grid points random value, one stream per level
+        Procedural::CounterRng rng(seed, Procedural::RngStage::Noise, i_lvl);
+        rng.uniformBatch(0, num_grid_pts, 0, -noise_lvl_scalefactor, noise_lvl_scalefactor, gridPts);
     }
 }
 
 Noise3D::~Noise3D()
 {
+    if (!mGridLevels) return;
+
     for (int i_gridlvl = 0; i_gridlvl<mNumGridLevels; i_gridlvl++)
     {
         delete [] mGridLevels[i_gridlvl];
@@ -59,6 +72,25 @@ Noise3D::~Noise3D()
     delete [] mGridLevels;
 }
 
+size_t Noise3D::numBytes() const
+{
+    if (!mGridLevels) return 0;
+
+    size_t bytes = mNumGridLevels*sizeof(float*);
+    for (int i_lvl = 0; i_lvl<mNumGridLevels; i_lvl++) bytes += getNumGridPts(i_lvl)*sizeof(float);
+    return bytes;
+}
+
+// the value the Grid storage holds at i_global of level i_lvl
+float Noise3D::latticeValue(int i_lvl, int64_t i_global) const
+{
+    if (mGridLevels) return mGridLevels[i_lvl][i_global];
+
+    float noise_lvl_scalefactor = getLevelScaleFactor(i_lvl);
+    Procedural::CounterRng rng(mSeed, Procedural::RngStage::Noise, i_lvl);
+    return rng.uniform(i_global, 0, -noise_lvl_scalefactor, noise_lvl_scalefactor);
+}
+
 inline Noise3D::ijk Noise3D::ijkFromPoint(const vmath::Vector3 &point, int num_side_pts)
 {
     ijk out;
@@ -68,9 +100,9 @@ inline Noise3D::ijk Noise3D::ijkFromPoint(const vmath::Vector3 &point, int num_s
     return out;
 }
 
-inline int Noise3D::localToGlobal(const ijk &indices, int num_side_pts)
+inline int64_t Noise3D::localToGlobal(const ijk &indices, int num_side_pts)
 {
-    return indices.inds[0] + indices.inds[1] * num_side_pts + indices.inds[2] * num_side_pts * num_side_pts;
+    return indices.inds[0] + int64_t(indices.inds[1]) * num_side_pts + int64_t(indices.inds[2]) * num_side_pts * num_side_pts;
 }
 
 inline vmath::Vector3 Noise3D::findGridPtLocation(const ijk &indices, int num_side_pts)
@@ -87,7 +119,6 @@ float Noise3D::sample(const vmath::Vector3 &point)
     float sum = 0.0f;
     for (int i_lvl = 0; i_lvl<mNumGridLevels; i_lvl++)
     {
-        float const * const &gridPts = mGridLevels[i_lvl];
         int num_side_pts = getNumSidePts(i_lvl);
 
         ijk indices = ijkFromPoint(point, num_side_pts);
@@ -103,9 +134,9 @@ float Noise3D::sample(const vmath::Vector3 &point)
                 {
                     int k = MathExt::wrap(indices.inds[2]+(d_k-1), num_side_pts);
 
-                    int I = localToGlobal({i, j, k}, num_side_pts);
+                    int64_t I = localToGlobal({i, j, k}, num_side_pts);
 
-                    p[d_i][d_j][d_k] = gridPts[I];
+                    p[d_i][d_j][d_k] = latticeValue(i_lvl, I);
                 }
             }
         }
@@ -124,3 +155,162 @@ float Noise3D::sample(const vmath::Vector3 &point)
 
     return sum;
 }
+
+#ifdef __SSE2__
+
+namespace
+{
+
+// SSE2 has no floor, truncate and step down where truncation rounded up
+inline __m128 floor4(__m128 x)
+{
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+}
+
+// the weights of interpolate::cubic, p1 + 0.5x(p2 - p0 + x(2p0 - 5p1 + 4p2 - p3 + x(3(p1 - p2) + p3 - p0)))
+// written as w0*p0 + w1*p1 + w2*p2 + w3*p3
+inline void cubicWeights4(__m128 x, __m128 w[4])
+{
+    const __m128 half = _mm_set1_ps(0.5f);
+    __m128 x2 = _mm_mul_ps(x, x);
+    __m128 x3 = _mm_mul_ps(x2, x);
+    __m128 x2_2 = _mm_add_ps(x2, x2);
+    __m128 x3_3 = _mm_add_ps(x3, _mm_add_ps(x3, x3));
+    w[0] = _mm_mul_ps(half, _mm_sub_ps(_mm_sub_ps(x2_2, x), x3));
+    w[1] = _mm_mul_ps(half, _mm_add_ps(_mm_sub_ps(_mm_set1_ps(2.0f), _mm_mul_ps(_mm_set1_ps(5.0f), x2)), x3_3));
+    w[2] = _mm_mul_ps(half, _mm_sub_ps(_mm_add_ps(x, _mm_add_ps(x2_2, x2_2)), x3_3));
+    w[3] = _mm_mul_ps(half, _mm_sub_ps(x3, x2));
+}
+
+// i - 1 + d for d in [0, 4), brought back into [0, num_side) with masks, i is already in range
+inline void neighborIndices4(__m128i i, __m128i num_side, int out[4][4])
+{
+    for (int d = 0; d<4; d++)
+    {
+        __m128i n = _mm_add_epi32(i, _mm_set1_epi32(d-1));
+        n = _mm_add_epi32(n, _mm_and_si128(_mm_cmplt_epi32(n, _mm_setzero_si128()), num_side));
+        n = _mm_sub_epi32(n, _mm_andnot_si128(_mm_cmplt_epi32(n, num_side), num_side));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out[d]), n);
+    }
+}
+
+} // anonymous namespace
+
+void Noise3D::sampleFour(const vmath::Vector3 *in, float *out) const
+{
+    // structure of arrays, one lane per point
+    __m128 point[3];
+    for (int n = 0; n<3; n++)
+    {
+        point[n] = _mm_setr_ps(in[0][n], in[1][n], in[2][n], in[3][n]);
+    }
+
+    __m128 sum = _mm_setzero_ps();
+    for (int i_lvl = 0; i_lvl<mNumGridLevels; i_lvl++)
+    {
+        const float *grid_pts = mGridLevels ? mGridLevels[i_lvl] : nullptr;
+        float noise_lvl_scalefactor = getLevelScaleFactor(i_lvl);
+        Procedural::CounterRng rng(mSeed, Procedural::RngStage::Noise, i_lvl);
+        int num_side_pts = getNumSidePts(i_lvl);
+        int64_t plane = int64_t(num_side_pts)*num_side_pts;
+        const __m128 num_side_f = _mm_set1_ps(float(num_side_pts));
+        const __m128 cell_side_length = _mm_set1_ps(mMaxDim/static_cast<float>(num_side_pts));
+
+        // same arithmetic as ijkFromPoint and findGridPtLocation, per axis
+        __m128 weights[3][4];
+        int indices[3][4][4]; // axis, neighbor, lane
+        for (int n = 0; n<3; n++)
+        {
+            __m128 min_n = _mm_set1_ps(mMin[n]);
+            __m128 cell = floor4(_mm_mul_ps(_mm_div_ps(_mm_sub_ps(point[n], min_n), _mm_set1_ps(mMax[n]-mMin[n])), num_side_f));
+            // MathExt::wrap, exact as long as the cell numbers fit in the float mantissa
+            cell = _mm_sub_ps(cell, _mm_mul_ps(num_side_f, floor4(_mm_div_ps(cell, num_side_f))));
+
+            __m128 cell_location = _mm_add_ps(min_n, _mm_mul_ps(cell, cell_side_length));
+            cubicWeights4(_mm_div_ps(_mm_sub_ps(point[n], cell_location), cell_side_length), weights[n]);
+
+            neighborIndices4(_mm_cvttps_epi32(cell), _mm_set1_epi32(num_side_pts), indices[n]);
+        }
+
+        // contract z, then y, then x, gathering the 4x4x4 neighborhood of every lane
+        __m128 sum_x = _mm_setzero_ps();
+        for (int d_i = 0; d_i<4; d_i++)
+        {
+            __m128 sum_y = _mm_setzero_ps();
+            for (int d_j = 0; d_j<4; d_j++)
+            {
+                // lattice indices of the 4 z neighbors of every lane
+                int64_t global[4][4];
+                for (int lane = 0; lane<4; lane++)
+                {
+                    int64_t row = indices[0][d_i][lane] + int64_t(indices[1][d_j][lane])*num_side_pts;
+                    for (int d_k = 0; d_k<4; d_k++) global[d_k][lane] = row + indices[2][d_k][lane]*plane;
+                }
+
+                float values[4][4];
+                if (grid_pts)
+                {
+                    for (int d_k = 0; d_k<4; d_k++)
+                        for (int lane = 0; lane<4; lane++) values[d_k][lane] = grid_pts[global[d_k][lane]];
+                }
+                else
+                {
+                    rng.uniformGather(reinterpret_cast<const uint64_t*>(&global[0][0]), 16, 0,
+                                      -noise_lvl_scalefactor, noise_lvl_scalefactor, &values[0][0]);
+                }
+
+                __m128 sum_z = _mm_setzero_ps();
+                for (int d_k = 0; d_k<4; d_k++)
+                {
+                    sum_z = _mm_add_ps(sum_z, _mm_mul_ps(weights[2][d_k], _mm_loadu_ps(values[d_k])));
+                }
+                sum_y = _mm_add_ps(sum_y, _mm_mul_ps(weights[1][d_j], sum_z));
+            }
+            sum_x = _mm_add_ps(sum_x, _mm_mul_ps(weights[0][d_i], sum_y));
+        }
+
+        sum = _mm_add_ps(sum, sum_x);
+    }
+
+    _mm_storeu_ps(out, sum);
+}
+
+#endif // __SSE2__
+
+void Noise3D::sampleBatch(const vmath::Vector3 *in, float *out, int n) const
+{
+    const int block_size = 256;
+    int n_blocks = (n + block_size - 1)/block_size;
+
+    Threads::parallelFor(0, n_blocks, [&](int begin, int end)
+    {
+        for (int i_block = begin; i_block<end; i_block++)
+        {
+            int block_begin = i_block*block_size;
+            int block_end = std::min(block_begin + block_size, n);
+#ifdef __SSE2__
+            int i = block_begin;
+            for (; i+4 <= block_end; i += 4)
+            {
+                sampleFour(in + i, out + i);
+            }
+
+            // pad the last few points with copies of the final one
+            if (i < block_end)
+            {
+                vmath::Vector3 rest_in[4];
+                float rest_out[4];
+                for (int j = 0; j<4; j++) rest_in[j] = in[std::min(i+j, block_end-1)];
+                sampleFour(rest_in, rest_out);
+                for (int j = 0; i+j<block_end; j++) out[i+j] = rest_out[j];
+            }
+#else
+            for (int i = block_begin; i<block_end; i++)
+            {
+                out[i] = const_cast<Noise3D*>(this)->sample(in[i]);
+            }
+#endif
+        }
+    });
+}
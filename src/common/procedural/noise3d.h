@@ -5,6 +5,8 @@
 #include "../../dep/vecmath/vectormath_aos.h"
 namespace vmath = Vectormath::Aos;
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 // TODO: Template this on dimension size NoiseND<int N>
@@ -12,17 +14,45 @@ namespace vmath = Vectormath::Aos;
 class Noise3D
 {
 public:
-    Noise3D(float width, float height, float min_noise_scale, int seed);
+    // Grid: the lattice values of every level are stored, (2^level + 1)^3 floats per level.
+    // Hashed: the lattice values are computed from the seed and lattice index when sampled, no
+    //         storage. Slower per sample, but the memory does not grow 8x per level.
+    // Both give the same lattice values, so the same noise.
+    enum class Storage {Grid, Hashed};
+
+    // the lattice values are a function of seed only, Noise3D objects with the same arguments are equal
+    Noise3D(float width, float height, float min_noise_scale, unsigned int seed,
+            Storage storage = Storage::Grid);
     ~Noise3D();
 
+    Noise3D(const Noise3D&) = delete;
+    Noise3D &operator=(const Noise3D&) = delete;
+
+    // bytes allocated for the lattice
+    size_t numBytes() const;
+
     float sample(const vmath::Vector3 &point);
+
+    /**
+     * @brief sampleBatch: out[i] = sample(in[i]) for i in [0, n), up to float rounding.
+     *          Four points at a time with SSE2, the cubic weights are computed once per axis
+     *          and the grid indices wrapped with compare masks instead of a modulo. The points
+     *          are split over the thread pool.
+     */
+    void sampleBatch(const vmath::Vector3 *in, float *out, int n) const;
 protected:
     struct ijk {int inds[3];};
     inline ijk ijkFromPoint(const vmath::Vector3 &point, int num_side_pts);
-    inline int localToGlobal(const ijk &indices, int num_side_pts);
+    inline int64_t localToGlobal(const ijk &indices, int num_side_pts);
     inline vmath::Vector3 findGridPtLocation(const ijk &indices, int num_side_pts);
 private:
-    float ** mGridLevels;
+    void sampleFour(const vmath::Vector3 *in, float *out) const;
+    float latticeValue(int i_lvl, int64_t i_global) const;
+
+    Storage mStorage;
+    unsigned int mSeed;
+
+    float ** mGridLevels; // nullptr for Hashed
     int mNumGridLevels;
 
     float mMaxDim;
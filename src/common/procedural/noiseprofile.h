@@ -0,0 +1,69 @@
+#ifndef NOISEPROFILE_H
+#define NOISEPROFILE_H
+
+#include "../macro/macroprofile.h"
+#include "counterrng.h"
+#include "noise3d.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace Procedural {
+
+/**
+ * @brief profileNoise3D: Compares the Grid and Hashed storage of Noise3D on n_points points
+ *          on a sphere of radius, the way the planet stages sample it. Prints construction
+ *          time, lattice memory, batch sampling throughput and the largest difference between
+ *          the two.
+ */
+inline void profileNoise3D(float radius = 6000.0f, float min_noise_scale = 300.0f, int n_points = 1 << 20)
+{
+    // uniform points on the sphere
+    CounterRng rng(1, RngStage::PointSampling);
+    std::vector<vmath::Vector3> points(n_points);
+    for (int i = 0; i<n_points; i++)
+    {
+        float z = rng.uniform(i, 0, -1.0f, 1.0f);
+        float angle = rng.uniform(i, 1, 0.0f, 6.2831853f);
+        float r = std::sqrt(std::max(0.0f, 1.0f - z*z));
+        points[i] = radius*vmath::Vector3(r*std::cos(angle), r*std::sin(angle), z);
+    }
+
+    float width = 2.2f*radius;
+    std::vector<float> grid_samples(n_points);
+    std::vector<float> hashed_samples(n_points);
+
+    auto report = [n_points](const char *name, const Noise3D &noise, std::chrono::high_resolution_clock::duration time)
+    {
+        double seconds = std::chrono::duration<double>(time).count();
+        std::cout << name << ": " << noise.numBytes()/double(1 << 20) << " MB, "
+                  << n_points/seconds*1e-6 << " million samples per second" << std::endl;
+    };
+
+    PROFILE_BEGIN(noise3d_grid_construct)
+    Noise3D grid_noise(width, width, min_noise_scale, 1, Noise3D::Storage::Grid);
+    PROFILE_END(noise3d_grid_construct)
+
+    PROFILE_BEGIN(noise3d_hashed_construct)
+    Noise3D hashed_noise(width, width, min_noise_scale, 1, Noise3D::Storage::Hashed);
+    PROFILE_END(noise3d_hashed_construct)
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    grid_noise.sampleBatch(points.data(), grid_samples.data(), n_points);
+    report("grid", grid_noise, std::chrono::high_resolution_clock::now() - begin);
+
+    begin = std::chrono::high_resolution_clock::now();
+    hashed_noise.sampleBatch(points.data(), hashed_samples.data(), n_points);
+    report("hashed", hashed_noise, std::chrono::high_resolution_clock::now() - begin);
+
+    float max_difference = 0.0f;
+    for (int i = 0; i<n_points; i++) max_difference = std::max(max_difference, std::abs(grid_samples[i] - hashed_samples[i]));
+    std::cout << "largest grid/hashed difference: " << max_difference << std::endl;
+}
+
+} // namespace Procedural
+
+#endif // NOISEPROFILE_H
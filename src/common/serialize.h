@@ -34,14 +34,23 @@
 #include <fstream>
 #include <istream>
 #include <iterator>
+#include <type_traits>
 
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 
 namespace Serial
 {
 
 typedef std::vector<uint8_t> StreamType;
 
+// Element types that are written as their raw bytes, so that a vector of them is copied with
+// a single memcpy. Specialize to true for plain data types that are not trivially copyable in
+// the language sense, like vector math types with a user defined copy constructor.
+template <class T>
+struct is_bitwise_serializable : std::integral_constant<bool, std::is_trivially_copyable<T>::value> {};
+
 template <class T>
 inline void serialize(const T&, StreamType&);
 
@@ -63,6 +72,14 @@ struct get_size_helper;
 template <class T>
 struct get_size_helper<std::vector<T>> {
     static size_t value(const std::vector<T>& obj) {
+        return value(obj, is_bitwise_serializable<T>());
+    }
+
+    static size_t value(const std::vector<T>& obj, std::true_type) {
+        return sizeof(size_t) + obj.size()*sizeof(T);
+    }
+
+    static size_t value(const std::vector<T>& obj, std::false_type) {
         return std::accumulate(obj.begin(), obj.end(), sizeof(size_t),
                                [](const size_t& acc, const T& cur) { return acc+get_size(cur); });
     }
@@ -166,6 +183,16 @@ struct serialize_helper<std::vector<T>> {
     static void apply(const std::vector<T>& obj, StreamType::iterator& res) {
         // store the number of elements of this vector at the beginning
         serializer(obj.size(), res);
+        apply_elements(obj, res, is_bitwise_serializable<T>());
+    }
+
+    static void apply_elements(const std::vector<T>& obj, StreamType::iterator& res, std::true_type) {
+        if (obj.empty()) return;
+        std::memcpy(&*res, obj.data(), obj.size()*sizeof(T));
+        res += obj.size()*sizeof(T);
+    }
+
+    static void apply_elements(const std::vector<T>& obj, StreamType::iterator& res, std::false_type) {
         for(const auto& cur : obj) { serializer(cur, res); }
     }
 
@@ -240,6 +267,25 @@ struct deserialize_helper<std::vector<T>> {
         // retrieve the number of elements
         size_t size = deserialize_helper<size_t>::apply(begin,end);
 
+        return apply_elements(size, begin, end, is_bitwise_serializable<T>());
+    }
+
+    static std::vector<T> apply_elements(size_t size, StreamType::const_iterator& begin,
+                                         StreamType::const_iterator end, std::true_type)
+    {
+        if (size > size_t(end-begin)/sizeof(T))
+            throw "serialization failure, corrupt stream?";
+
+        std::vector<T> vect(size);
+        if (size == 0) return vect;
+        std::memcpy(static_cast<void*>(vect.data()), &*begin, size*sizeof(T));
+        begin += size*sizeof(T);
+        return vect;
+    }
+
+    static std::vector<T> apply_elements(size_t size, StreamType::const_iterator& begin,
+                                         StreamType::const_iterator end, std::false_type)
+    {
         std::vector<T> vect(size);
         for(size_t i=0; i<size; ++i) {
             vect[i] = std::move(deserialize_helper<T>::apply(begin,end));
@@ -321,43 +367,317 @@ inline T deserialize(const StreamType& res) {
     return deserialize<T>(it, res.end());
 }
 
+////////////////////////////
+// Streaming file access  //
+////////////////////////////
+
+/**
+ * @brief The FileWriter class: buffered writes straight to a file, so an object can be saved
+ *          without building its whole StreamType in memory first. Writes larger than the
+ *          buffer bypass it. The bytes are the same as serialize() would produce.
+ */
+class FileWriter
+{
+public:
+    explicit FileWriter(const std::string &filename) : mUsed(0)
+    {
+        // unbuffered, the chunks are collected in mBuffer instead
+        mFile.rdbuf()->pubsetbuf(nullptr, 0);
+        mFile.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!mFile) throw "serialization failure, could not open file for writing";
+        mBuffer.resize(CHUNK_SIZE);
+    }
+
+    ~FileWriter()
+    {
+        if (mFile.is_open()) { write_file(mBuffer.data(), mUsed); }
+    }
+
+    FileWriter(const FileWriter&) = delete;
+    FileWriter &operator=(const FileWriter&) = delete;
+
+    void write(const void *data, size_t size)
+    {
+        const uint8_t *bytes = static_cast<const uint8_t*>(data);
+        if (mUsed + size > mBuffer.size())
+        {
+            flush();
+            if (size >= mBuffer.size()) { write_file(bytes, size); check(); return; }
+        }
+        std::memcpy(mBuffer.data() + mUsed, bytes, size);
+        mUsed += size;
+    }
+
+    // flush and close, throws if anything could not be written
+    void close()
+    {
+        flush();
+        mFile.close();
+        check();
+    }
+
+private:
+    static const size_t CHUNK_SIZE = 1 << 20;
+
+    std::ofstream mFile;
+    std::vector<uint8_t> mBuffer;
+    size_t mUsed;
+
+    void flush()
+    {
+        write_file(mBuffer.data(), mUsed);
+        mUsed = 0;
+        check();
+    }
+
+    void write_file(const uint8_t *data, size_t size)
+    {
+        mFile.write(reinterpret_cast<const char*>(data), std::streamsize(size));
+    }
+
+    void check() const
+    {
+        if (mFile.fail()) throw "serialization failure, could not write file";
+    }
+};
+
+/**
+ * @brief The FileReader class: buffered reads straight from a file, the counterpart of
+ *          FileWriter. Reads larger than the buffer bypass it. Knows how many bytes are left,
+ *          so element counts read from a damaged file are caught before they are allocated.
+ */
+class FileReader
+{
+public:
+    explicit FileReader(const std::string &filename) : mBegin(0), mEnd(0)
+    {
+        mFile.rdbuf()->pubsetbuf(nullptr, 0);
+        mFile.open(filename, std::ios::in | std::ios::binary);
+        if (!mFile) throw "serialization failure, could not open file for reading";
+
+        mFile.seekg(0, std::ios::end);
+        mRemaining = size_t(mFile.tellg());
+        mFile.seekg(0, std::ios::beg);
+        mBuffer.resize(CHUNK_SIZE);
+    }
+
+    FileReader(const FileReader&) = delete;
+    FileReader &operator=(const FileReader&) = delete;
+
+    // bytes not read yet
+    size_t remaining() const {return mRemaining;}
+
+    void read(void *data, size_t size)
+    {
+        if (size > mRemaining) throw "serialization failure, corrupt stream?";
+        mRemaining -= size;
+
+        uint8_t *bytes = static_cast<uint8_t*>(data);
+
+        // whatever is left in the buffer first
+        size_t buffered = std::min(size, mEnd - mBegin);
+        std::memcpy(bytes, mBuffer.data() + mBegin, buffered);
+        mBegin += buffered;
+        bytes += buffered;
+        size -= buffered;
+        if (size == 0) return;
+
+        if (size >= mBuffer.size())
+        {
+            read_file(bytes, size);
+            return;
+        }
+
+        // refill, the remaining count was checked above so this does not read past the end
+        size_t refill = std::min(mBuffer.size(), mRemaining + size);
+        read_file(mBuffer.data(), refill);
+        std::memcpy(bytes, mBuffer.data(), size);
+        mBegin = size;
+        mEnd = refill;
+    }
+
+private:
+    static const size_t CHUNK_SIZE = 1 << 20;
+
+    std::ifstream mFile;
+    std::vector<uint8_t> mBuffer;
+    size_t mBegin;
+    size_t mEnd;
+    size_t mRemaining;
+
+    void read_file(uint8_t *data, size_t size)
+    {
+        mFile.read(reinterpret_cast<char*>(data), std::streamsize(size));
+        if (size_t(mFile.gcount()) != size) throw "serialization failure, corrupt stream?";
+    }
+};
+
+template <class T>
+inline void serialize(const T&, FileWriter&);
+
+template <class T>
+inline T deserialize(FileReader&);
+
+namespace detail {
+
+template <class T>
+struct write_helper {
+    static void apply(const T& obj, FileWriter& out) { out.write(&obj, sizeof(T)); }
+};
+
+template <class T>
+struct write_helper<std::vector<T>> {
+    static void apply(const std::vector<T>& obj, FileWriter& out) {
+        size_t size = obj.size();
+        out.write(&size, sizeof(size));
+        apply_elements(obj, out, is_bitwise_serializable<T>());
+    }
+
+    static void apply_elements(const std::vector<T>& obj, FileWriter& out, std::true_type) {
+        out.write(static_cast<const void*>(obj.data()), obj.size()*sizeof(T));
+    }
+
+    static void apply_elements(const std::vector<T>& obj, FileWriter& out, std::false_type) {
+        for(const auto& cur : obj) { serialize(cur, out); }
+    }
+};
+
+template <>
+struct write_helper<std::string> {
+    static void apply(const std::string& obj, FileWriter& out) {
+        size_t size = obj.length();
+        out.write(&size, sizeof(size));
+        out.write(obj.data(), size);
+    }
+};
+
+template <class tuple_type>
+inline void write_tuple(const tuple_type&, FileWriter&, int_<size_t(-1)>) {}
+
+template <class tuple_type, size_t pos>
+inline void write_tuple(const tuple_type& obj, FileWriter& out, int_<pos>) {
+    constexpr size_t idx = std::tuple_size<tuple_type>::value-pos-1;
+    serialize(std::get<idx>(obj), out);
+    write_tuple(obj, out, int_<pos-1>());
+}
+
+template <class... T>
+struct write_helper<std::tuple<T...>> {
+    static void apply(const std::tuple<T...>& obj, FileWriter& out) {
+        write_tuple(obj, out, int_<sizeof...(T)-1>());
+    }
+};
+
+template <class T>
+struct read_helper {
+    static T apply(FileReader& in) {
+        T val;
+        in.read(&val, sizeof(T));
+        return val;
+    }
+};
+
+template <class T>
+struct read_helper<std::vector<T>> {
+    static std::vector<T> apply(FileReader& in) {
+        size_t size = read_helper<size_t>::apply(in);
+        return apply_elements(size, in, is_bitwise_serializable<T>());
+    }
+
+    static std::vector<T> apply_elements(size_t size, FileReader& in, std::true_type) {
+        if (size > in.remaining()/sizeof(T))
+            throw "serialization failure, corrupt stream?";
+
+        std::vector<T> vect(size);
+        in.read(static_cast<void*>(vect.data()), size*sizeof(T));
+        return vect;
+    }
+
+    static std::vector<T> apply_elements(size_t size, FileReader& in, std::false_type) {
+        std::vector<T> vect;
+        for(size_t i=0; i<size; ++i) { vect.push_back(deserialize<T>(in)); }
+        return vect;
+    }
+};
+
+template <>
+struct read_helper<std::string> {
+    static std::string apply(FileReader& in) {
+        size_t size = read_helper<size_t>::apply(in);
+        if (size > in.remaining())
+            throw "serialization failure, corrupt stream?";
+
+        std::string str(size, '\0');
+        if (size > 0) in.read(&str[0], size);
+        return str;
+    }
+};
+
+template <class tuple_type>
+inline void read_tuple(tuple_type&, FileReader&, int_<size_t(-1)>) {}
+
+template <class tuple_type, size_t pos>
+inline void read_tuple(tuple_type& obj, FileReader& in, int_<pos>) {
+    constexpr size_t idx = std::tuple_size<tuple_type>::value-pos-1;
+    typedef typename std::tuple_element<idx,tuple_type>::type T;
+    std::get<idx>(obj) = deserialize<T>(in);
+    read_tuple(obj, in, int_<pos-1>());
+}
+
+template <class... T>
+struct read_helper<std::tuple<T...>> {
+    static std::tuple<T...> apply(FileReader& in) {
+        std::tuple<T...> ret;
+        read_tuple(ret, in, int_<sizeof...(T)-1>());
+        return ret;
+    }
+};
+
+} // end detail namespace
+
+template <class T>
+inline void serialize(const T& obj, FileWriter& out) {
+    detail::write_helper<T>::apply(obj, out);
+}
+
+template <class T>
+inline T deserialize(FileReader& in) {
+    return detail::read_helper<T>::apply(in);
+}
+
 inline void write_to_file(const StreamType& res, const std::string &filename)
 {
-    // write file
-    std::ofstream output_file(filename, std::ios::out | std::ios::binary);
-    output_file.write((char*)&res[0], res.size() * sizeof(uint8_t));
-    output_file.close();
+    FileWriter out(filename);
+    out.write(res.data(), res.size());
+    out.close();
 }
 
+// streams obj to the file without building it in memory first
 template <class T>
 inline void serialize_to_file(const T &obj, const std::string &filename)
 {
-    StreamType res;
-    serialize(obj, res);
+    FileWriter out(filename);
+    serialize(obj, out);
+    out.close();
+}
 
-    write_to_file(res, filename);
+template <class T>
+inline T deserialize_from_file(const std::string &filename)
+{
+    FileReader in(filename);
+    return deserialize<T>(in);
 }
 
 inline StreamType read_from_file_stream(std::ifstream &file)
 {
-    // Stop eating new lines in binary mode!!!
-    file.unsetf(std::ios::skipws);
-
     // get its size:
-    std::streampos fileSize;
-
     file.seekg(0, std::ios::end);
-    fileSize = file.tellg();
+    std::streampos fileSize = file.tellg();
     file.seekg(0, std::ios::beg);
 
-    // reserve capacity
-    StreamType res;
-    res.reserve(fileSize);
-
-    // read the data:
-    res.insert(res.begin(),
-               std::istream_iterator<uint8_t>(file),
-               std::istream_iterator<uint8_t>());
+    // read the data in one go
+    StreamType res(fileSize);
+    file.read(reinterpret_cast<char*>(res.data()), res.size());
 
     return res;
 }
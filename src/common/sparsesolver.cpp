@@ -0,0 +1,218 @@
+#include "sparsesolver.h"
+
+#include "macro/macrodebugassert.h"
+#include "threads/parallelfor.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Sparse
+{
+
+namespace
+{
+
+const int SUM_BLOCK_SIZE = 4096;
+
+// sum of func(i) for i in [0, n), func may also update entry i. The blocks are summed in
+// order, so the result is the same for any number of threads.
+template<typename F>
+double blockedSum(int n, F func)
+{
+    int n_blocks = (n + SUM_BLOCK_SIZE - 1)/SUM_BLOCK_SIZE;
+    std::vector<double> block_sums(n_blocks, 0.0);
+    Threads::parallelFor(0, n_blocks, [&](int begin, int end)
+    {
+        for (int i_block = begin; i_block<end; i_block++)
+        {
+            double sum = 0.0;
+            int block_end = std::min(n, (i_block+1)*SUM_BLOCK_SIZE);
+            for (int i = i_block*SUM_BLOCK_SIZE; i<block_end; i++) sum += func(i);
+            block_sums[i_block] = sum;
+        }
+    });
+
+    double sum = 0.0;
+    for (double block_sum : block_sums) sum += block_sum;
+    return sum;
+}
+
+} // anonymous namespace
+
+CsrMatrix::CsrMatrix(const gfx::IndexLists &adjacency)
+{
+    int n = adjacency.size();
+    offsets.resize(n+1);
+    offsets[0] = 0;
+    for (int i = 0; i<n; i++) offsets[i+1] = offsets[i] + 1 + adjacency[i].size();
+
+    columns.resize(offsets[n]);
+    values.assign(offsets[n], 0.0f);
+    for (int i = 0; i<n; i++)
+    {
+        int *row = &columns[offsets[i]];
+        *row++ = i;
+        for (int j : adjacency[i]) *row++ = j;
+    }
+}
+
+int CsrMatrix::find(int i, int j) const
+{
+    for (int k = offsets[i]; k<offsets[i+1]; k++)
+    {
+        if (columns[k] == j) return k;
+    }
+    return -1;
+}
+
+void CsrMatrix::multiply(const std::vector<float> &x, std::vector<float> &y) const
+{
+    DEBUG_ASSERT(int(x.size()) == size());
+    y.resize(size());
+    Threads::parallelFor(0, size(), [&](int begin, int end)
+    {
+        for (int i = begin; i<end; i++)
+        {
+            float sum = 0.0f;
+            for (int k = offsets[i]; k<offsets[i+1]; k++) sum += values[k]*x[columns[k]];
+            y[i] = sum;
+        }
+    });
+}
+
+CsrMatrix uniformLaplacian(const gfx::IndexLists &adjacency)
+{
+    CsrMatrix L(adjacency);
+    for (int i = 0; i<L.size(); i++)
+    {
+        L.diagonal(i) = float(adjacency[i].size());
+        for (int k = L.offsets[i]+1; k<L.offsets[i+1]; k++) L.values[k] = -1.0f;
+    }
+    return L;
+}
+
+CsrMatrix cotangentLaplacian(const std::vector<vmath::Vector3> &points,
+                             const std::vector<gfx::Triangle> &triangles,
+                             const gfx::MeshTopology &topology,
+                             std::vector<float> &mass)
+{
+    CsrMatrix L(topology.pointPoints());
+    mass.assign(points.size(), 0.0f);
+
+    // every corner adds half its cotangent to the weight of the opposite edge
+    for (int i_t = 0; i_t<int(triangles.size()); i_t++)
+    {
+        const gfx::Triangle &tri = triangles[i_t];
+        float area = 0.5f*vmath::length(vmath::cross(points[tri[1]]-points[tri[0]], points[tri[2]]-points[tri[0]]));
+        for (int j = 0; j<3; j++) mass[tri[j]] += area/3.0f;
+        if (area <= 0.0f) continue;
+
+        for (int j = 0; j<3; j++)
+        {
+            int i_corner = tri[j];
+            int i_a = tri[(j+1)%3];
+            int i_b = tri[(j+2)%3];
+            vmath::Vector3 to_a = points[i_a] - points[i_corner];
+            vmath::Vector3 to_b = points[i_b] - points[i_corner];
+
+            // cot = cos/sin = dot/|cross|, and |cross| is twice the area
+            float half_cot = 0.5f*float(vmath::dot(to_a, to_b))/(2.0f*area);
+
+            int k_ab = L.find(i_a, i_b);
+            int k_ba = L.find(i_b, i_a);
+            DEBUG_ASSERT(k_ab >= 0 && k_ba >= 0);
+            L.values[k_ab] -= half_cot;
+            L.values[k_ba] -= half_cot;
+            L.diagonal(i_a) += half_cot;
+            L.diagonal(i_b) += half_cot;
+        }
+    }
+
+    return L;
+}
+
+SolveResult solveJacobi(const CsrMatrix &A, const std::vector<float> &b, std::vector<float> &x,
+                        const SolveSettings &settings)
+{
+    int n = A.size();
+    x.resize(n, 0.0f);
+
+    double b_norm = std::sqrt(blockedSum(n, [&](int i) {return double(b[i])*b[i];}));
+    if (b_norm == 0.0)
+    {
+        std::fill(x.begin(), x.end(), 0.0f);
+        return {0, 0.0f, true};
+    }
+
+    std::vector<float> ax;
+    SolveResult result = {0, 0.0f, false};
+    for (result.iterations = 0; ; result.iterations++)
+    {
+        A.multiply(x, ax);
+        double r_norm_sqr = blockedSum(n, [&](int i) {float r = b[i] - ax[i]; return double(r)*r;});
+        result.relativeResidual = float(std::sqrt(r_norm_sqr)/b_norm);
+        result.converged = result.relativeResidual <= settings.tolerance;
+        if (result.converged || result.iterations == settings.maxIterations) break;
+
+        Threads::parallelFor(0, n, [&](int begin, int end)
+        {
+            for (int i = begin; i<end; i++) x[i] += (b[i] - ax[i])/A.diagonal(i);
+        });
+    }
+
+    return result;
+}
+
+SolveResult solveConjugateGradient(const CsrMatrix &A, const std::vector<float> &b, std::vector<float> &x,
+                                   const SolveSettings &settings)
+{
+    int n = A.size();
+    x.resize(n, 0.0f);
+
+    double b_norm = std::sqrt(blockedSum(n, [&](int i) {return double(b[i])*b[i];}));
+    if (b_norm == 0.0)
+    {
+        std::fill(x.begin(), x.end(), 0.0f);
+        return {0, 0.0f, true};
+    }
+
+    // r = b - A*x, z = r/diagonal, p = z
+    std::vector<float> r(n), z(n), p(n), ap(n);
+    A.multiply(x, ap);
+    double r_norm_sqr = blockedSum(n, [&](int i) {r[i] = b[i] - ap[i]; return double(r[i])*r[i];});
+    double rz = blockedSum(n, [&](int i) {z[i] = r[i]/A.diagonal(i); p[i] = z[i]; return double(r[i])*z[i];});
+
+    SolveResult result = {0, float(std::sqrt(r_norm_sqr)/b_norm), false};
+    while (true)
+    {
+        result.converged = result.relativeResidual <= settings.tolerance;
+        if (result.converged || result.iterations == settings.maxIterations || rz <= 0.0) break;
+
+        A.multiply(p, ap);
+        double p_ap = blockedSum(n, [&](int i) {return double(p[i])*ap[i];});
+        if (p_ap <= 0.0) break; // not positive definite
+        float alpha = float(rz/p_ap);
+
+        r_norm_sqr = blockedSum(n, [&](int i)
+        {
+            x[i] += alpha*p[i];
+            r[i] -= alpha*ap[i];
+            return double(r[i])*r[i];
+        });
+        double rz_next = blockedSum(n, [&](int i) {z[i] = r[i]/A.diagonal(i); return double(r[i])*z[i];});
+
+        float beta = float(rz_next/rz);
+        rz = rz_next;
+        Threads::parallelFor(0, n, [&](int begin, int end)
+        {
+            for (int i = begin; i<end; i++) p[i] = z[i] + beta*p[i];
+        });
+
+        result.iterations++;
+        result.relativeResidual = float(std::sqrt(r_norm_sqr)/b_norm);
+    }
+
+    return result;
+}
+
+} // namespace Sparse
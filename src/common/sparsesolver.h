@@ -0,0 +1,83 @@
+#ifndef SPARSESOLVER_H
+#define SPARSESOLVER_H
+
+#include <vector>
+
+#include "gfx_primitives.h"
+#include "meshtopology.h"
+
+namespace Sparse
+{
+
+/**
+ * @brief The CsrMatrix class: square sparse matrix in compressed sparse row form, with the
+ *          sparsity of a point adjacency plus the diagonal. Row i holds the diagonal first,
+ *          then the neighbors in adjacency order.
+ */
+class CsrMatrix
+{
+public:
+    CsrMatrix() {}
+    explicit CsrMatrix(const gfx::IndexLists &adjacency);
+
+    int size() const {return int(offsets.size())-1;}
+
+    float diagonal(int i) const {return values[offsets[i]];}
+    float &diagonal(int i) {return values[offsets[i]];}
+
+    // index into values of entry (i, j), -1 if it is not stored
+    int find(int i, int j) const;
+
+    // y = A*x, rows split over the thread pool
+    void multiply(const std::vector<float> &x, std::vector<float> &y) const;
+
+    std::vector<int> offsets;
+    std::vector<int> columns;
+    std::vector<float> values;
+};
+
+// L = D - A of the graph, every edge weight 1
+CsrMatrix uniformLaplacian(const gfx::IndexLists &adjacency);
+
+// the cotangent Laplacian of a triangle mesh, weights (cot(alpha) + cot(beta))/2 from the
+// angles opposite each edge. mass gets the lumped vertex areas, a third of each adjacent
+// triangle, for solving in meters instead of graph hops.
+CsrMatrix cotangentLaplacian(const std::vector<vmath::Vector3> &points,
+                             const std::vector<gfx::Triangle> &triangles,
+                             const gfx::MeshTopology &topology,
+                             std::vector<float> &mass);
+
+struct SolveSettings
+{
+    SolveSettings() : maxIterations(1000), tolerance(1e-4f) {}
+
+    int maxIterations;
+    float tolerance;    // stop when |b - A*x| <= tolerance*|b|
+};
+
+struct SolveResult
+{
+    int iterations;
+    float relativeResidual;
+    bool converged;
+};
+
+/**
+ * @brief solveJacobi: Jacobi iterations for A*x = b, A with a nonzero diagonal, diagonally
+ *          dominant to converge. x is the start value, so a previous solution warm starts it.
+ */
+SolveResult solveJacobi(const CsrMatrix &A, const std::vector<float> &b, std::vector<float> &x,
+                        const SolveSettings &settings = SolveSettings());
+
+/**
+ * @brief solveConjugateGradient: Conjugate gradients with a Jacobi preconditioner for A*x = b,
+ *          A symmetric positive definite. x is the start value, so a previous solution warm
+ *          starts it. The dot products are summed in fixed blocks, the result does not depend
+ *          on the number of threads.
+ */
+SolveResult solveConjugateGradient(const CsrMatrix &A, const std::vector<float> &b, std::vector<float> &x,
+                                   const SolveSettings &settings = SolveSettings());
+
+} // namespace Sparse
+
+#endif // SPARSESOLVER_H
@@ -0,0 +1,57 @@
+#ifndef PARALLELFOR_H
+#define PARALLELFOR_H
+
+#include <algorithm>
+#include <exception>
+#include <future>
+#include <vector>
+
+#include "threadpool.h"
+
+namespace Threads {
+
+// split the index range [begin, end) into contiguous chunks, one per pool thread plus
+// one for the calling thread, and call func(chunk_begin, chunk_end) for each chunk.
+// Returns when all chunks are done. Exceptions thrown by a chunk are rethrown here.
+// The chunk boundaries only decide who does the work, so as long as func writes
+// each index independently the result does not depend on the number of threads.
+template<typename F>
+void parallelFor(ThreadPool &pool, int begin, int end, F func)
+{
+    int n = end - begin;
+    if (n <= 0) return;
+
+    int n_chunks = std::min(pool.size() + 1, n);
+    int chunk_size = (n + n_chunks - 1) / n_chunks;
+
+    std::vector<std::future<void>> futures;
+    futures.reserve(n_chunks);
+
+    // the first chunk runs on the calling thread, the rest go to the pool
+    for (int chunk_begin = begin + chunk_size; chunk_begin < end; chunk_begin += chunk_size)
+    {
+        int chunk_end = std::min(chunk_begin + chunk_size, end);
+        futures.push_back(pool.push([&func, chunk_begin, chunk_end](int /*thread_id*/) {
+            func(chunk_begin, chunk_end);
+        }));
+    }
+
+    // the pool tasks reference func, so always wait for them before leaving
+    std::exception_ptr local_exception;
+    try { func(begin, std::min(begin + chunk_size, end)); }
+    catch (...) { local_exception = std::current_exception(); }
+
+    for (auto &f : futures) f.wait();
+    if (local_exception) std::rethrow_exception(local_exception);
+    for (auto &f : futures) f.get();
+}
+
+template<typename F>
+void parallelFor(int begin, int end, F func)
+{
+    parallelFor(ThreadPool::get(), begin, end, func);
+}
+
+} // namespace Threads
+
+#endif // PARALLELFOR_H
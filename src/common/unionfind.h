@@ -0,0 +1,56 @@
+#ifndef UNIONFIND_H
+#define UNIONFIND_H
+
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "macro/macrodebugassert.h"
+
+namespace stdext {
+
+// disjoint sets of the elements 0 to n-1, union by size with path halving, so a
+// sequence of operations is close to linear
+class union_find
+{
+public:
+    explicit union_find(int n = 0) : parent_(n), size_(n, 1) { std::iota(parent_.begin(), parent_.end(), 0); }
+
+    int size() const { return int(parent_.size()); }
+
+    int find(int i)
+    {
+        DEBUG_ASSERT(i >= 0 && i < size());
+        while (parent_[i] != i)
+        {
+            parent_[i] = parent_[parent_[i]];
+            i = parent_[i];
+        }
+        return i;
+    }
+
+    // returns the root of the merged set
+    int unite(int a, int b)
+    {
+        a = find(a);
+        b = find(b);
+        if (a == b) return a;
+        if (size_[a] < size_[b]) std::swap(a, b);
+        parent_[b] = a;
+        size_[a] += size_[b];
+        return a;
+    }
+
+    bool same(int a, int b) { return find(a) == find(b); }
+
+    // number of elements in the set of i
+    int set_size(int i) { return size_[find(i)]; }
+
+private:
+    std::vector<int> parent_;
+    std::vector<int> size_;
+};
+
+} // namespace stdext
+
+#endif // UNIONFIND_H
@@ -8,8 +8,34 @@
 #include "altplanet/climate/humidity.h"
 #include "altplanet/climate/climate.h"
 #include "altplanet/civ/civ.h"
+#include "common/meshtopology.h"
+#include "common/filecache.h"
 #include "common/macro/debuglog.h"
 
+// finished planets are cached here, keyed by everything createPlanetData gets and uses
+#define MACRO_STATE_CACHE_DIRECTORY "res/meshes/planets"
+#define MACRO_STATE_CACHE_MAX_BYTES (1024ull*1024ull*1024ull)
+
+// Part of the planet cache key, together with AltPlanet::GEOMETRY_PIPELINE_VERSION. Bump it
+// whenever the stages below the geometry change what they output.
+static const unsigned int MACRO_STATE_PIPELINE_VERSION = 1;
+
+// Huge planets are drawn and collided through PlanetChunks instead of as one mesh. The planet
+// triangles are the far field and the patches around the focus refine to a few meters.
+static void createSurfaceChunks(state::MacroState &macro_state)
+{
+    AltPlanet::PlanetChunks::Settings settings;
+    settings.chunkSplits = 2;
+    settings.maxLevel = 8;
+    settings.reselectDistance = 4.0f;
+
+    macro_state.surface_chunks.reset(new AltPlanet::PlanetChunks(macro_state.alt_planet_points,
+                                                                 macro_state.alt_planet_triangles,
+                                                                 macro_state.clim_mat_texco,
+                                                                 *macro_state.planet_base_shape,
+                                                                 settings));
+}
+
 Ptr::OwningPtr<state::MacroState> createPlanetData(PlanetShape planet_shape_selector, PlanetSize planet_size_selector, int planet_seed)
 {
 #ifdef PROFILE
@@ -18,11 +44,10 @@ Ptr::OwningPtr<state::MacroState> createPlanetData(PlanetShape planet_shape_sele
         std::cout << "generating with " << num_pts << " points" << std::endl;
 
         PROFILE_BEGIN(altplanet_generate);
-        auto dummy = AltPlanet::generate(num_pts, planet_shape);
+        auto dummy = AltPlanet::generate(num_pts, planet_shape, planet_seed);
         PROFILE_END(altplanet_generate);
     }
 #endif
-    srand(planet_seed);
 
     // parse input arguments
     AltPlanet::PlanetShape alt_planet_shape = planet_shape_selector == PlanetShape::Sphere ?
@@ -32,21 +57,58 @@ Ptr::OwningPtr<state::MacroState> createPlanetData(PlanetShape planet_shape_sele
 
     unsigned int num_subdivisions = planet_size_selector == PlanetSize::Small  ? 0 :
                                     planet_size_selector == PlanetSize::Medium ? 1 :
-                                /*planet_size_selector == PlanetSize::Large  ?*/ 2 ;
+                                    planet_size_selector == PlanetSize::Large  ? 2 :
+                                /*planet_size_selector == PlanetSize::Huge   ?*/ 0 ; // refined by the surface chunks
 
     float planet_scale_factor  = planet_size_selector == PlanetSize::Small  ?     1200.0f : // gives a side length of approx 50 m
                                  planet_size_selector == PlanetSize::Medium ?     2400.0f :
-                                /*planet_size_selector == PlanetSize::Large  ?*/  4800.0f ;
+                                 planet_size_selector == PlanetSize::Large  ?     4800.0f :
+                                /*planet_size_selector == PlanetSize::Huge   ?*/  9600.0f ;
+
+    bool use_surface_chunks = planet_size_selector == PlanetSize::Huge;
 
 //    float planet_scale_factor  = planet_size_selector == PlanetSize::Small  ?     1.0f :
 //                                 planet_size_selector == PlanetSize::Medium ?     1.0f :
 //                                /*planet_size_selector == PlanetSize::Large  ?*/  1.0f ;
 
 
+    // blue noise points need no relaxation, generating is about ten times faster than with
+    // relaxed random points and the triangulation has no stars to reconcile
+    AltPlanet::PointSampling point_sampling = AltPlanet::PointSampling::PoissonDisk;
+
+    Serial::StreamType cache_key;
+    Serial::serialize(std::make_tuple(AltPlanet::GEOMETRY_PIPELINE_VERSION, MACRO_STATE_PIPELINE_VERSION,
+                                      static_cast<int>(alt_planet_shape), num_subdivisions, planet_scale_factor,
+                                      planet_seed, static_cast<int>(point_sampling)), cache_key);
+    FileCache::Directory cache(MACRO_STATE_CACHE_DIRECTORY, MACRO_STATE_CACHE_MAX_BYTES);
+
+    // try to load the finished planet. The arrays are checked in place rather than through the
+    // checksums, then copied out once: the renderer, the physics and the map take the state
+    // as vectors and keep it for the whole game.
+    {
+        Archive::MappedFile cache_entry;
+        state::MacroStateView cached_state;
+        if (cache.load(cache_key, cache_entry, false) && state::viewFromArchive(cache_entry, cached_state))
+        {
+            if (cached_state.isConsistent())
+            {
+                std::cout << "loaded planet from cache" << std::endl;
+                state::MacroState *macro_state = new state::MacroState();
+                cached_state.copyTo(*macro_state);
+                macro_state->planet_base_shape = AltPlanet::createPlanetShape(alt_planet_shape, planet_scale_factor);
+                macro_state->planet_seed = planet_seed;
+                if (use_surface_chunks) createSurfaceChunks(*macro_state);
+                return Ptr::OwningPtr<state::MacroState>(macro_state);
+            }
+            std::cout << "damaged planet in cache" << std::endl;
+        }
+    }
+
     // Alt planet
     AltPlanet::PlanetGeometry alt_planet_geometry;
     AltPlanet::Shape::BaseShape * planet_shape_ptr = nullptr;
-    AltPlanet::createOrLoadPlanetGeom(alt_planet_geometry, planet_shape_ptr, alt_planet_shape, planet_scale_factor);
+    AltPlanet::createOrLoadPlanetGeom(alt_planet_geometry, planet_shape_ptr, alt_planet_shape, planet_scale_factor, planet_seed,
+                                      point_sampling);
 
     AltPlanet::Shape::BaseShape &planet_shape = *planet_shape_ptr;
 
@@ -62,14 +124,21 @@ Ptr::OwningPtr<state::MacroState> createPlanetData(PlanetShape planet_shape_sele
         AltPlanet::subdivideOnce(alt_planet_geometry.points, alt_planet_geometry.triangles);
 
         // jitter the points around a bit...
-        AltPlanet::jitterPoints(alt_planet_geometry.points, alt_planet_geometry.triangles);
+        gfx::MeshTopology subdivided_topology(alt_planet_geometry.points.size(), alt_planet_geometry.triangles);
+        AltPlanet::jitterPoints(alt_planet_geometry.points, subdivided_topology, planet_seed, i);
 
         // reproject points
         AltPlanet::reproject(alt_planet_geometry.points, planet_shape);
 
     }
 
-    AltPlanet::perturbHeightNoise3D(alt_planet_geometry.points, planet_shape);
+    AltPlanet::perturbHeightNoise3D(alt_planet_geometry.points, planet_shape, planet_seed);
+
+    // the points are final, the stages below read their heights and normals from here
+    alt_planet_geometry.surface = AltPlanet::computeSurfaceFrames(alt_planet_geometry.points, planet_shape);
+
+    // the connectivity is final from here on, shared by all the stages below
+    gfx::MeshTopology alt_planet_topology(alt_planet_geometry.points.size(), alt_planet_geometry.triangles);
 
     std::vector<vmath::Vector3> &alt_planet_points = alt_planet_geometry.points;
     std::vector<gfx::Triangle> &alt_planet_triangles = alt_planet_geometry.triangles;
@@ -94,20 +163,25 @@ Ptr::OwningPtr<state::MacroState> createPlanetData(PlanetShape planet_shape_sele
     // Generate the planet water system
     float planet_ocean_fraction = 0.55f;
     int num_river_springs = 100;
-    auto water_geometry = AltPlanet::WaterSystem::generateWaterSystem(alt_planet_geometry, planet_shape,
+    auto water_geometry = AltPlanet::WaterSystem::generateWaterSystem(alt_planet_geometry, alt_planet_topology, planet_shape,
                                                                       planet_ocean_fraction,
-                                                                      num_river_springs);
+                                                                      num_river_springs,
+                                                                      planet_seed);
 
     // Generate planet irradiance map
     std::vector<vmath::Vector3> alt_planet_normals;
-    gfx::generateNormals(&alt_planet_normals, alt_planet_points, alt_planet_triangles);
+    gfx::generateNormals(&alt_planet_normals, alt_planet_points, alt_planet_triangles, alt_planet_topology);
 
     float planet_tilt = 0.408407f; // radians, same as earth
+    // the inner side of the torus ring is shaded by the ring itself, a sphere only by its terrain
+    AltPlanet::Irradiance::Method irradiance_method = alt_planet_shape == AltPlanet::PlanetShape::Torus ?
+                AltPlanet::Irradiance::Method::Shadowed : AltPlanet::Irradiance::Method::Analytic;
     std::vector<float> alt_planet_irradiance = AltPlanet::Irradiance::irradianceYearMean(
                 alt_planet_points,
                 alt_planet_normals,
                 alt_planet_triangles,
-                planet_tilt);
+                planet_tilt,
+                irradiance_method);
 
     // check the irradiance
     float max = std::numeric_limits<float>::min();
@@ -123,7 +197,8 @@ Ptr::OwningPtr<state::MacroState> createPlanetData(PlanetShape planet_shape_sele
     std::cout << "irradiance info" << min << ", " << mean << ", " << max << std::endl;
 
     // planet humidity
-    std::vector<float> alt_planet_humidity = AltPlanet::Humidity::humidityYearMean(alt_planet_points, planet_shape);
+    std::vector<float> alt_planet_humidity = AltPlanet::Humidity::humidityYearMean(alt_planet_points, alt_planet_triangles, alt_planet_topology,
+                                                                                   water_geometry.landWaterTypes, planet_shape, planet_seed);
 
     // texcos
     std::vector<gfx::TexCoords> alt_planet_texcoords = planet_shape.getUV(alt_planet_points);
@@ -131,30 +206,40 @@ Ptr::OwningPtr<state::MacroState> createPlanetData(PlanetShape planet_shape_sele
 
 
     // resources
-    std::vector<AltPlanet::Civ::Resource> resources = AltPlanet::Civ::distributeResources(alt_planet_geometry.points, water_geometry.landWaterTypes);
+    std::vector<AltPlanet::Civ::Resource> resources = AltPlanet::Civ::distributeResources(alt_planet_geometry.points, water_geometry.landWaterTypes, planet_seed);
 
-    return Ptr::OwningPtr<state::MacroState>(
-        new state::MacroState{
-            alt_planet_geometry.points,
-            alt_planet_geometry.triangles,
+    state::MacroState *macro_state = new state::MacroState{
+        alt_planet_geometry.points,
+        alt_planet_geometry.triangles,
 
-            water_geometry.ocean.points,
-            water_geometry.ocean.triangles,
+        water_geometry.ocean.points,
+        water_geometry.ocean.triangles,
 
-            water_geometry.freshwater.lakes.points,
-            water_geometry.freshwater.lakes.triangles,
-            water_geometry.freshwater.rivers.lines,
+        water_geometry.freshwater.lakes.points,
+        water_geometry.freshwater.lakes.triangles,
+        water_geometry.freshwater.lakes.bodies,
+        water_geometry.freshwater.lakes.pointLakes,
+        water_geometry.freshwater.rivers.lines,
 
-            alt_planet_texcoords,
-            clim_mat_texco,
+        alt_planet_texcoords,
+        clim_mat_texco,
 
-            water_geometry.landWaterTypes,
+        water_geometry.landWaterTypes,
 
-            planet_shape_ptr,
+        planet_shape_ptr,
 
-            resources
-        }
-    );
+        resources,
+
+        planet_seed
+    };
+
+    Archive::Writer cache_writer;
+    state::addToArchive(cache_writer, *macro_state);
+    if (!cache.store(cache_key, cache_writer)) std::cout << "could not cache the planet" << std::endl;
+
+    if (use_surface_chunks) createSurfaceChunks(*macro_state);
+
+    return Ptr::OwningPtr<state::MacroState>(macro_state);
 }
 
 
@@ -184,7 +269,45 @@ inline gfx::SceneObjectHandle add_trivial_object(const std::vector<vmath::Vector
     return scene_node->addSceneObject(geometry, material);
 }
 
-void createScene(gfx::SceneNodeHandle scene_root_hdl, Ptr::ReadPtr<state::MacroState> scene_data, float &cam_view_distance)
+gfx::Material createClimateMaterial()
+{
+    //auto climate_zone_tex = AltPlanet::Climate::createClimatePixels();
+    auto climate_tex = AltPlanet::Climate::createClimateColorPixels();
+
+    return gfx::Material(static_cast<void*>(&climate_tex.pixels[0]),
+                         climate_tex.w, climate_tex.h, gfx::gl_type(GL_FLOAT), gfx::Texture::filter::linear);
+}
+
+gfx::Geometry createSurfaceChunksGeometry(const std::vector<std::shared_ptr<const AltPlanet::PlanetChunk>> &chunks)
+{
+    std::vector<vmath::Vector4> position_data;
+    std::vector<vmath::Vector4> normal_data;
+    std::vector<gfx::TexCoords> texcoord_data;
+    std::vector<gfx::Triangle> triangles;
+
+    for (const auto &chunk : chunks)
+    {
+        int offset = position_data.size();
+        for (int i = 0; i<chunk->points.size(); i++)
+        {
+            position_data.push_back((const vmath::Vector4&)(chunk->points[i]));
+            position_data.back().setW(1.0f);
+            normal_data.push_back((const vmath::Vector4&)(chunk->normals[i]));
+            normal_data.back().setW(0.0f);
+        }
+        texcoord_data.insert(texcoord_data.end(), chunk->texcoords.begin(), chunk->texcoords.end());
+
+        for (const gfx::Triangle &tri : chunk->triangles)
+        {
+            triangles.push_back({tri[0]+offset, tri[1]+offset, tri[2]+offset});
+        }
+    }
+
+    return gfx::Geometry(gfx::Vertices(position_data, normal_data, texcoord_data), gfx::Primitives(triangles));
+}
+
+void createScene(gfx::SceneNodeHandle scene_root_hdl, Ptr::ReadPtr<state::MacroState> scene_data, float &cam_view_distance,
+                 bool add_planet_surface)
 {
     gfx::SceneNode &scene_root = *scene_root_hdl;
     gfx::SceneNodeHandle planet_scene_node = scene_root.addSceneNode();
@@ -237,11 +360,7 @@ void createScene(gfx::SceneNodeHandle scene_root_hdl, Ptr::ReadPtr<state::MacroS
         gfx::Primitives primitives = gfx::Primitives(alt_planet_triangles);
         gfx::Geometry geometry = gfx::Geometry(alt_planet_irr_verts, primitives);*/
 
-        //auto climate_zone_tex = AltPlanet::Climate::createClimatePixels();
-        auto climate_tex = AltPlanet::Climate::createClimateColorPixels();
-
-        gfx::Material material = gfx::Material(static_cast<void*>(&climate_tex.pixels[0]),
-                climate_tex.w, climate_tex.h, gfx::gl_type(GL_FLOAT), gfx::Texture::filter::linear);
+        gfx::Material material = createClimateMaterial();
 
         gfx::Vertices alt_planet_clim_verts = gfx::Vertices(alt_planet_position_data, alt_planet_normal_data, scene_data->clim_mat_texco);
 
@@ -251,6 +370,8 @@ void createScene(gfx::SceneNodeHandle scene_root_hdl, Ptr::ReadPtr<state::MacroS
         return planet_scene_node->addSceneObject(geometry, material);
     })(); // immediately invoked lambda!
 
+    if (!add_planet_surface) alt_planet_triangles_so->toggleVisible();
+
     //alt_planet_triangles_so->setWireframe(true);
 
     // Add planet ocean scene object
@@ -12,7 +12,14 @@ using PlanetSize = events::GenerateWorldEvent::PlanetSize;
 
 Ptr::OwningPtr<state::MacroState> createPlanetData(PlanetShape planet_shape_selector, PlanetSize planet_size_selector, int planet_seed);
 
-void createScene(gfx::SceneNodeHandle scene_root_hdl, Ptr::ReadPtr<state::MacroState> scene_data, float &cam_view_distance);
+// add_planet_surface false hides the planet triangles, for callers drawing MacroState::surface_chunks
+void createScene(gfx::SceneNodeHandle scene_root_hdl, Ptr::ReadPtr<state::MacroState> scene_data, float &cam_view_distance,
+                 bool add_planet_surface = true);
+
+gfx::Material createClimateMaterial();
+
+// one geometry for a set of surface chunks, with climate texture coordinates
+gfx::Geometry createSurfaceChunksGeometry(const std::vector<std::shared_ptr<const AltPlanet::PlanetChunk>> &chunks);
 
 void createMap(gfx::SceneNodeHandle scene_root_hdl, Ptr::ReadPtr<state::MacroState> scene_data);
 
@@ -11,6 +11,9 @@ ClientState::ClientState(state::SceneCreationInfo &new_game_info) :
    mFrame(0)
 {
     // ctor
+    // the scene and the physics start from a complete selection around the landing point
+    if (mMacroStatePtr->surface_chunks) mMacroStatePtr->surface_chunks->finish(new_game_info.land_pos);
+
     mGFXSceneManager.initScene(new_game_info.point_above, mMacroStatePtr.getReadPtr(), new_game_info.actors);
     mPhysicsManager.initScene(new_game_info.land_pos, mMacroStatePtr.getReadPtr(), new_game_info.actors);
     mMechanicsManager.initScene(new_game_info.land_pos, mMacroStatePtr.getReadPtr(), new_game_info.actors);
@@ -56,6 +59,15 @@ void ClientState::update(float delta_time_sec)
         mGFXSceneManager.updateCamera(player_orientation, mMacroStatePtr->getLocalUp(getActiveCamera().mTransform.position));
     }
 
+    // refine the surface around the camera, the terrain collision follows the player
+    if (mMacroStatePtr->surface_chunks)
+    {
+        AltPlanet::PlanetChunks &surface_chunks = *mMacroStatePtr->surface_chunks;
+        surface_chunks.update(getActiveCamera().mTransform.position);
+        mGFXSceneManager.updateSurfaceChunks(surface_chunks);
+        mPhysicsManager.updateTerrain(surface_chunks, mMechanicsManager.getPlayerPosition());
+    }
+
 
     /*if (mFrame > 0) {
         DEBUG_LOG("TERMINATING FOR DEBUG");
@@ -3,6 +3,7 @@
 #include "../createscene.h"
 #include "../common/mathext.h"
 #include "../common/macro/debuglog.h"
+#include "../common/procedural/counterrng.h"
 #include "../state/scenecreationinfo.h"
 
 namespace engine {
@@ -234,11 +235,13 @@ void Engine::registerEngineCallbacks()
 
             Ptr::OwningPtr<state::MacroState> scene_data = mNewGameInfoPtr->moveMacroState();
 
-            // find a point on land...
-            int i_point = rand()%scene_data->alt_planet_points.size();
-            while (scene_data->land_water_types[i_point] != AltPlanet::LandWaterType::Land)
+            // find a point on land, the same one every time a planet is played
+            Procedural::CounterRng rng(scene_data->planet_seed, Procedural::RngStage::Spawn);
+            uint32_t n_points = scene_data->alt_planet_points.size();
+            int i_point = rng.below(0, 0, n_points);
+            for (uint64_t i_draw = 1; scene_data->land_water_types[i_point] != AltPlanet::LandWaterType::Land; i_draw++)
             {
-                i_point = rand()%scene_data->alt_planet_points.size();
+                i_point = rng.below(i_draw, 0, n_points);
             }
             vmath::Vector3 land_point = scene_data->alt_planet_points[i_point];
 
@@ -2,6 +2,18 @@
 
 #include "../common/procedural/icosphere.h"
 
+using SurfaceChunks = std::vector<std::shared_ptr<const AltPlanet::PlanetChunk>>;
+
+static std::vector<SurfaceChunks> groupDisplayedChunks(const AltPlanet::PlanetChunks &surface_chunks)
+{
+    std::vector<SurfaceChunks> groups(surface_chunks.numGroups());
+    for (const auto &chunk : surface_chunks.displayedChunks())
+    {
+        groups[surface_chunks.groupOf(chunk->baseTriangle)].push_back(chunk);
+    }
+    return groups;
+}
+
 
 void GFXSceneManager::initScene(const vmath::Vector3 &point_above,
                                 Ptr::ReadPtr<state::MacroState> scene_data,
@@ -10,7 +22,21 @@ void GFXSceneManager::initScene(const vmath::Vector3 &point_above,
     // add stuff to scene
     gfx::SceneNodeHandle world_node = mGFXSceneRoot.addSceneNode();
     float cam_view_distance;
-    createScene(world_node, scene_data, cam_view_distance);
+    createScene(world_node, scene_data, cam_view_distance, !scene_data->surface_chunks);
+
+    if (scene_data->surface_chunks)
+    {
+        const AltPlanet::PlanetChunks &surface_chunks = *scene_data->surface_chunks;
+        gfx::SceneNodeHandle surface_node = world_node->addSceneNode();
+        gfx::Material material = createClimateMaterial();
+
+        for (SurfaceChunks &group_chunks : groupDisplayedChunks(surface_chunks))
+        {
+            gfx::SceneObjectHandle object = surface_node->addSceneObject(createSurfaceChunksGeometry(group_chunks), material);
+            mSurfaceChunkGroups.push_back({object, std::move(group_chunks)});
+        }
+        mSurfaceChunksGeneration = surface_chunks.displayGeneration();
+    }
 
     // set the sun light to be on this side of the planet
     vmath::Vector3 local_up = vmath::normalize(scene_data->planet_base_shape->getGradDir(point_above));
@@ -72,3 +98,19 @@ void GFXSceneManager::updateCamera(const vmath::Quat &player_orientation, const
         mCamera.mTransform = mCameraNodePtr->transform;
     }
 }
+
+void GFXSceneManager::updateSurfaceChunks(const AltPlanet::PlanetChunks &surface_chunks)
+{
+    if (surface_chunks.displayGeneration() == mSurfaceChunksGeneration) return;
+    mSurfaceChunksGeneration = surface_chunks.displayGeneration();
+
+    std::vector<SurfaceChunks> groups = groupDisplayedChunks(surface_chunks);
+    for (int i = 0; i<mSurfaceChunkGroups.size(); i++)
+    {
+        SurfaceChunkGroup &group = mSurfaceChunkGroups[i];
+        if (groups[i] == group.chunks) continue;
+
+        group.object->mGeometry = createSurfaceChunksGeometry(groups[i]);
+        group.chunks = std::move(groups[i]);
+    }
+}
@@ -25,6 +25,15 @@ struct GFXSceneManager
     //PhysTransformContainer      mPhysTransforms;
     Ptr::WritePtr<PhysTransformContainer> mActorTransformsPtr;
 
+    // one scene object per group of planet triangles, when the planet has surface chunks
+    struct SurfaceChunkGroup
+    {
+        gfx::SceneObjectHandle object;
+        std::vector<std::shared_ptr<const AltPlanet::PlanetChunk>> chunks;
+    };
+    std::vector<SurfaceChunkGroup> mSurfaceChunkGroups;
+    unsigned int mSurfaceChunksGeneration;
+
     void initScene(const vmath::Vector3 &point_above,
                    Ptr::ReadPtr<state::MacroState> scene_data,
                    const std::vector<state::Actor> &actors);
@@ -35,6 +44,9 @@ struct GFXSceneManager
     const gfx::SceneNode  inline &getGFXSceneRoot() const { return mGFXSceneRoot; }
 
     void updateCamera(const vmath::Quat &player_orientation, const vmath::Vector3 &local_up);
+
+    // replace the geometry of the groups whose displayed chunks changed
+    void updateSurfaceChunks(const AltPlanet::PlanetChunks &surface_chunks);
 };
 
 inline GFXSceneManager::GFXSceneManager(gfx::Camera &&cam,
@@ -44,7 +56,8 @@ inline GFXSceneManager::GFXSceneManager(gfx::Camera &&cam,
     mGFXSceneRoot(std::move(scene_node)),
     mActorTransformsPtr(actor_transforms_ptr),
     mPlayerNodePtr(nullptr),
-    mCameraNodePtr(nullptr)
+    mCameraNodePtr(nullptr),
+    mSurfaceChunksGeneration(0)
 {
     //ctor
     //auto player_node_hdl = mGFXSceneRoot.addSceneNode();
@@ -59,7 +59,7 @@ struct PlayerUpdateEvent
 struct GenerateWorldEvent
 {
     enum class PlanetShape {Sphere, Disk, Torus};
-    enum class PlanetSize  {Small, Medium, Large};
+    enum class PlanetSize  {Small, Medium, Large, Huge};
 
     PlanetShape planet_shape;
     PlanetSize planet_size;
@@ -203,7 +203,7 @@ void createNewGameMenu(GUI &gui, GUINode &new_game_menu_root)
     GUINodeHandle size_node = newgame_bg_node->addGUINode(
         GUITransform({HorzPos(30.0f, Units::Absolute, HorzAnchor::Left, HorzFrom::Left),
                      VertPos(200.0f, Units::Absolute, VertAnchor::Top, VertFrom::Top)},
-                     {SizeSpec(360.0f, Units::Absolute),
+                     {SizeSpec(480.0f, Units::Absolute),
                       SizeSpec(60.0f, Units::Absolute)} ));
 
     size_node->addElement( TextElement( "World size", font));
@@ -252,6 +252,21 @@ void createNewGameMenu(GUI &gui, GUINode &new_game_menu_root)
                     return sr->planet_size == NewGameMenuState::PlanetSize::Large;
                  });
 
+    createToggle(size_node, "Huge", font,
+                 HorzPos(360.0f, Units::Absolute, HorzAnchor::Left, HorzFrom::Left),
+                 VertPos(30.0f, Units::Absolute, VertAnchor::Top, VertFrom::Top),
+                 90.0f,
+                 [state_handle] ()
+                 {
+                    GUIStateWriter<NewGameMenuState> sw = state_handle.getStateWriter();
+                    sw->planet_size = NewGameMenuState::PlanetSize::Huge;
+                 },
+                 [state_handle] ()
+                 {
+                    GUIStateReader<NewGameMenuState> sr = state_handle.getStateReader();
+                    return sr->planet_size == NewGameMenuState::PlanetSize::Huge;
+                 });
+
     // Bottom buttons
     createButton(newgame_bg_node, "Generate", font,
                  HorzPos(150.0f, Units::Absolute, HorzAnchor::Right, HorzFrom::Right),
@@ -33,6 +33,7 @@
 #include "common/collision/spatialindex3d.h"
 
 #include "physics/euler/euler.h"
+#include "common/procedural/noiseprofile.h"
 
 namespace vmath = Vectormath::Aos;
 
@@ -194,6 +195,10 @@ int main(int argc, char *argv[])
 
     Euler::testAll();
 
+#ifdef PROFILE_NOISE3D
+    Procedural::profileNoise3D();
+#endif
+
     // finish test ====================================================================================================================
 
     bool valgrind_test;
@@ -6,7 +6,9 @@
 PhysicsManager::PhysicsManager(Ptr::WritePtr<PhysTransformContainer> actor_transforms_ptr) :
     mActorTransformsPtr(actor_transforms_ptr),
     mPhysicsSim(Ptr::WritePtr<RigidBodyPool>(&mActorRigidBodies),
-                Ptr::WritePtr<RigidBodyPool>(&mStaticsRigidBodies))//,
+                Ptr::WritePtr<RigidBodyPool>(&mStaticsRigidBodies)),
+    mTerrainBodyHandle(nullptr),
+    mTerrainGeneration(0)//,
     //mEulerPhysicsSimPtr(nullptr)
 {
     // ctor...
@@ -26,8 +28,15 @@ void PhysicsManager::initScene(const vmath::Vector3 &land_point,
 
 
     // add static collision object for world
-    mPhysicsSim.addStaticBodyMesh(vmath::Vector3(0.0f, 0.0f, 0.0f), vmath::Quat(0.0f, 0.0f, 0.0f, 1.0f),
+    if (macro_state_ptr->surface_chunks)
+    {
+        updateTerrain(*macro_state_ptr->surface_chunks, land_point);
+    }
+    else
+    {
+        mPhysicsSim.addStaticBodyMesh(vmath::Vector3(0.0f, 0.0f, 0.0f), vmath::Quat(0.0f, 0.0f, 0.0f, 1.0f),
                                       macro_state_ptr->alt_planet_points, macro_state_ptr->alt_planet_triangles);
+    }
 
    /* mPhysicsSim.addStaticBodyPlane(land_point, vmath::Quat(0.0f, 0.0f, 0.0f, 1.0f),
                                        vmath::normalize(grad_dir));*/
@@ -54,3 +63,34 @@ void PhysicsManager::updateDynamicsGravity(const AltPlanet::Shape::BaseShape *pl
         rb.setGravity((btVector3&)(gravity));
     });
 }
+
+void PhysicsManager::updateTerrain(const AltPlanet::PlanetChunks &surface_chunks, const vmath::Vector3 &focus)
+{
+    if (mTerrainBodyHandle && surface_chunks.displayGeneration() == mTerrainGeneration &&
+        vmath::length(focus - mTerrainFocus) < 0.5f*sTerrainRadius) return;
+
+    std::vector<vmath::Vector3> points;
+    std::vector<gfx::Triangle> triangles;
+    for (const auto &chunk : surface_chunks.displayedChunks())
+    {
+        if (vmath::length(chunk->center - focus) > chunk->radius + sTerrainRadius) continue;
+
+        int offset = points.size();
+        points.insert(points.end(), chunk->points.begin(), chunk->points.end());
+        for (const gfx::Triangle &tri : chunk->triangles)
+        {
+            triangles.push_back({tri[0]+offset, tri[1]+offset, tri[2]+offset});
+        }
+    }
+    if (triangles.empty()) return; // keep the last terrain until chunks get close again
+
+    // add the new body before removing the old one, so there is no frame without ground
+    RigidBodyPoolHandle terrain_body_handle = mPhysicsSim.addStaticBodyMesh(vmath::Vector3(0.0f, 0.0f, 0.0f),
+                                                                            vmath::Quat(0.0f, 0.0f, 0.0f, 1.0f),
+                                                                            points, triangles);
+    if (mTerrainBodyHandle) mPhysicsSim.removeStaticBody(mTerrainBodyHandle);
+
+    mTerrainBodyHandle = terrain_body_handle;
+    mTerrainGeneration = surface_chunks.displayGeneration();
+    mTerrainFocus = focus;
+}
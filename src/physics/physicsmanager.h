@@ -18,6 +18,11 @@ class PhysicsManager
     PhysicsSimulation mPhysicsSim;
     Ptr::WritePtr<PhysTransformContainer> mActorTransformsPtr;
 
+    // static body of the surface chunks around the player, when the planet has them
+    RigidBodyPoolHandle mTerrainBodyHandle;
+    unsigned int mTerrainGeneration;
+    vmath::Vector3 mTerrainFocus;
+
     //Ptr::OwningPtr<Euler::PhysicsSim> mEulerPhysicsSimPtr;
 
 
@@ -33,9 +38,13 @@ public:
 
     void updateDynamicsGravity(const AltPlanet::Shape::BaseShape *planet_shape);
 
+    // collide with the displayed surface chunks close to focus, rebuilt as they change
+    void updateTerrain(const AltPlanet::PlanetChunks &surface_chunks, const vmath::Vector3 &focus);
+
     Ptr::WritePtr<RigidBodyPool> getActorRigidBodyPoolWPtr() { return Ptr::WritePtr<RigidBodyPool>(&mActorRigidBodies); }
 
     static float constexpr sGravityMagnitude = 9.81f;
+    static float constexpr sTerrainRadius = 64.0f;
 };
 
 inline void PhysicsManager::stepPhysicsSimulation(float delta_time_sec)
@@ -128,8 +128,8 @@ void PhysicsSimulation::addDynamicBody(const vmath::Vector3 &pos, const vmath::Q
 }
 
 
-void PhysicsSimulation::addStaticBodyMesh(const vmath::Vector3 &pos, const vmath::Quat &rot,
-                                          const std::vector<vmath::Vector3> &points, const std::vector<gfx::Triangle> &triangles)
+RigidBodyPoolHandle PhysicsSimulation::addStaticBodyMesh(const vmath::Vector3 &pos, const vmath::Quat &rot,
+                                                         const std::vector<vmath::Vector3> &points, const std::vector<gfx::Triangle> &triangles)
 {
     // could use a pool allocator for all these 'new's
     // LIFETIME: Points and triangles need to live longer than this collision-shape!!!
@@ -172,6 +172,8 @@ void PhysicsSimulation::addStaticBodyMesh(const vmath::Vector3 &pos, const vmath
     btRigidBody* body = rb_handle->get_ptr();
 
     mDynamicsWorld->addRigidBody(body);
+
+    return rb_handle;
 }
 
 void PhysicsSimulation::addStaticBodyPlane(const vmath::Vector3 &pos, const vmath::Quat &rot,
@@ -201,6 +203,32 @@ void PhysicsSimulation::addStaticBodyPlane(const vmath::Vector3 &pos, const vmat
 }
 
 
+void PhysicsSimulation::removeStaticBody(RigidBodyPoolHandle rb_handle)
+{
+    btRigidBody* body = rb_handle->get_ptr();
+    btCollisionShape* col_shape = body->getCollisionShape();
+
+    DEBUG_LOG("REMOVING STATIC BODY");
+
+    mDynamicsWorld->removeRigidBody(body);
+    delete body->getMotionState();
+
+    // the mesh triangles are only referenced by this shape, free them after it
+    const btStridingMeshInterface* mesh_interface = nullptr;
+    if (col_shape->getShapeType() == TRIANGLE_MESH_SHAPE_PROXYTYPE)
+    {
+        mesh_interface = static_cast<btBvhTriangleMeshShape*>(col_shape)->getMeshInterface();
+    }
+
+    mCollisionShapes.remove(col_shape);
+    delete col_shape;
+
+    mStaticMeshData.remove_if([&](const btTriangleMesh &mesh) { return &mesh == mesh_interface; });
+
+    mStaticRigidBodiesPtr->destroy(rb_handle);
+}
+
+
 /*
 // void PhysicsWorld::addPhysicsObject(RigidBody::Collision shape, par1=0, par2=0, par3=0, par4=0)
 void PhysicsSubsystem::addPhysicsDynamic(RigidBody* rigidbody, btCollisionShape* shape)
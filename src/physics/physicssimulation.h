@@ -26,8 +26,7 @@ class PhysicsSimulation
     btGhostPairCallback*                    mGhostPairCallback;
     btAlignedObjectArray<btCollisionShape*> mCollisionShapes;
 
-    // lives as long as the simulation, therefore should not keep adding
-    // static data without quitting
+    // triangles of the static meshes, freed by removeStaticBody or with the simulation
     std::list<btTriangleMesh> mStaticMeshData;
 
     Ptr::WritePtr<RigidBodyPool> mActorRigidBodiesPtr;
@@ -42,12 +41,15 @@ public:
 
     void setGravity(const vmath::Vector3 &g);
     void addDynamicBody(const vmath::Vector3 &pos, const vmath::Quat &rot, Shape shape);
-    void addStaticBodyMesh(const vmath::Vector3 &pos, const vmath::Quat &rot,
-                           const std::vector<vmath::Vector3> &points, const std::vector<gfx::Triangle> &triangles);
+    RigidBodyPoolHandle addStaticBodyMesh(const vmath::Vector3 &pos, const vmath::Quat &rot,
+                                          const std::vector<vmath::Vector3> &points, const std::vector<gfx::Triangle> &triangles);
 
     void addStaticBodyPlane(const vmath::Vector3 &pos, const vmath::Quat &rot,
                             const vmath::Vector3 &normal);
 
+    // remove a body added by addStaticBodyMesh or addStaticBodyPlane and free its shape
+    void removeStaticBody(RigidBodyPoolHandle rb_handle);
+
     inline void stepSimulation(float time_delta_sec);
 private:
     btCollisionShape * createMeshShape(const std::vector<vmath::Vector4> &pts, const std::vector<gfx::Triangle> &tris);
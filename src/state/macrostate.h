@@ -2,7 +2,9 @@
 #define MACROSTATE_H
 
 #include "../common/gfx_primitives.h"
+#include "../common/mappedarchive.h"
 #include "../altplanet/planetshapes.h"
+#include "../altplanet/planetchunks.h"
 
 #include "../altplanet/watersystem.h"
 #include "../altplanet/civ/civ.h"
@@ -22,6 +24,8 @@ public:
 
     std::vector<vmath::Vector3> alt_lake_points;
     std::vector<gfx::Triangle> alt_lake_triangles;
+    std::vector<AltPlanet::WaterSystem::WaterGeometry::Freshwater::Lake> alt_lakes; // ranges into the lake arrays above
+    std::vector<int> alt_point_lakes;   // lake of every planet point, -1 if none
     std::vector<gfx::Line> alt_river_lines;
 
     std::vector<gfx::TexCoords> alt_planet_texcoords;
@@ -33,6 +37,12 @@ public:
 
     std::vector<AltPlanet::Civ::Resource> resource_locations;
 
+    int planet_seed; // not archived, part of the cache key
+
+    // level of detail surface, only for planets too large to draw and collide as one mesh.
+    // Built from the arrays and the shape above, not archived.
+    std::unique_ptr<AltPlanet::PlanetChunks> surface_chunks;
+
     // save sparse  and dense data
 
     /*struct Sparse {
@@ -52,13 +62,123 @@ public:
     } dense ;*/
 
     // methods
-    ~MacroState() { delete planet_base_shape; }
+    ~MacroState() { surface_chunks.reset(); delete planet_base_shape; }
 
 
     vmath::Vector3 getLocalUp(const vmath::Vector3 &point) const
     { return vmath::normalize(planet_base_shape->getGradDir(point)); }
 };
 
+// MacroState arrays read in place from a mapped Archive. The planet shape is not part of the
+// archive, the caller recreates it.
+struct MacroStateView
+{
+    Archive::ArrayView<vmath::Vector3> alt_planet_points;
+    Archive::ArrayView<gfx::Triangle> alt_planet_triangles;
+
+    Archive::ArrayView<vmath::Vector3> alt_ocean_points;
+    Archive::ArrayView<gfx::Triangle> alt_ocean_triangles;
+
+    Archive::ArrayView<vmath::Vector3> alt_lake_points;
+    Archive::ArrayView<gfx::Triangle> alt_lake_triangles;
+    Archive::ArrayView<AltPlanet::WaterSystem::WaterGeometry::Freshwater::Lake> alt_lakes;
+    Archive::ArrayView<int> alt_point_lakes;
+    Archive::ArrayView<gfx::Line> alt_river_lines;
+
+    Archive::ArrayView<gfx::TexCoords> alt_planet_texcoords;
+    Archive::ArrayView<gfx::TexCoords> clim_mat_texco;
+
+    Archive::ArrayView<AltPlanet::LandWaterType> land_water_types;
+
+    Archive::ArrayView<AltPlanet::Civ::Resource> resource_locations;
+
+    // check in place that the arrays fit together: every per point array has one element per
+    // planet point and every index is in range. This catches damaged files without hashing
+    // the archive first.
+    bool isConsistent() const
+    {
+        size_t n_points = alt_planet_points.size();
+        if (alt_point_lakes.size() != n_points || alt_planet_texcoords.size() != n_points ||
+            clim_mat_texco.size() != n_points || land_water_types.size() != n_points) return false;
+
+        auto triangles_in_range = [](const Archive::ArrayView<gfx::Triangle> &triangles, size_t n)
+        {
+            for (const gfx::Triangle &tri : triangles)
+                if (size_t(tri[0]) >= n || size_t(tri[1]) >= n || size_t(tri[2]) >= n) return false;
+            return true;
+        };
+        if (!triangles_in_range(alt_planet_triangles, n_points) ||
+            !triangles_in_range(alt_ocean_triangles, alt_ocean_points.size()) ||
+            !triangles_in_range(alt_lake_triangles, alt_lake_points.size())) return false;
+
+        for (const gfx::Line &line : alt_river_lines)
+            if (size_t(line[0]) >= n_points || size_t(line[1]) >= n_points) return false;
+        for (int lake : alt_point_lakes)
+            if (lake < -1 || lake >= int(alt_lakes.size())) return false;
+        for (const auto &lake : alt_lakes)
+            if (lake.firstPoint < 0 || lake.numPoints < 0 || size_t(lake.firstPoint + lake.numPoints) > alt_lake_points.size() ||
+                lake.firstTriangle < 0 || lake.numTriangles < 0 || size_t(lake.firstTriangle + lake.numTriangles) > alt_lake_triangles.size())
+                return false;
+        for (const auto &resource : resource_locations)
+            if (resource.point_index < 0 || size_t(resource.point_index) >= n_points) return false;
+        return true;
+    }
+
+    // copy the arrays out into state, leaving its planet shape alone
+    void copyTo(MacroState &state) const
+    {
+        state.alt_planet_points = alt_planet_points.toVector();
+        state.alt_planet_triangles = alt_planet_triangles.toVector();
+        state.alt_ocean_points = alt_ocean_points.toVector();
+        state.alt_ocean_triangles = alt_ocean_triangles.toVector();
+        state.alt_lake_points = alt_lake_points.toVector();
+        state.alt_lake_triangles = alt_lake_triangles.toVector();
+        state.alt_lakes = alt_lakes.toVector();
+        state.alt_point_lakes = alt_point_lakes.toVector();
+        state.alt_river_lines = alt_river_lines.toVector();
+        state.alt_planet_texcoords = alt_planet_texcoords.toVector();
+        state.clim_mat_texco = clim_mat_texco.toVector();
+        state.land_water_types = land_water_types.toVector();
+        state.resource_locations = resource_locations.toVector();
+    }
+};
+
+#define MACRO_STATE_ARCHIVE_ARRAYS(X)                   \
+    X(alt_planet_points,    "MPPT")                     \
+    X(alt_planet_triangles, "MPTR")                     \
+    X(alt_ocean_points,     "MOPT")                     \
+    X(alt_ocean_triangles,  "MOTR")                     \
+    X(alt_lake_points,      "MLPT")                     \
+    X(alt_lake_triangles,   "MLTR")                     \
+    X(alt_lakes,            "MLKS")                     \
+    X(alt_point_lakes,      "MPLK")                     \
+    X(alt_river_lines,      "MRLN")                     \
+    X(alt_planet_texcoords, "MPUV")                     \
+    X(clim_mat_texco,       "MCUV")                     \
+    X(land_water_types,     "MLWT")                     \
+    X(resource_locations,   "MRES")
+
+// state must stay alive until the writer has written
+inline void addToArchive(Archive::Writer &writer, const MacroState &state)
+{
+#define X(MEMBER, TAG) writer.add(Archive::tag(TAG), state.MEMBER);
+    MACRO_STATE_ARCHIVE_ARRAYS(X)
+#undef X
+}
+
+// false if the archive does not hold a MacroState
+inline bool viewFromArchive(const Archive::MappedFile &archive, MacroStateView &view)
+{
+#define X(MEMBER, TAG)                                                                              \
+    if (!archive.hasArrayOf<decltype(view.MEMBER)::value_type>(Archive::tag(TAG))) return false;    \
+    view.MEMBER = archive.view<decltype(view.MEMBER)::value_type>(Archive::tag(TAG));
+    MACRO_STATE_ARCHIVE_ARRAYS(X)
+#undef X
+    return true;
+}
+
+#undef MACRO_STATE_ARCHIVE_ARRAYS
+
 //}
 
 }